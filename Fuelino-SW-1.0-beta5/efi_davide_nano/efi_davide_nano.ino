@@ -13,6 +13,7 @@
 #include "src/GPSmgr/GPSmgr.h" // GPS manager
 #include "src/ADCmgr/ADCmgr.h" // ADC manager (Analog Inputs A0 - A7)
 #include "src/MPU6050mgr/MPU6050mgr.h" // IMU module (if present)
+#include "src/ISRmgr/ISRmgr.h" // ISR monitoring
 
 bool first_loop=true; // first time to execute the loop
 uint16_t time_last_gate = 0; // for loop minimum time check
@@ -21,11 +22,11 @@ uint16_t time_last_gate = 0; // for loop minimum time check
 void fuelino_yield(unsigned long time_now_ms){
   INJmgr.safety_check(time_now_ms); // Safety checks (checks if, from last function call, the injector has been deactivated at least one time)
   MPU6050mgr.manager(time_now_ms); // IMU communication manager
-  INJmgr.analog_digital_signals_acquisition(); // Acquires throttle position sensor and lambda signals
   //delay(1);
 }
 
 void setup(){
+  ISRmgr_init(); // ISR monitoring (trace pins)
   COMM_begin(); // Initializes serial communication ports
   INJmgr.begin(); // Injection and signal IO management
   EEPROM_initialize(); // EEPROM memory check, loads calibration maps and config word
@@ -47,13 +48,13 @@ void loop() {
 
   // Scheduled functions
   INJmgr.safety_check(time_now_tmp); // Safety checks (checks if, from last function call, the injector has been deactivated at least one time)
+  INJmgr.opening_time_update(); // Injector opening time, from battery voltage
   INJmgr.steady_state_eval(time_now_tmp); // Evaluates if engine is working in steady state conditions, to enable Lambda sensor signal logging
   MPU6050mgr.manager(time_now_tmp); // IMU communication manager
   COMM_receive_check(); // Serial Communication manager
   #if (GPS_PRESENT == 1) && (FUELINO_HW_VERSION >= 2) && (BLUETOOTH_PRESENT == 0)
   GPS_manager(); // GPS communication manager
   #endif
-  INJmgr.analog_digital_signals_acquisition(); // Acquires throttle position sensor signal
   SDmgr.log_SD_data(); // SD card data logging, as last, after checking all data
 
   // Loop time check (waiting cycles)
@@ -9,14 +9,44 @@
 #define ADCmgr_cpp
 
 #include "ADCmgr.h"
+#include <avr/pgmspace.h> // conversion schedule in flash
 #include "../INJmgr/INJmgr.h" // INJ manager. To have access to Timer0 reading
+#include "../ISRmgr/ISRmgr.h" // ISR monitoring (trace pins)
 
 // Variables needed for pin Analog Voltage acquisition
-volatile uint8_t ADCmgr_pin_read_now_index = 0; // Start from the first element of the array
+volatile uint8_t ADCmgr_schedule_slot = 0; // Slot of the schedule being converted. Start from the first element of the array
+#if ADCMGR_FREE_RUNNING
+volatile bool ADCmgr_schedule_resync = false; // Free Running: the schedule slipped (ADC interrupt delayed more than one conversion), the conversion in progress is on an unknown pin and restarts the schedule
+#endif
 const uint8_t ADCmgr_pins_order[] = {ADCMGR_DI1_PIN, ADCMGR_THROTTLE_PIN, ADCMGR_LAMBDA_PIN, ADCMGR_VBATTERY_PIN, ADCMGR_ENABLE_OR_INT_PIN, ADCMGR_TEMPERATURE_PIN};
+
+// Conversion schedule (measure indexes), walked one slot per conversion. Throttle and Lambda get 10 slots out of 11, the slow signals share the remaining one
+#define ADCMGR_SCHEDULE_FAST_PAIR ADCMGR_THROTTLE_INDEX, ADCMGR_LAMBDA_INDEX
+#define ADCMGR_SCHEDULE_GROUP(slow_index) ADCMGR_SCHEDULE_FAST_PAIR, ADCMGR_SCHEDULE_FAST_PAIR, ADCMGR_SCHEDULE_FAST_PAIR, ADCMGR_SCHEDULE_FAST_PAIR, ADCMGR_SCHEDULE_FAST_PAIR, slow_index
+const uint8_t ADCmgr_schedule[] PROGMEM = {ADCMGR_SCHEDULE_GROUP(ADCMGR_DI1_INDEX), ADCMGR_SCHEDULE_GROUP(ADCMGR_BATTERY_INDEX), ADCMGR_SCHEDULE_GROUP(ADCMGR_ENABLE_OR_INT_INDEX)};
+#if (ADCMGR_SCHEDULE_FAST_PAIRS != 5)
+	#error "ADCMGR_SCHEDULE_GROUP must contain ADCMGR_SCHEDULE_FAST_PAIRS pairs"
+#endif
+
+// Physical pin of a schedule slot
+inline uint8_t ADCmgr_schedule_pin(uint8_t slot){
+	return ADCmgr_pins_order[pgm_read_byte(&ADCmgr_schedule[slot])];
+}
 volatile uint8_t ADCmgr_pins_buffer_busy = 0; // buffer busy status. This flag is set when reading the status. 8 bits (1 bit per signal)
 volatile uint16_t ADCmgr_measures[ADCMGR_PINS_ORDER_SIZE]; // Analog value (0 .. 1023)
 volatile uint8_t ADCmgr_meas_binary = 0; // Digital value (0 .. 1) 8 bits (1 bit per signal)
+volatile uint8_t ADCmgr_battery_sample_cnt = 0; // Increased at each battery voltage sample
+
+// Oversampling (Throttle and Lambda). Index 0 is Throttle, 1 is Lambda
+#if ADCMGR_OVERSAMPLING_EXTRA_BITS
+#if (ADCMGR_LAMBDA_INDEX != (ADCMGR_THROTTLE_INDEX + 1)) || (ADCMGR_OVERSAMPLING_EXTRA_BITS > 3)
+	#error "Oversampling needs consecutive Throttle and Lambda indexes, and at most 3 extra bits"
+#endif
+#define ADCMGR_OVERSAMPLING_NUM 2 // Throttle, Lambda
+uint16_t ADCmgr_os_acc[ADCMGR_OVERSAMPLING_NUM] = {0}; // sum of the samples (up to 64 x 1023, fits 16 bits). Used only by ADC interrupt
+uint8_t ADCmgr_os_cnt[ADCMGR_OVERSAMPLING_NUM] = {0}; // samples summed
+volatile uint16_t ADCmgr_measures_ext[ADCMGR_OVERSAMPLING_NUM] = {0}; // decimated values, 10 + ADCMGR_OVERSAMPLING_EXTRA_BITS bits
+#endif
 
 // For debugging purpose (calculation of cycle time)
 #if ADCMGR_CYCLE_TIME_MEASURE // measure the cycle time
@@ -26,15 +56,31 @@ volatile bool ADCmgr_read_time_buf_busy = false; // flag set by Main Loop to loc
 #endif
 
 // For Lambda sensor buffer acquisition
-volatile uint8_t ADCmgr_lambda_acq_buf[ADCMGR_LAMBDA_ACQ_BUF_TOT]; // Lambda sensor signal values buffer
+volatile uint8_t ADCmgr_lambda_acq_buf[ADCMGR_LAMBDA_ACQ_BUF_NUM][ADCMGR_LAMBDA_ACQ_BUF_TOT]; // Lambda sensor signal values buffers (pool)
+volatile uint8_t ADCmgr_lambda_acq_buf_fill = 0; // Buffer of the pool being filled by ADC interrupt (header written by INJmgr). Next buffer (round robin) after each completed acquisition
 volatile uint8_t ADCmgr_lambda_acq_buf_index = ADCMGR_LAMBDA_ACQ_BUF_HEAD; // Index when storing Lambda sensor voltage on buffer
-volatile bool ADCmgr_lambda_acq_buf_filled = false; // Becomes true after the buffer is completely filled
-volatile uint16_t ADCmgr_lambda_acq_buf_time_start; // Time when first buffer sample is acquired
+volatile bool ADCmgr_lambda_acq_buf_filled[ADCMGR_LAMBDA_ACQ_BUF_NUM] = {false}; // Set by ADC interrupt after the buffer is completely filled (owned by SDmgr), cleared by SDmgr after writing it
+volatile uint32_t ADCmgr_lambda_acq_buf_time_start; // Time when first buffer sample is acquired
 volatile uint8_t ADCmgr_lambda_acq_prescaler_max = 0; // Prescaler to reduce the acquisition frequency of Lambda signal (max value)
 volatile uint8_t ADCmgr_lambda_acq_prescaler_cnt = 0; // Prescaler to reduce the acquisition frequency of Lambda signal (counter value)
 
+// Crank-synchronous Lambda acquisition
+#if ADCMGR_LAMBDA_SYNC_ENABLE
+#if !ADCMGR_FREE_RUNNING || (INJ_CHANNELS_NUM != 1)
+	#error "ADCMGR_LAMBDA_SYNC_ENABLE needs ADCMGR_FREE_RUNNING, and Timer1 compare B free (INJ_CHANNELS_NUM = 1)"
+#endif
+#define ADCMGR_LAMBDA_SYNC_STEP_MIN 832 // minimum time between 2 samples, Timer1 ticks (0.5us): the first sample (half step) comes 2 conversions (208us) after the injection start
+enum ADCmgr_lambda_sync_state_enum : uint8_t {LSYNC_IDLE = 0, LSYNC_STARTING, LSYNC_RUNNING, LSYNC_STOPPING}; // STARTING: the last Free Running conversions are not yet finished. STOPPING: the last triggered conversion is not yet finished, its interrupt restarts Free Running
+volatile ADCmgr_lambda_sync_state_enum ADCmgr_lambda_sync_state = LSYNC_IDLE; // acquisition status
+volatile uint8_t ADCmgr_lambda_sync_slot = 0; // next sample of the present engine cycle (ADCMGR_LAMBDA_SYNC_SLOTS: cycle completed, waiting for the next injection)
+volatile uint8_t ADCmgr_lambda_sync_cycle = 0; // engine cycles completed
+volatile uint8_t ADCmgr_lambda_sync_retries = 0; // engine cycles restarted
+volatile uint16_t ADCmgr_lambda_sync_step = 0; // time between 2 samples, Timer1 ticks (0.5us)
+#endif
+
 
 // Reads the ADC pin status, and returns the ADC value. Each conversion requires about 25 clock cycles (at 125kHz).
+// To be used only before "ADCmgr_init" (it stops the continuous acquisition)
 uint16_t ADCmgr_read_pin_now(uint8_t ADC_pin){
 
 	ADMUX &= 0xF0; // Removes previous pin setting
@@ -71,6 +117,19 @@ void ADCmgr_program_pin_read(uint8_t ADC_pin){
 }
 
 
+#if ADCMGR_FREE_RUNNING
+// Starts the Free Running conversions from slot "ADCmgr_schedule_slot". No conversion must be in progress
+void ADCmgr_free_running_start(){
+	uint8_t slot_next = ADCmgr_schedule_slot + 1;
+	if (slot_next >= ADCMGR_SCHEDULE_SIZE) slot_next = 0; // rollover
+	ADMUX = (ADMUX & 0xF0) | (ADCmgr_schedule_pin(ADCmgr_schedule_slot) & 0x0F); // First conversion pin
+	ADCSRA |= (1<<ADEN) | (1<<ADATE) | (1<<ADIE); // ADC enabled, auto trigger (ADCSRB = 0: Free Running mode), interrupt enabled
+	ADCSRA |= (1<<ADSC); // Start converting (the next conversions start automatically)
+	ADMUX = (ADMUX & 0xF0) | (ADCmgr_schedule_pin(slot_next) & 0x0F); // Second conversion pin: the multiplexer is read when each conversion starts
+}
+#endif
+
+
 // Initializes the ADC
 void ADCmgr_init(){
 	
@@ -90,9 +149,26 @@ void ADCmgr_init(){
 	// ADCSRB - ADC Control and Status Register B
 	ADCSRB = 0;
 	
-	ADCmgr_lambda_acq_buf[0] = 0x4C; // Lambda packet identifier ('L')
+	for (uint8_t n=0; n<ADCMGR_LAMBDA_ACQ_BUF_NUM; n++){
+#if ADCMGR_LAMBDA_SYNC_ENABLE && ADCMGR_LAMBDA_PACKED_10BIT
+		ADCmgr_lambda_acq_buf[n][0] = 0x58; // Synchronous Lambda packet identifier, 10 bits samples ('X')
+#elif ADCMGR_LAMBDA_SYNC_ENABLE
+		ADCmgr_lambda_acq_buf[n][0] = 0x53; // Synchronous Lambda packet identifier ('S')
+#elif ADCMGR_LAMBDA_PACKED_10BIT
+		ADCmgr_lambda_acq_buf[n][0] = 0x57; // Lambda packet identifier, 10 bits samples ('W')
+#else
+		ADCmgr_lambda_acq_buf[n][0] = 0x4C; // Lambda packet identifier ('L')
+#endif
+	}
 	
-	ADCmgr_program_pin_read(ADCmgr_pins_order[0]); // Starts the ADC conversion (which will then continue indefinitely)
+#if ADCMGR_FREE_RUNNING
+	#if ADCMGR_SCHEDULE_SIZE < 2
+		#error "ADCMGR_FREE_RUNNING needs at least 2 slots (the multiplexer is set one conversion ahead)"
+	#endif
+	ADCmgr_free_running_start(); // from the first slot
+#else
+	ADCmgr_program_pin_read(ADCmgr_schedule_pin(0)); // Starts the ADC conversion (which will then continue indefinitely)
+#endif
 }
 
 
@@ -105,6 +181,19 @@ uint16_t ADCmgr_throttle_signal_read(){
 }
 
 
+// Acquires throttle voltage signal from ADC module, with the oversampling resolution (10 + ADCMGR_OVERSAMPLING_EXTRA_BITS bits)
+uint16_t ADCmgr_throttle_signal_read_ext(){
+#if ADCMGR_OVERSAMPLING_EXTRA_BITS
+	ADCmgr_pins_buffer_busy |=  (1<<ADCMGR_THROTTLE_INDEX); // Locks buffer write access
+	uint16_t throttle_tmp_rd = ADCmgr_measures_ext[0]; // Reads throttle voltage from ADCmgr software module
+	ADCmgr_pins_buffer_busy &=  ~(1<<ADCMGR_THROTTLE_INDEX); // Unlocks buffer write access
+	return throttle_tmp_rd;
+#else
+	return ADCmgr_throttle_signal_read();
+#endif
+}
+
+
 // Acquires lambda voltage signal from ADC module
 uint16_t ADCmgr_lambda_signal_read(){
 	ADCmgr_pins_buffer_busy |=  (1<<ADCMGR_LAMBDA_INDEX); // Locks buffer write access
@@ -114,6 +203,40 @@ uint16_t ADCmgr_lambda_signal_read(){
 }
 
 
+// Acquires battery voltage signal from ADC module
+uint16_t ADCmgr_battery_signal_read(){
+	ADCmgr_pins_buffer_busy |=  (1<<ADCMGR_BATTERY_INDEX); // Locks buffer write access
+	uint16_t battery_tmp_rd = ADCmgr_measures[ADCMGR_BATTERY_INDEX]; // update buffer
+	ADCmgr_pins_buffer_busy &=  ~(1<<ADCMGR_BATTERY_INDEX); // Unlocks buffer write access
+	return battery_tmp_rd;
+}
+
+
+// Number of battery voltage samples acquired (8 bits, wraps). Changes when a new sample is available
+uint8_t ADCmgr_battery_sample_count_read(){
+	return ADCmgr_battery_sample_cnt;
+}
+
+
+// Acquires lambda voltage signal from ADC module, with the oversampling resolution (10 + ADCMGR_OVERSAMPLING_EXTRA_BITS bits)
+uint16_t ADCmgr_lambda_signal_read_ext(){
+#if ADCMGR_OVERSAMPLING_EXTRA_BITS
+	ADCmgr_pins_buffer_busy |=  (1<<ADCMGR_LAMBDA_INDEX); // Locks buffer write access
+	uint16_t lambda_tmp_rd = ADCmgr_measures_ext[1]; // update buffer
+	ADCmgr_pins_buffer_busy &=  ~(1<<ADCMGR_LAMBDA_INDEX); // Unlocks buffer write access
+	return lambda_tmp_rd;
+#else
+	return ADCmgr_lambda_signal_read();
+#endif
+}
+
+
+// Returns true if the next Lambda acquisition has a free buffer (the buffer to be filled is not waiting to be written on SD)
+bool ADCmgr_lambda_acq_buf_free(){
+	return !ADCmgr_lambda_acq_buf_filled[ADCmgr_lambda_acq_buf_fill];
+}
+
+
 // Acquires input battery voltage status
 uint8_t ADCmgr_battery_status_read(){
 	return ((ADCmgr_meas_binary & (1 << ADCMGR_BATTERY_INDEX)) >> ADCMGR_BATTERY_INDEX);
@@ -126,41 +249,218 @@ uint8_t ADCmgr_binary_inputs_status_read(){
 }
 
 
+// Stores one Lambda sample ("sample_index" 0 .. ADCMGR_LAMBDA_ACQ_BUF_SIZE-1) in the buffer being filled (ADC interrupt)
+inline void ADCmgr_lambda_acq_buf_store(uint8_t sample_index, uint8_t adc_L, uint8_t adc_H){
+	volatile uint8_t* data = &ADCmgr_lambda_acq_buf[ADCmgr_lambda_acq_buf_fill][ADCMGR_LAMBDA_ACQ_BUF_HEAD];
+#if ADCMGR_LAMBDA_PACKED_10BIT
+	uint8_t group = (sample_index >> 2) * 5; // 4 samples in 5 bytes
+	uint8_t pos = sample_index & 0x03; // position in the group
+	data[group + pos] = adc_L; // low 8 bits
+	uint8_t high_bits = (adc_H & 0x03) << (pos << 1); // bits 9-8, in the 5th byte of the group
+	if (pos == 0){
+		data[group + 4] = high_bits; // first sample of the group: old bits cleared
+	}else{
+		data[group + 4] |= high_bits;
+	}
+#else
+	data[sample_index] = (adc_H != 0) ? 0xFF : adc_L; // Save low byte (0 - 255), saturated to 0xFF (about 1.25V) if over
+#endif
+}
+
+
+// Hands the buffer just filled to SDmgr, and moves the acquisition to the next buffer of the pool (ADC interrupt)
+inline void ADCmgr_lambda_acq_buf_complete(){
+	ADCmgr_lambda_acq_buf_filled[ADCmgr_lambda_acq_buf_fill] = true; // Indicates that the buffer has been completely filled, and is now ready to use
+	uint8_t fill_next = ADCmgr_lambda_acq_buf_fill + 1;
+	if (fill_next >= ADCMGR_LAMBDA_ACQ_BUF_NUM) fill_next = 0; // rollover
+	ADCmgr_lambda_acq_buf_fill = fill_next;
+}
+
+
+#if ADCMGR_LAMBDA_SYNC_ENABLE
+// Returns to Free Running mode, from the pin after the last one converted. Interrupts must be disabled. Does not wait: if a conversion is in progress (or its interrupt is pending), the ADC interrupt restarts Free Running
+void ADCmgr_lambda_sync_stop(){
+	ADCSRA &= ~((1<<ADATE) | (1<<ADIF)); // Auto trigger disabled: compare B does not trigger conversions anymore (writing 0 leaves ADIF unchanged)
+	ADCSRB = 0; // Free Running mode, for the restart
+	if (ADCSRA & (_BV(ADSC) | _BV(ADIF))){ // conversion in progress, or its interrupt not yet executed
+		ADCmgr_lambda_sync_state = LSYNC_STOPPING; // its result is discarded by the interrupt, which restarts Free Running
+	}else{
+		ADCmgr_lambda_sync_state = LSYNC_IDLE;
+		ADCmgr_free_running_start();
+	}
+}
+
+
+// Injection start on the first injector (injection interrupt). Starts the acquisition if requested, or starts the sample slots of the next engine cycle
+void ADCmgr_lambda_sync_injection(uint16_t timer1_now, uint32_t delta_time_tick){
+	
+	uint32_t step_32 = (delta_time_tick << 3) >> (5 - ADCMGR_LAMBDA_SYNC_CYCLES_SHIFT); // 4us -> 0.5us ticks, divided by the slots number
+	bool step_ok = (step_32 >= ADCMGR_LAMBDA_SYNC_STEP_MIN) && (step_32 <= 0xFFFF); // range check (2 conversions between samples, no Timer1 wrap)
+	
+	if (ADCmgr_lambda_sync_state == LSYNC_STOPPING) return; // last triggered conversion not yet finished
+	if (ADCmgr_lambda_sync_state == LSYNC_IDLE){
+		if ((ADCmgr_lambda_acq_prescaler_max == 0) || (!ADCmgr_lambda_acq_buf_free()) || (!step_ok)) return; // no request, no buffer free (pool not yet written on SD), or rpm out of range
+		ADCmgr_lambda_sync_cycle = 0;
+		ADCmgr_lambda_sync_retries = 0;
+		ADCmgr_lambda_sync_state = LSYNC_STARTING; // the next ADC interrupt sets the multiplexer on Lambda pin
+		TIFR1 = _BV(OCF1B); // clears any old compare match: the ADC is triggered by the flag rising edge
+		ADCSRB = (1<<ADTS2) | (1<<ADTS0); // Auto trigger source: Timer1 Compare Match B (the conversion in progress is completed)
+	}else{
+		if ((ADCmgr_lambda_sync_slot < ADCMGR_LAMBDA_SYNC_SLOTS) || (!step_ok)){ // engine cycle shorter than the measured one: the cycles captured have not the expected phase
+			if ((++ADCmgr_lambda_sync_retries > ADCMGR_LAMBDA_SYNC_RETRIES_MAX) || (!step_ok)){ // not in steady state anymore
+				ADCmgr_lambda_sync_stop();
+				ADCmgr_lambda_acq_prescaler_max = 0; // Filling request turned OFF
+				return;
+			}
+			ADCmgr_lambda_sync_cycle = 0; // restarts from this cycle
+		}
+	}
+	
+	ADCmgr_lambda_sync_step = (uint16_t)step_32; // measured on the last engine cycle
+	ADCmgr_lambda_sync_slot = 0;
+	OCR1B = timer1_now + (uint16_t)(step_32 >> 1); // first sample: half step after the injection start
+	TIFR1 = _BV(OCF1B); // clears any old compare match
+	
+}
+
+
+// Stops the synchronous acquisition (engine stopped). Interrupts must be disabled
+void ADCmgr_lambda_sync_abort(){
+	if ((ADCmgr_lambda_sync_state == LSYNC_STARTING) || (ADCmgr_lambda_sync_state == LSYNC_RUNNING)){
+		ADCmgr_lambda_sync_stop();
+		ADCmgr_lambda_acq_prescaler_max = 0; // Filling request turned OFF
+	}
+}
+
+
+// Stores one Lambda sample converted at the time of a slot (ADC interrupt)
+inline void ADCmgr_lambda_sync_sample(uint8_t adc_L, uint8_t adc_H){
+	
+	uint8_t slot = ADCmgr_lambda_sync_slot;
+	if (slot >= ADCMGR_LAMBDA_SYNC_SLOTS) return; // Timer1 wrapped over OCR1B while waiting for the next injection: not a slot
+	
+	uint8_t sample_index = (ADCmgr_lambda_sync_cycle << (5 - ADCMGR_LAMBDA_SYNC_CYCLES_SHIFT)) + slot;
+	if (sample_index == 0) ADCmgr_lambda_acq_buf_time_start = INJmgr.Timer0_tick_counts(); // First element of the buffer. 1 tick = 4us
+	ADCmgr_lambda_acq_buf_store(sample_index, adc_L, adc_H);
+	
+	slot++;
+	if (slot < ADCMGR_LAMBDA_SYNC_SLOTS){
+		OCR1B += ADCmgr_lambda_sync_step; // next slot
+		TIFR1 = _BV(OCF1B); // clears the compare match, for the next trigger edge
+	}else if (++ADCmgr_lambda_sync_cycle >= (1 << ADCMGR_LAMBDA_SYNC_CYCLES_SHIFT)){ // all the cycles acquired
+		uint32_t time_delta_32 = INJmgr.Timer0_tick_counts() - ADCmgr_lambda_acq_buf_time_start; // Total acquisition period between first and last sample
+		uint16_t time_delta_buf = (time_delta_32 > 0xFFFF) ? 0xFFFF : (uint16_t)time_delta_32; // saturated to the 2 bytes of the buffer tail
+		ADCmgr_lambda_acq_buf[ADCmgr_lambda_acq_buf_fill][(ADCMGR_LAMBDA_ACQ_BUF_HEAD + ADCMGR_LAMBDA_ACQ_BUF_DATA)] = (uint8_t)(time_delta_buf & 0xff); // LSB
+		ADCmgr_lambda_acq_buf[ADCmgr_lambda_acq_buf_fill][(ADCMGR_LAMBDA_ACQ_BUF_HEAD + ADCMGR_LAMBDA_ACQ_BUF_DATA) + 1] = (uint8_t)((time_delta_buf >> 8) & 0xff); // MSB
+		ADCmgr_lambda_sync_stop(); // back to Free Running
+		ADCmgr_lambda_acq_prescaler_max = 0; // Filling request turned OFF (need a new request to start filling again)
+		ADCmgr_lambda_acq_buf_complete(); // the buffer is ready for SD, the next acquisition uses the next one
+	}
+	ADCmgr_lambda_sync_slot = slot;
+	
+}
+#endif
+
+
 // Interrupt service routine for the ADC completion
 ISR(ADC_vect){
 
+	ISR_TRACE_ADC_BEGIN(); // Trace pin HIGH
+	ISR_STATS_BEGIN(); // Execution time statistics
+
 	// Read ADC measurement
 	uint8_t adc_L = ADCL; // low part
 	uint8_t adc_H = ADCH; // high part
+#if ADCMGR_LAMBDA_SYNC_ENABLE
+	if (ADCmgr_lambda_sync_state == LSYNC_RUNNING){ // conversion triggered by a sample slot: Lambda pin
+		ADCmgr_lambda_sync_sample(adc_L, adc_H);
+		ISR_STATS_END(ISR_ID_ADC); // Execution time statistics
+		ISR_TRACE_ADC_END(); // Trace pin LOW
+		return;
+	}
+	if (ADCmgr_lambda_sync_state == LSYNC_STOPPING){ // last conversion of the stopped acquisition (Lambda pin, or Free Running pin if stopped while starting): discarded
+		ADCmgr_lambda_sync_state = LSYNC_IDLE;
+		ADCmgr_free_running_start(); // back to Free Running, from the pin after the last one converted
+		ISR_STATS_END(ISR_ID_ADC); // Execution time statistics
+		ISR_TRACE_ADC_END(); // Trace pin LOW
+		return;
+	}
+#endif
+#if ADCMGR_FREE_RUNNING
+	// The next conversion has already started (on slot "ADCmgr_schedule_slot + 1"): the multiplexer is set for the one after it
+	uint8_t slot_program = ADCmgr_schedule_slot + 2;
+	if (slot_program >= ADCMGR_SCHEDULE_SIZE) slot_program -= ADCMGR_SCHEDULE_SIZE; // rollover
+	ADMUX = (ADMUX & 0xF0) | (ADCmgr_schedule_pin(slot_program) & 0x0F); // Pin number setting
+	#if ADCMGR_LAMBDA_SYNC_ENABLE
+	if (ADCmgr_lambda_sync_state == LSYNC_STARTING){ // the next conversions are triggered by the sample slots, on Lambda pin
+		ADMUX = (ADMUX & 0xF0) | (ADCMGR_LAMBDA_PIN & 0x0F);
+		if (!(ADCSRA & _BV(ADSC))) ADCmgr_lambda_sync_state = LSYNC_RUNNING; // no Free Running conversion still in progress (this interrupt was delayed)
+	}
+	if (ADCmgr_lambda_sync_state == LSYNC_IDLE)
+	#endif
+	if (ADCSRA & _BV(ADIF)){ // Slip: another conversion has finished since this interrupt was triggered, the one in progress was started before the multiplexer was set (pin not known)
+		ADMUX = (ADMUX & 0xF0) | (ADCmgr_schedule_pin(0) & 0x0F); // the schedule restarts from the first slot, after the conversion in progress
+		ADCSRA |= (1<<ADIF); // the result of the finished conversion is lost (flag is cleared writing 1)
+		ADCmgr_schedule_slot = ADCMGR_SCHEDULE_SIZE - 1; // the conversion in progress is handled as the slot before the first one
+		ADCmgr_schedule_resync = true; // its result is dropped
+		ISR_STATS_END(ISR_ID_ADC); // Execution time statistics
+		ISR_TRACE_ADC_END(); // Trace pin LOW
+		return; // this sample is dropped (it may belong to the next slot)
+	}
+	if (ADCmgr_schedule_resync){ // conversion started while the schedule slipped (pin not known): dropped. The conversion in progress is the first slot
+		ADCmgr_schedule_resync = false;
+		ADCmgr_schedule_slot = 0;
+		ISR_STATS_END(ISR_ID_ADC); // Execution time statistics
+		ISR_TRACE_ADC_END(); // Trace pin LOW
+		return;
+	}
+#else
 	ADCSRA &= ~(1<<ADEN); // Disables the ADC - Bit 7 - ADEN: ADC Enable
-	if (!(ADCmgr_pins_buffer_busy & (1 << ADCmgr_pin_read_now_index))) ADCmgr_measures[ADCmgr_pin_read_now_index] = ((uint16_t)adc_H << 8) | (uint16_t)adc_L; // Calculates the ADC value (2 bytes) and stores it into the buffer, if not busy
+#endif
+	uint16_t adc_value = ((uint16_t)adc_H << 8) | (uint16_t)adc_L; // Calculates the ADC value (2 bytes)
+	uint8_t meas_index = pgm_read_byte(&ADCmgr_schedule[ADCmgr_schedule_slot]); // signal converted
+#if ADCMGR_OVERSAMPLING_EXTRA_BITS
+	uint8_t os_index = meas_index - ADCMGR_THROTTLE_INDEX; // 0: Throttle, 1: Lambda (other pins: out of range)
+	if (os_index < ADCMGR_OVERSAMPLING_NUM){ // Throttle or Lambda: boxcar sum, then decimation
+		ADCmgr_os_acc[os_index] += adc_value;
+		if (++ADCmgr_os_cnt[os_index] >= ADCMGR_OVERSAMPLING_RATIO){ // a new decimated value is ready
+			uint16_t value_ext = ADCmgr_os_acc[os_index] >> ADCMGR_OVERSAMPLING_EXTRA_BITS; // 10 + n bits
+			if (!(ADCmgr_pins_buffer_busy & (1 << meas_index))){ // stores it into the buffers, if not busy
+				ADCmgr_measures_ext[os_index] = value_ext;
+				ADCmgr_measures[meas_index] = value_ext >> ADCMGR_OVERSAMPLING_EXTRA_BITS; // 10 bits, same scale as without oversampling
+			}
+			ADCmgr_os_acc[os_index] = 0;
+			ADCmgr_os_cnt[os_index] = 0;
+		}
+	}
+	else
+#endif
+	if (!(ADCmgr_pins_buffer_busy & (1 << meas_index))) ADCmgr_measures[meas_index] = adc_value; // stores the value into the buffer, if not busy
 	if (adc_H == 0) {
-		ADCmgr_meas_binary &= ~(1 << ADCmgr_pin_read_now_index); // OFF, if <= 255
+		ADCmgr_meas_binary &= ~(1 << meas_index); // OFF, if <= 255
 	}else{
-		ADCmgr_meas_binary |= (1 << ADCmgr_pin_read_now_index); // ON, if >= 256
+		ADCmgr_meas_binary |= (1 << meas_index); // ON, if >= 256
 	}
 
 	// Check if there is anything special to do with the present measured signal
-	switch (ADCmgr_pins_order[ADCmgr_pin_read_now_index]){
+	switch (ADCmgr_pins_order[meas_index]){
+		#if !ADCMGR_LAMBDA_SYNC_ENABLE
 		case ADCMGR_LAMBDA_PIN: // Lambda sensor signal acquired
-			if ((ADCmgr_lambda_acq_prescaler_max) && (ADCmgr_lambda_acq_buf_filled == false)){ // Filling request coming from external module, and the buffer is not yet filled completely
+			if ((ADCmgr_lambda_acq_prescaler_max) && ADCmgr_lambda_acq_buf_free()){ // Filling request coming from external module, and the buffer is not yet filled completely
 				ADCmgr_lambda_acq_prescaler_cnt++; // divider
-				if (ADCmgr_lambda_acq_prescaler_cnt >= ADCmgr_lambda_acq_prescaler_max){ // divider
+				if (ADCmgr_lambda_acq_prescaler_cnt >= (ADCmgr_lambda_acq_prescaler_max << ADCMGR_LAMBDA_PRESCALER_SHIFT)){ // divider
 					ADCmgr_lambda_acq_prescaler_cnt = 0; // divider
 					if (ADCmgr_lambda_acq_buf_index == ADCMGR_LAMBDA_ACQ_BUF_HEAD) ADCmgr_lambda_acq_buf_time_start = INJmgr.Timer0_tick_counts(); // First element of the buffer. 1 tick = 4us
-					if (adc_H != 0) { // Over 1.25V
-						ADCmgr_lambda_acq_buf[ADCmgr_lambda_acq_buf_index] = 0xFF; // Saturation to max value, about 1.25V
-					}else{
-						ADCmgr_lambda_acq_buf[ADCmgr_lambda_acq_buf_index] = adc_L; // Save low byte (0 - 255), 255 corresponds to a max value of about 1.25V
-					}
+					ADCmgr_lambda_acq_buf_store(ADCmgr_lambda_acq_buf_index - ADCMGR_LAMBDA_ACQ_BUF_HEAD, adc_L, adc_H); // 1 byte (saturated at about 1.25V), or 10 bits packed
 					ADCmgr_lambda_acq_buf_index++; // increase counter
 					if (ADCmgr_lambda_acq_buf_index >= (ADCMGR_LAMBDA_ACQ_BUF_HEAD+ADCMGR_LAMBDA_ACQ_BUF_SIZE)){ // the Lambda buffer has been completely filled
-						uint16_t ADCmgr_lambda_acq_buf_time_delta_buf = INJmgr.Timer0_tick_counts() - ADCmgr_lambda_acq_buf_time_start; // Total acquisition period between first and last sample
-						ADCmgr_lambda_acq_buf[(ADCMGR_LAMBDA_ACQ_BUF_HEAD + ADCMGR_LAMBDA_ACQ_BUF_SIZE)] = (uint8_t)(ADCmgr_lambda_acq_buf_time_delta_buf & 0xff); // LSB
-						ADCmgr_lambda_acq_buf[(ADCMGR_LAMBDA_ACQ_BUF_HEAD + ADCMGR_LAMBDA_ACQ_BUF_SIZE) + 1] = (uint8_t)((ADCmgr_lambda_acq_buf_time_delta_buf >> 8) & 0xff); // MSB
+						uint32_t ADCmgr_lambda_acq_buf_time_delta_32 = INJmgr.Timer0_tick_counts() - ADCmgr_lambda_acq_buf_time_start; // Total acquisition period between first and last sample
+						uint16_t ADCmgr_lambda_acq_buf_time_delta_buf = (ADCmgr_lambda_acq_buf_time_delta_32 > 0xFFFF) ? 0xFFFF : (uint16_t)ADCmgr_lambda_acq_buf_time_delta_32; // saturated to the 2 bytes of the buffer tail
+						ADCmgr_lambda_acq_buf[ADCmgr_lambda_acq_buf_fill][(ADCMGR_LAMBDA_ACQ_BUF_HEAD + ADCMGR_LAMBDA_ACQ_BUF_DATA)] = (uint8_t)(ADCmgr_lambda_acq_buf_time_delta_buf & 0xff); // LSB
+						ADCmgr_lambda_acq_buf[ADCmgr_lambda_acq_buf_fill][(ADCMGR_LAMBDA_ACQ_BUF_HEAD + ADCMGR_LAMBDA_ACQ_BUF_DATA) + 1] = (uint8_t)((ADCmgr_lambda_acq_buf_time_delta_buf >> 8) & 0xff); // MSB
 						ADCmgr_lambda_acq_buf_index = ADCMGR_LAMBDA_ACQ_BUF_HEAD; // Set the counter to first value, for next use
 						ADCmgr_lambda_acq_prescaler_max = 0; // Filling request turned OFF (need a new request to start filling again)
-						ADCmgr_lambda_acq_buf_filled = true; // Indicates that the buffer has been completely filled, and is now ready to use
+						ADCmgr_lambda_acq_buf_complete(); // the buffer is ready for SD, the next acquisition uses the next one
 					}
 				}
 			}else{ // no need to fill the buffer
@@ -168,6 +468,11 @@ ISR(ADC_vect){
 				ADCmgr_lambda_acq_prescaler_cnt = 0; // prescaler counter initialized to 0
 			}
 			break;
+		#endif
+		
+		case ADCMGR_VBATTERY_PIN: // Battery voltage acquired
+			ADCmgr_battery_sample_cnt++; // new sample available
+			break;
 		  
 		default:
 			break;
@@ -175,19 +480,24 @@ ISR(ADC_vect){
 	}
 
 	// Programs the next ADC reading
-	ADCmgr_pin_read_now_index++; // Increase pin
-	if (ADCmgr_pin_read_now_index == ADCMGR_PINS_ORDER_SIZE) { // Read all pins
-		ADCmgr_pin_read_now_index = 0; // restart from the first pin
+	ADCmgr_schedule_slot++; // Next slot
+	if (ADCmgr_schedule_slot == ADCMGR_SCHEDULE_SIZE) { // Complete schedule converted
+		ADCmgr_schedule_slot = 0; // restart from the first slot
 		// Cycle time calculation
 		#if ADCMGR_CYCLE_TIME_MEASURE // measure the cycle time
 		uint16_t ADCmgr_read_time_start = ADCmgr_read_time_end; // starting time is the time at which it ended last measurement cycle
-		ADCmgr_read_time_end = INJmgr.Timer0_tick_counts(); // 1 tick = 4us
+		ADCmgr_read_time_end = (uint16_t)INJmgr.Timer0_tick_counts(); // 1 tick = 4us
 		if (ADCmgr_read_time_buf_busy == false){ // if the buffer is not being used, update the buffer
 			ADCmgr_read_time_delta_buf = ADCmgr_read_time_end - ADCmgr_read_time_start; // time required for one complete cycle of acquisitions
 		}
 		#endif
 	}
-	ADCmgr_program_pin_read(ADCmgr_pins_order[ADCmgr_pin_read_now_index]); // programs the next ADC read
+#if !ADCMGR_FREE_RUNNING
+	ADCmgr_program_pin_read(ADCmgr_schedule_pin(ADCmgr_schedule_slot)); // programs the next ADC read
+#endif
+
+	ISR_STATS_END(ISR_ID_ADC); // Execution time statistics
+	ISR_TRACE_ADC_END(); // Trace pin LOW
 
 }
 
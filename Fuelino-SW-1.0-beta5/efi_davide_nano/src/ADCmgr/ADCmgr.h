@@ -9,7 +9,8 @@
 #define ADCmgr_h
 
 #include <Arduino.h>
-#define ADCMGR_CYCLE_TIME_MEASURE 0 // Defines if needed to measure the cycle time ("ADCMGR_PINS_ORDER_SIZE" measures)
+#define ADCMGR_CYCLE_TIME_MEASURE 0 // Defines if needed to measure the cycle time (complete schedule, "ADCMGR_SCHEDULE_SIZE" conversions)
+#define ADCMGR_FREE_RUNNING 1 // 1: ADC always enabled, auto triggered in Free Running mode (13 ADC clocks = 104us per sample, fixed period), the pin multiplexer is set one conversion ahead (if the ADC interrupt is delayed more than one conversion, the samples are dropped and the schedule restarts). 0: ADC enabled at each conversion (25 ADC clocks = 200us per sample)
 #define ADCMGR_DI1_PIN 0 // Digital Input DI1 (A0)
 #define ADCMGR_THROTTLE_PIN 2 // Throttle Pin (A2)
 #define ADCMGR_LAMBDA_PIN 3 // Lambda Pin (A3)
@@ -17,15 +18,38 @@
 #define ADCMGR_ENABLE_OR_INT_PIN 7 // ENABLE_OR_INT (A6)
 #define ADCMGR_TEMPERATURE_PIN 8 // Internal Temperature
 #define ADCMGR_PINS_ORDER_SIZE 5 // Number of pins to be read continuously (max should be 8!!!)
+#define ADCMGR_SCHEDULE_FAST_PAIRS 5 // Schedule: Throttle and Lambda are converted in 5 pairs of slots, then one slot goes to the next slow signal (DI1, Battery, ENABLE_OR_INT)
+#define ADCMGR_SCHEDULE_SIZE (3 * (2 * ADCMGR_SCHEDULE_FAST_PAIRS + 1)) // Slots of the complete schedule (33 conversions = 3.4ms in Free Running)
 #define ADCMGR_LAMBDA_ACQ_BUF_HEAD 9 // Header size (0x4C, Engine info 4x2 bytes)
-#define ADCMGR_LAMBDA_ACQ_BUF_SIZE 32 // Total acquisitions of Lambda Sensor voltage (single byte, 0 - 255)
+#define ADCMGR_LAMBDA_ACQ_BUF_SIZE 32 // Total acquisitions of Lambda Sensor voltage (samples)
+#define ADCMGR_LAMBDA_PACKED_10BIT 0 // 1: full range 10 bits samples (0 - 1023, 0 - 5V), 4 samples packed in 5 bytes ('W' packet, 'X' if synchronous). 0: single byte samples (0 - 255), saturated at about 1.25V ('L' packet, 'S' if synchronous)
+// Packed format, group g of 5 bytes (b0 .. b4) holds samples 4g .. 4g+3: sample(4g+k) = bk | (((b4 >> (2*k)) & 0x03) << 8), k = 0 .. 3. Host decoder of SD logs: test/host/lambda_decode
+#if ADCMGR_LAMBDA_PACKED_10BIT
+	#define ADCMGR_LAMBDA_ACQ_BUF_DATA ((ADCMGR_LAMBDA_ACQ_BUF_SIZE >> 2) * 5) // Data bytes (40)
+#else
+	#define ADCMGR_LAMBDA_ACQ_BUF_DATA ADCMGR_LAMBDA_ACQ_BUF_SIZE // Data bytes (32)
+#endif
+#define ADCMGR_LAMBDA_ACQ_BUF_NUM 2 // Lambda buffers pool: an acquisition can be filled while the previous one is waiting for SD writing
 #define ADCMGR_LAMBDA_ACQ_BUF_TAIL 4 // Tail size (acquisition time + delta_time_tick)
-#define ADCMGR_LAMBDA_ACQ_BUF_TOT (ADCMGR_LAMBDA_ACQ_BUF_HEAD + ADCMGR_LAMBDA_ACQ_BUF_SIZE + ADCMGR_LAMBDA_ACQ_BUF_TAIL + 2) // Total size of packet: header, data, tail, checksum
+#define ADCMGR_OVERSAMPLING_EXTRA_BITS 2 // Throttle and Lambda oversampling: 4^n samples are summed (boxcar) and decimated, giving 10+n bits (0 = off, max 3). 2 = 16 samples, 12 bits, one value each 3.7ms (Free Running)
+#define ADCMGR_OVERSAMPLING_RATIO (1 << (2 * ADCMGR_OVERSAMPLING_EXTRA_BITS)) // samples per decimated value
+#if ADCMGR_FREE_RUNNING
+	#define ADCMGR_LAMBDA_PRESCALER_SHIFT 2 // Lambda acquisition prescaler x4: Lambda is converted each 229us on average (15 slots out of 33), about the same acquisition window as one sample per 1ms
+#else
+	#define ADCMGR_LAMBDA_PRESCALER_SHIFT 0
+#endif
+#define ADCMGR_LAMBDA_SYNC_ENABLE 0 // 1: crank-synchronous Lambda acquisition ('S' packet): sample k of each engine cycle is converted at (2k+1)/2 x delta_time_tick / ADCMGR_LAMBDA_SYNC_SLOTS after the injection start (Timer1 compare B triggers the ADC). Needs ADCMGR_FREE_RUNNING and INJ_CHANNELS_NUM = 1
+#define ADCMGR_LAMBDA_SYNC_CYCLES_SHIFT 1 // engine cycles (2 rpm) in one synchronous packet: 2e1 = 2 cycles
+#define ADCMGR_LAMBDA_SYNC_SLOTS (ADCMGR_LAMBDA_ACQ_BUF_SIZE >> ADCMGR_LAMBDA_SYNC_CYCLES_SHIFT) // samples per engine cycle (16)
+#define ADCMGR_LAMBDA_SYNC_RETRIES_MAX 4 // engine cycles shorter than the measured one (sample slots not completed) accepted before giving up the synchronous acquisition
+#define ADCMGR_LAMBDA_ACQ_BUF_TOT (ADCMGR_LAMBDA_ACQ_BUF_HEAD + ADCMGR_LAMBDA_ACQ_BUF_DATA + ADCMGR_LAMBDA_ACQ_BUF_TAIL + 2) // Total size of packet: header, data, tail, checksum
 
-// Indexes of arrays "ADCmgr_pins_order[]" and "ADCmgr_measures[ADCMGR_PINS_ORDER_SIZE]" in which the info is stored
+// Indexes of arrays "ADCmgr_pins_order[]" and "ADCmgr_measures[ADCMGR_PINS_ORDER_SIZE]" in which the info is stored (the schedule contains these indexes)
+#define ADCMGR_DI1_INDEX 0 // Index to read DI1 signal from ADC module
 #define ADCMGR_THROTTLE_INDEX 1 // Index to read Throttle signal from ADC module
 #define ADCMGR_LAMBDA_INDEX 2 // Index to read Lambda signal from ADC module
 #define ADCMGR_BATTERY_INDEX 3 // Index to read Battery signal from ADC module
+#define ADCMGR_ENABLE_OR_INT_INDEX 4 // Index to read ENABLE_OR_INT signal from ADC module
 
 // Variables
 //extern const uint8_t ADCmgr_pins_order[]; // Contains the physical number of the Analog pin to be read (example: [A]1, [A]2, ..., [A]7)
@@ -40,9 +64,14 @@ extern volatile bool ADCmgr_read_time_buf_busy; // becomes "true" when Main Loop
 #endif
 
 // For Lambda sensor buffer acquisition
-extern volatile uint8_t ADCmgr_lambda_acq_buf[]; // Lambda sensor signal values buffer
-extern volatile bool ADCmgr_lambda_acq_buf_filled; // Becomes true after the buffer is completely filled
+extern volatile uint8_t ADCmgr_lambda_acq_buf[ADCMGR_LAMBDA_ACQ_BUF_NUM][ADCMGR_LAMBDA_ACQ_BUF_TOT]; // Lambda sensor signal values buffers (pool)
+extern volatile uint8_t ADCmgr_lambda_acq_buf_fill; // Buffer of the pool being filled
+extern volatile bool ADCmgr_lambda_acq_buf_filled[]; // Becomes true after the buffer is completely filled (SDmgr writes it, then sets it to false)
 extern volatile uint8_t ADCmgr_lambda_acq_prescaler_max; // Prescaler to reduce the acquisition frequency of Lambda signal (max value)
+#if ADCMGR_LAMBDA_SYNC_ENABLE
+extern void ADCmgr_lambda_sync_injection(uint16_t timer1_now, uint32_t delta_time_tick); // Injection start (first injector), called by the injection interrupt
+extern void ADCmgr_lambda_sync_abort(); // Stops the synchronous acquisition (engine stopped), interrupts must be disabled. Does not wait for the conversion in progress
+#endif
 
 // Functions
 extern void ADCmgr_init(); // Initialization
@@ -52,7 +81,12 @@ extern uint16_t ADCmgr_read_pin_now(uint8_t ADC_pin); // Read pin voltage, waits
 // For reading Throttle and Lambda and Battery Status signals
 extern uint16_t ADCmgr_throttle_signal_read();
 extern uint16_t ADCmgr_lambda_signal_read();
+extern uint16_t ADCmgr_throttle_signal_read_ext(); // 10 + ADCMGR_OVERSAMPLING_EXTRA_BITS bits
+extern uint16_t ADCmgr_lambda_signal_read_ext(); // 10 + ADCMGR_OVERSAMPLING_EXTRA_BITS bits
+extern uint16_t ADCmgr_battery_signal_read();
+extern uint8_t ADCmgr_battery_sample_count_read();
 extern uint8_t ADCmgr_battery_status_read();
 extern uint8_t ADCmgr_binary_inputs_status_read();
+extern bool ADCmgr_lambda_acq_buf_free(); // The next Lambda acquisition has a free buffer
 
 #endif
\ No newline at end of file
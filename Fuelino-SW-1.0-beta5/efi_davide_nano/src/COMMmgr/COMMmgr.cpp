@@ -6,12 +6,17 @@
 #include "../SDmgr/SDmgr.h"
 #include "../ADCmgr/ADCmgr.h" // ADC manager. To have access to Analog readings
 #include "../MPU6050mgr/MPU6050mgr.h" // IMU manager. To have access to IMU readings
+#include "../ISRmgr/ISRmgr.h" // ISR monitoring. To have access to ISR execution time statistics
 #include "../compile_options.h"
 #include "COMMmgr.h"
 
 #define COMM_SERIAL_RECV_BYTES_NUM 8 // Buffer size for incoming data from SW and HW serial
 #define COMM_SERIAL_STR_LEN_MAX 26 // Temporary buffer for string conversion (26 bytes should be enough for GPS config message)
 
+#if INJ_MAP_2D_ENABLE && ((INJ_MAP_2D_RPM_SIZE > 16) || (INJ_MAP_2D_THR_SIZE > 16))
+	#error "2D map index is sent as 2 hex digits (rpm, throttle): maximum size is 16 x 16"
+#endif
+
 uint8_t serial_inbyte_HW[COMM_SERIAL_RECV_BYTES_NUM]; // buffer for data received by Serial (HW seriale)
 uint8_t serial_inbyte_SW[COMM_SERIAL_RECV_BYTES_NUM]; // buffer for data received by Serial (SW seriale)
 uint8_t serial_byte_cnt_HW = 0; // contatore di numero bytes ricevuti in seriale
@@ -98,6 +103,39 @@ uint8_t COMM_convert_char_array_to_num(uint8_t* input_array, uint8_t array_start
 }
 
 
+// Converts a character hexadecimal number (0-9, A-F) into an unsigned int number
+uint8_t COMM_convert_char_array_to_hex_num(uint8_t* input_array, uint8_t array_start, uint8_t array_len){
+	uint8_t output_value = 0;
+	for (uint8_t i=0;i<array_len;i++){
+		uint8_t cypher_tmp = input_array[array_start+i];
+		if ((cypher_tmp >= '0') && (cypher_tmp <= '9')){
+			cypher_tmp -= '0';
+		}else if ((cypher_tmp >= 'A') && (cypher_tmp <= 'F')){
+			cypher_tmp -= ('A' - 10);
+		}else{
+			return 0x00; // not valid number
+		}
+		output_value = (output_value << 4) | cypher_tmp;
+	}
+	return output_value;
+}
+
+
+// Adds the calibration map index to the reply message (2 cyphers: decimal for 1D maps, hexadecimal "rpm throttle" for the 2D map)
+void COMM_add_map_index(String& message_string, uint8_t map_num, uint8_t map_index){
+#if INJ_MAP_2D_ENABLE
+	if (map_num == INJ_MAP_2D_NUM){
+		const char hex_cyphers[] = "0123456789ABCDEF";
+		message_string += hex_cyphers[map_index >> 4]; // rpm index
+		message_string += hex_cyphers[map_index & 0x0F]; // throttle index
+		return;
+	}
+#endif
+	if (map_index < 10) message_string += F("0"); // Index
+	message_string += map_index; // Index
+}
+
+
 // Sends NACK
 void COMM_send_nack(String nack_code, COMM_destination_port_enum send_port){
 	COMM_Send_String(send_port, nack_code, true); // // NACK reply
@@ -148,19 +186,27 @@ uint8_t COMM_evaluate_parameter_read_writing_request(uint8_t* data_array, uint8_
 		uint8_t map_num = COMM_convert_char_array_to_num(data_array, 2, 1);
 		uint8_t sum_index = COMM_convert_char_array_to_num(data_array, 3, 2);
 		uint8_t sum_value = COMM_convert_char_array_to_num(data_array, 5, 3);
+		#if INJ_MAP_2D_ENABLE
+		if (map_num == INJ_MAP_2D_NUM) sum_index = COMM_convert_char_array_to_hex_num(data_array, 3, 2); // 2D map: c n 3 XY vvv (X = rpm index, Y = throttle index, hexadecimal)
+		#endif
 		singleMessageString += F("c"); // (Header)
 		singleMessageString += read_write; // Read (0) or Write (1)
 		singleMessageString += map_num; // Map number
-		if ((read_write==0) && (sum_value == 0)){ // Read from RAM
+		if ((read_write==0) && (sum_value == 0)){ // Read from RAM (shadow calibration set)
 			sum_value = 0xFF; // tentative value (error case)
-			if (sum_index < 10) singleMessageString += F("0"); // Index
-			singleMessageString += sum_index; // Index
+			COMM_add_map_index(singleMessageString, map_num, sum_index); // Index
 			if ((map_num == 0) && (sum_index < INJ_INCR_RPM_MAPS_SIZE)){
-				sum_value = incrementi_rpm[sum_index];
+				sum_value = INJ_calib_shadow->incrementi_rpm[sum_index];
 			}
 			else if ((map_num == 1) && (sum_index < INJ_INCR_THR_MAPS_SIZE)){
-				sum_value = incrementi_thr[sum_index];
-			}else{
+				sum_value = INJ_calib_shadow->incrementi_thr[sum_index];
+			}
+			#if INJ_MAP_2D_ENABLE
+			else if ((map_num == INJ_MAP_2D_NUM) && ((sum_index >> 4) < INJ_MAP_2D_RPM_SIZE) && ((sum_index & 0x0F) < INJ_MAP_2D_THR_SIZE)){
+				sum_value = INJ_calib_shadow->incrementi_2d.cells[sum_index >> 4][sum_index & 0x0F];
+			}
+			#endif
+			else{
 				COMM_send_nack(F("c0999999"), recv_port); // NACK reply
 				return 0; // NG
 			}
@@ -170,33 +216,39 @@ uint8_t COMM_evaluate_parameter_read_writing_request(uint8_t* data_array, uint8_
 			COMM_send_service_message(singleMessageString, recv_port); //send string
 			return 1; // OK
 		}
-		else if ((read_write==1)){ // Write to RAM
+		else if ((read_write==1)){ // Write to RAM (shadow calibration set, used by the injection only after "c3" commit)
 			if ((map_num == 0) && (sum_index < INJ_INCR_RPM_MAPS_SIZE)){
-				incrementi_rpm[sum_index]=sum_value; // write the value in RAM
-				sum_value=incrementi_rpm[sum_index]; // check back
+				INJ_calib_shadow->incrementi_rpm[sum_index]=sum_value; // write the value in RAM
+				sum_value=INJ_calib_shadow->incrementi_rpm[sum_index]; // check back
 			}
 			else if ((map_num == 1) && (sum_index < INJ_INCR_THR_MAPS_SIZE)){
-				incrementi_thr[sum_index]=sum_value; // write the value in RAM
-				sum_value=incrementi_thr[sum_index]; // check back
-			}else{
+				INJ_calib_shadow->incrementi_thr[sum_index]=sum_value; // write the value in RAM
+				sum_value=INJ_calib_shadow->incrementi_thr[sum_index]; // check back
+			}
+			#if INJ_MAP_2D_ENABLE
+			else if ((map_num == INJ_MAP_2D_NUM) && ((sum_index >> 4) < INJ_MAP_2D_RPM_SIZE) && ((sum_index & 0x0F) < INJ_MAP_2D_THR_SIZE)){
+				INJ_calib_shadow->incrementi_2d.cells[sum_index >> 4][sum_index & 0x0F]=sum_value; // write the value in RAM
+				sum_value=INJ_calib_shadow->incrementi_2d.cells[sum_index >> 4][sum_index & 0x0F]; // check back
+			}
+			#endif
+			else{
 				COMM_send_nack(F("c1999999"), recv_port); // // NACK reply
 				return 0; // NG
 			}
-			if (sum_index < 10) singleMessageString += F("0"); // Index
-			singleMessageString += sum_index; // Index
+			COMM_add_map_index(singleMessageString, map_num, sum_index); // Index
 			if (sum_value < 10) singleMessageString += F("0"); // 3 cyphers
 			if (sum_value < 100) singleMessageString += F("0"); // 3 cyphers
 			singleMessageString += sum_value; // 3 cyphers
 			COMM_send_service_message(singleMessageString, recv_port); //send string
 			return 1; // OK
 		}
-		else if ((read_write==2) && (map_num<=INJ_MAPS_TOTAL_NUM) && (sum_index == 0)){ // Write to EEPROM
+		else if ((read_write==2) && ((map_num<=INJ_MAPS_TOTAL_NUM) || (INJ_MAP_2D_ENABLE && (map_num == INJ_MAP_2D_NUM))) && (sum_index == 0)){ // Write to EEPROM
 			singleMessageString += F("0000"); // 00 00
 			if (sum_value == 0){
-				EEPROM_write_standard_values(map_num); // c n 2 00 000
+				EEPROM_write_standard_values(map_num); // c n 2 00 000 (standard values also in RAM, active and shadow sets)
 				singleMessageString += F("0"); // 0
 			}else if (sum_value == 1){
-				EEPROM_write_RAM_map_to_EEPROM(map_num); // c n 2 00 001
+				EEPROM_write_RAM_map_to_EEPROM(map_num); // c n 2 00 001 (saves the maps used by the injection: RAM edits must be committed before, with "c3")
 				singleMessageString += F("1"); // 1
 			}else{
 				COMM_send_nack(F("c2999999"), recv_port); // // NACK reply
@@ -205,6 +257,12 @@ uint8_t COMM_evaluate_parameter_read_writing_request(uint8_t* data_array, uint8_
 			COMM_send_service_message(singleMessageString, recv_port); //send string
 			return 1; // OK
 		}
+		else if ((read_write==3) && (map_num == 0) && (sum_index == 0) && (sum_value == 0)){ // Commit: all the maps written in RAM are used by the injection (c 3 0 00 000)
+			INJmgr.calib_commit(); // publishes the shadow calibration set
+			singleMessageString += F("00000"); // 00 000
+			COMM_send_service_message(singleMessageString, recv_port); //send string
+			return 1; // OK
+		}
 		else{
 			COMM_send_nack(F("c9999999"), recv_port); // // NACK reply
 			return 0; // Error
@@ -220,36 +278,52 @@ uint8_t COMM_evaluate_parameter_read_writing_request(uint8_t* data_array, uint8_
 			singleMessageString += F("d0"); // (Header) d 0
 			if (request_num < 10) singleMessageString += F("0"); // 2 cyphers
 			singleMessageString += request_num; // 2 cyphers
-			buffer_busy = 1; // Locks the buffer access (semaphore)
+			INJ_engine_snapshot_struct engine_data; // coherent copy of engine data
+			INJmgr.read_engine_snapshot(&engine_data);
 			if (request_num == 0){ // d 0 0 0 ... // 2rpm
-				val_to_send = delta_time_tick_buffer;
+				val_to_send = (engine_data.channel[0].delta_time_tick > 0xFFFF) ? 0xFFFF : (uint16_t)engine_data.channel[0].delta_time_tick; // saturated (below 458rpm)
 			}
 			else if (request_num == 1){ // d 0 0 1 ... // inj time
-				val_to_send = delta_inj_tick_buffer;
+				val_to_send = engine_data.channel[0].delta_inj_tick;
 			}
 			else if (request_num == 2){ // d 0 0 2 ... // extension time
-				val_to_send = extension_time_ticks_buffer;
+				val_to_send = engine_data.channel[0].extension_time_ticks;
 			}
 			else if (request_num == 3){ // d 0 0 3 ... // throttle
-				val_to_send = throttle_buffer;
+				val_to_send = engine_data.throttle;
 			}
 			else if (request_num == 4){ // d 0 0 4 ... // lambda
-				val_to_send = lambda_buffer;
+				val_to_send = engine_data.lambda;
 			}
 			else if (request_num == 5){ // d 0 0 5 ... // combustion counter
-				val_to_send = injection_counter_buffer;
+				val_to_send = engine_data.channel[0].injection_counter;
 			}
 			else if (request_num == 6){ // d 0 0 6 ... // combustion counter, and activate one Lambda sensor screenshot
 				INJmgr.steady_state_prescaler_tgt = 3; // 3 * 1085 us * 32 = about 100ms, therefore 1 cycle is about 2 rotations at 1200rpm
-				val_to_send = injection_counter_buffer;
+				val_to_send = engine_data.channel[0].injection_counter;
 			}
 			else if (request_num == 7){ // d 0 0 7 ... // digital inputs status
 				val_to_send = ADCmgr_binary_inputs_status_read();
 			}
+#if INJ_CHANNELS_NUM == 2
+			else if (request_num == 8){ // d 0 0 8 ... // injector 2 inj time
+				val_to_send = engine_data.channel[1].delta_inj_tick;
+			}
+			else if (request_num == 9){ // d 0 0 9 ... // injector 2 extension time
+				val_to_send = engine_data.channel[1].extension_time_ticks;
+			}
+#endif
+#if INJ_SAFETY_WDT_ENABLE
+			else if ((request_num >= 10) && (request_num < (10 + INJ_CHANNELS_NUM))){ // d 0 1 0 ... // watchdog trips, injector 1 (d 0 1 1: injector 2)
+				uint8_t oldSREG = SREG;
+				cli(); // 2 bytes, written by the watchdog interrupt
+				val_to_send = INJ_wdt_trip_cnt[request_num - 10];
+				SREG = oldSREG;
+			}
+#endif
 			else{
 				req_good = false; // no valid request
 			}
-			buffer_busy = 0; // Opens the buffer again
 			if (req_good == true){
 				if (val_to_send < 10) singleMessageString += F("0"); // 5 cyphers
 				if (val_to_send < 100) singleMessageString += F("0"); // 5 cyphers
@@ -272,6 +346,17 @@ uint8_t COMM_evaluate_parameter_read_writing_request(uint8_t* data_array, uint8_
 				return 1; // OK
 			}
 		}
+#if ISR_STATS_ENABLE
+		else if (data_array[1] == '2'){ // d 2 x n ... (binary request) -> ISR execution time statistics of ISR "n" (0: injector, 1: Timer1, 2: ADC, 3: SWseriale). x = 0: read, x = 1: read and reset
+			uint8_t isr_id = data_array[3] - '0';
+			if (((data_array[2] == '0') || (data_array[2] == '1')) && (isr_id < ISR_IDS_NUM)){
+				uint8_t ISR_buffer_COMM_tmp[(ISR_STATS_COMM_SIZE + 2)]; // allocates buffer (data + checksum)
+				ISRmgr_prepare_COMM_packet(ISR_buffer_COMM_tmp, isr_id, (data_array[2] == '1')); // prepares buffer (data)
+				COMM_Send_Char_Array(recv_port, ISR_buffer_COMM_tmp, ISR_STATS_COMM_SIZE, true); // attach checksum and send packet
+				return 1; // OK
+			}
+		}
+#endif
 		else if ((data_array[1] == 'i') && (data_array[2] == 'm') && (data_array[3] == 'u')){ // d i m u ... (ASCII request) -> IMU data for calibration
 			MPU6050mgr.send_ASCII_data();
 			return 1; // OK
@@ -2,7 +2,7 @@
 #define COMMmgr_h
 
 #include <Arduino.h>
-#include "SWSeriale/SWseriale.h" // SW serial using INT1 and Timer2
+#include "SWseriale/SWseriale.h" // SW serial using INT1 and Timer2
 
 enum COMM_destination_port_enum{
 	HW_SERIAL = 0, // 
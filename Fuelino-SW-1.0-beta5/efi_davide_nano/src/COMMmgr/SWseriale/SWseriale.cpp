@@ -7,6 +7,7 @@
 #define SWSERIALE_cpp
 
 #include "SWseriale.h"
+#include "../../ISRmgr/ISRmgr.h" // ISR monitoring (trace pins)
 
 SWseriale_class SWseriale;
 
@@ -161,11 +162,16 @@ ISR(INT0_vect) {
 // This timer is activated after INT1 (start bit, 5V -> 0V) interrupt happens, or when sending byte is requested
 ISR(TIMER2_COMPA_vect) {
 
+	ISR_TRACE_TIMER2_BEGIN(); // Trace pin HIGH
+	ISR_STATS_BEGIN(); // Execution time statistics
+
 	// Byte receiving case
 	if (SWseriale_mode == RECV_MODE){
 		if (recv_bit_num == 0) { // At the moment I am in the middle of start bit (0), need to sample in the middle of bit 1 next (distance is 1 bit)
 			if (PIND & _BV(RX_PIN)){ // Need to make sure that the bit is 0 (=0V)
 				SWseriale.listen(IDLE_MODE); // re-initialize receiving, in case external input was a mistake (this bit should be =0V because it is Start Bit)
+				ISR_STATS_END(ISR_ID_SWSERIALE); // Execution time statistics
+				ISR_TRACE_TIMER2_END(); // Trace pin LOW
 				return;
 			}
 			OCR2A = ONE_BIT_CYLES; // 1 bit time (needed to jump from one bit to the next)
@@ -186,6 +192,8 @@ ISR(TIMER2_COMPA_vect) {
 		else if (recv_bit_num == 9+BITS_WAITING_AFTER_RECV){ // the bus is kept in "RECV" state for a little bit more, to allow the next byte to arrive
 			SWseriale_mode = IDLE_MODE; // Set the bus in IDLE mode (so that, in case FORCE_SEND=0, there is no trouble, the check passes)
 			if (!SWseriale.prepareToSend()) SWseriale.listen(IDLE_MODE); // Checks if any byte has to be sent (this is necessary in case any byte to be sent is pending the end of reception state). If not, timer is stopped.
+			ISR_STATS_END(ISR_ID_SWSERIALE); // Execution time statistics
+			ISR_TRACE_TIMER2_END(); // Trace pin LOW
 			return;
 		}
 		recv_bit_num++;
@@ -206,11 +214,16 @@ ISR(TIMER2_COMPA_vect) {
 		else if (send_bit_num == 10){ // Finished transmitting the byte (after Stop Bit, there is an additional bit with 5V status)
 			SWseriale.listen(IDLE_MODE); // Set the bus in IDLE mode
 			SWseriale.prepareToSend(); // Checks if any other byte needs to be sent
+			ISR_STATS_END(ISR_ID_SWSERIALE); // Execution time statistics
+			ISR_TRACE_TIMER2_END(); // Trace pin LOW
 			return;
 		}
 		send_bit_num++;
 	}
 	
+	ISR_STATS_END(ISR_ID_SWSERIALE); // Execution time statistics
+	ISR_TRACE_TIMER2_END(); // Trace pin LOW
+	
 }
 
 #endif
\ No newline at end of file
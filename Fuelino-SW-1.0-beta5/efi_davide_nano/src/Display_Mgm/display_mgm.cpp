@@ -37,7 +37,7 @@ void Display_Mgr::initialize(){
 
 // Bufferizes data before plotting it on the screen
 void Display_Mgr::buffer_data(){
-	
+	INJmgr.read_engine_snapshot(&engine_data); // coherent copy of engine data
 }
 
 // CREATES THE "ECU Fuel Injection Time" PAGE
@@ -47,21 +47,21 @@ void Display_Mgr::ECU_FIT_LINE_creator(){
 	//if (delta_inj_tick_buffer<100) display_char_line1+=' ';
 	//if (delta_inj_tick_buffer<1000) display_char_line1+=' ';
 	//if (delta_inj_tick_buffer<10000) display_char_line1+=' ';
-	display_char_line2+=((uint32_t)delta_inj_tick_buffer << 2);
+	display_char_line2+=(((uint32_t)engine_data.channel[0].delta_inj_tick << 2) >> INJ_TS_SHIFT);
 	display_char_line2+="u";
 }
 	
 // CREATES THE "ECU RPM" PAGE
 void Display_Mgr::ECU_RPM_LINE_creator(){
 	display_char_line1+="DeltaTim";
-	display_char_line2+=((uint32_t)delta_time_tick_buffer << 2);
+	display_char_line2+=((uint32_t)engine_data.channel[0].delta_time_tick << 2);
 	display_char_line2+="u";
 }
 
 // CREATES THE "ECU Throttle" PAGE
 void Display_Mgr::ECU_THR_LINE_creator(){
 	display_char_line1+="Throttle";
-	display_char_line2+=throttle_buffer;
+	display_char_line2+=engine_data.throttle;
 	//display_char_line2+="";
 }
 
@@ -71,7 +71,6 @@ void Display_Mgr::page_reflash(){
 	// Create lines contents
 	display_char_line1="";
 	display_char_line2="";
-	buffer_busy = 1; // Locks the buffer access (semaphore)
 	switch (display_page_sts) {
 		case NO_PAGE:
 			display_char_line1+="Init";
@@ -93,7 +92,6 @@ void Display_Mgr::page_reflash(){
 			display_page_sts = ECU_FIT_PAGE; // increase page
 			break;
 	}
-	buffer_busy = 0; // Opens the buffer again
 	
 	// Print lines on the LCD
 	lcd.clear();
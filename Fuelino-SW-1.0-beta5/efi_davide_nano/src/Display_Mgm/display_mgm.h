@@ -29,6 +29,7 @@ class Display_Mgr{
 	uint8_t req_cycle_counter;
 	String display_char_line1; // characters to be printed on the display (8 characters)
 	String display_char_line2; // characters to be printed on the display (8 characters)
+	INJ_engine_snapshot_struct engine_data; // engine data copy, for the page being printed
 	void buffer_data(); // Creates the data buffer
 	void ECU_FIT_LINE_creator(); // Fuel Injection time
 	void ECU_RPM_LINE_creator(); // RPM
@@ -9,6 +9,8 @@
 #define INJ_INCR_THR_MAPS_START 2*INJ_INCR_RPM_MAPS_SIZE // start address (16) -> 16x2 bytes used for this map = 32
 #define SD_FILE_NUM_ADDR 64 // address of file number (4 bytes used)
 #define EEPROM_CONFIG_WORD_ADDR 68 // address of Configuration Word
+#define INJ_MAP_2D_START 128 // start address (128) -> 128x2 bytes used for the 2D map = 256 (up to address 383)
+#define INJ_MAP_2D_CELLS (INJ_MAP_2D_RPM_SIZE * INJ_MAP_2D_THR_SIZE) // 2D map size (bytes)
 #define BATTERY_CHECK_BYPASS_BIT 0
 #define ENG_DATA_LOG_BYPASS_BIT 1
 #define GPS_DATA_LOG_BYPASS_BIT 2
@@ -33,23 +35,74 @@ void EEPROM_load_config_word(){
 }
 
 
-// Writes injection standard values into EEPROM
+// Writes the standard values of the requested maps into one calibration set (RAM)
+static void EEPROM_standard_values_to_set(INJ_calib_struct* calib, uint8_t data_number){
+  if ((data_number ==0) || (data_number ==INJ_MAPS_TOTAL_NUM)){ // RPM map
+	for (uint8_t i=0; i<INJ_INCR_RPM_MAPS_SIZE; i++) calib->incrementi_rpm[i]=INJ_INCREMENT_RPM_STD; // prende il valore standard
+  }
+  if ((data_number ==1) || (data_number ==INJ_MAPS_TOTAL_NUM)){ // THR map
+	for (uint8_t i=0; i<INJ_INCR_THR_MAPS_SIZE; i++) calib->incrementi_thr[i]=INJ_INCREMENT_THR_STD; // prende il valore standard
+  }
+#if INJ_MAP_2D_ENABLE
+  if ((data_number ==INJ_MAP_2D_NUM) || (data_number ==INJ_MAPS_TOTAL_NUM)){ // 2D map
+	uint8_t* cells_tmp = &calib->incrementi_2d.cells[0][0]; // map cells, in a row
+	for (uint16_t j=0; j<INJ_MAP_2D_CELLS; j++) cells_tmp[j]=INJ_INCREMENT_2D_STD; // standard value
+  }
+#endif
+}
+
+
+// Writes injection standard values into EEPROM, and into both calibration sets (active and shadow). Serial edits of the other maps, not yet committed, stay in the shadow set (they are not committed)
 uint8_t EEPROM_write_standard_values(uint8_t data_number){
   uint8_t i;
   if ((data_number ==0) || (data_number ==INJ_MAPS_TOTAL_NUM)){ // RPM map
 	  for (i=0; i<INJ_INCR_RPM_MAPS_SIZE; i++){
 		  EEPROM.write(INJ_INCR_RPM_MAPS_START+i, INJ_INCREMENT_RPM_STD); //main data
 		  EEPROM.write(INJ_INCR_RPM_MAPS_START+INJ_INCR_RPM_MAPS_SIZE+i, (uint8_t)255 - INJ_INCREMENT_RPM_STD); //for redundancy, this is a copy of the main data
-		  incrementi_rpm[i]=INJ_INCREMENT_RPM_STD; // prende il valore standard
 	  }
   }
   if ((data_number ==1) || (data_number ==INJ_MAPS_TOTAL_NUM)){ // THR map
 	for (i=0; i<INJ_INCR_THR_MAPS_SIZE; i++){
 		EEPROM.write(INJ_INCR_THR_MAPS_START+i, INJ_INCREMENT_THR_STD); //main data
 		EEPROM.write(INJ_INCR_THR_MAPS_START+INJ_INCR_THR_MAPS_SIZE+i, (uint8_t)255 - INJ_INCREMENT_THR_STD); //for redundancy, this is a copy of the main data
-		incrementi_thr[i]=INJ_INCREMENT_THR_STD; // prende il valore standard
 	}
   }
+#if INJ_MAP_2D_ENABLE
+  if ((data_number ==INJ_MAP_2D_NUM) || (data_number ==INJ_MAPS_TOTAL_NUM)){ // 2D map
+	for (uint16_t j=0; j<INJ_MAP_2D_CELLS; j++){
+		EEPROM.write(INJ_MAP_2D_START+j, INJ_INCREMENT_2D_STD); //main data
+		EEPROM.write(INJ_MAP_2D_START+INJ_MAP_2D_CELLS+j, (uint8_t)255 - INJ_INCREMENT_2D_STD); //for redundancy, this is a copy of the main data
+	}
+  }
+  if ((data_number ==0) || (data_number ==1)){ // 1D map only: not used by the injection when the 2D map is enabled, both sets are written directly
+	EEPROM_standard_values_to_set(INJ_calib_shadow, data_number);
+	EEPROM_standard_values_to_set(INJ_calib_active, data_number);
+	INJmgr.rpm_map_lut_build(); // shadow set lookup table (the active one is not used)
+	return 0;
+  }
+#endif
+  
+  // Maps used by the injection: the active set is changed only by a commit. The shadow set is prepared with the standard values and the active values of the 1D maps not requested,
+  // then committed. Uncommitted Serial edits of those 1D maps are saved before, and restored in the new shadow set (the 2D map, if enabled, is requested here)
+  uint8_t rpm_edit[INJ_INCR_RPM_MAPS_SIZE]; // shadow "incrementi_rpm", not committed
+  uint8_t thr_edit[INJ_INCR_THR_MAPS_SIZE]; // shadow "incrementi_thr", not committed
+  for (i=0; i<INJ_INCR_RPM_MAPS_SIZE; i++){
+	rpm_edit[i] = INJ_calib_shadow->incrementi_rpm[i];
+	INJ_calib_shadow->incrementi_rpm[i] = INJ_calib_active->incrementi_rpm[i];
+  }
+  for (i=0; i<INJ_INCR_THR_MAPS_SIZE; i++){
+	thr_edit[i] = INJ_calib_shadow->incrementi_thr[i];
+	INJ_calib_shadow->incrementi_thr[i] = INJ_calib_active->incrementi_thr[i];
+  }
+  EEPROM_standard_values_to_set(INJ_calib_shadow, data_number);
+  INJmgr.calib_commit(); // standard values are used by the injection
+  if ((data_number !=0) && (data_number !=INJ_MAPS_TOTAL_NUM)){ // RPM map not requested: edits restored
+	for (i=0; i<INJ_INCR_RPM_MAPS_SIZE; i++) INJ_calib_shadow->incrementi_rpm[i] = rpm_edit[i];
+	INJmgr.rpm_map_lut_build(); // lookup table of the edited map
+  }
+  if ((data_number !=1) && (data_number !=INJ_MAPS_TOTAL_NUM)){ // THR map not requested: edits restored
+	for (i=0; i<INJ_INCR_THR_MAPS_SIZE; i++) INJ_calib_shadow->incrementi_thr[i] = thr_edit[i];
+  }
   return 0;
 }
 
@@ -64,7 +117,7 @@ uint8_t EEPROM_load_calib(){
 			error_flag=1;
 		}
 		else{ // OK
-			incrementi_rpm[i]=EEPROM.read(INJ_INCR_RPM_MAPS_START+i);
+			INJ_calib_shadow->incrementi_rpm[i]=EEPROM.read(INJ_INCR_RPM_MAPS_START+i);
 		}
 	}
 	// Imports "incrementi_thr"
@@ -73,13 +126,34 @@ uint8_t EEPROM_load_calib(){
 			error_flag=1;
 		}
 		else{ // OK
-			incrementi_thr[i]=EEPROM.read(INJ_INCR_THR_MAPS_START+i);
+			INJ_calib_shadow->incrementi_thr[i]=EEPROM.read(INJ_INCR_THR_MAPS_START+i);
+		}
+	}
+#if INJ_MAP_2D_ENABLE
+	// Imports "incrementi_2d"
+	uint8_t error_flag_2d = 0;
+	uint8_t* cells_tmp = &INJ_calib_shadow->incrementi_2d.cells[0][0]; // map cells, in a row
+	for (uint16_t j=0; j<INJ_MAP_2D_CELLS; j++){
+		if (EEPROM.read(INJ_MAP_2D_START+INJ_MAP_2D_CELLS+j) != ((uint8_t)255 - (uint8_t)EEPROM.read(INJ_MAP_2D_START+j))){ // redundancy check NG
+			error_flag_2d=1;
 		}
+		else{ // OK
+			cells_tmp[j]=EEPROM.read(INJ_MAP_2D_START+j);
+		}
+	}
+#endif
+#if INJ_MAP_2D_ENABLE
+	if (error_flag_2d && !error_flag){ // only the 2D map is not valid (example: first time after enabling it)
+		INJmgr.calib_commit(); // loaded 1D maps are used
+		EEPROM_write_standard_values(INJ_MAP_2D_NUM); // Writes the standard values of the 2D map only, 1D maps are kept
+		return 0; // Not OK
 	}
+#endif
 	if (error_flag){
 		EEPROM_write_standard_values(INJ_MAPS_TOTAL_NUM); // Writes the standard values
 		return 0; // Not OK
 	}
+	INJmgr.calib_commit(); // loaded maps are used by the injection
 	return 1; // OK
 }
 
@@ -91,25 +165,35 @@ void EEPROM_initialize(){
 }
 
 
-// Writes a map from RAM into EEPROM memory
+// Writes a map from RAM into EEPROM memory. The active calibration set is saved (the maps used by the injection): Serial edits must be committed ("c3") before
 void EEPROM_write_RAM_map_to_EEPROM(uint8_t map_number_req){
+	const INJ_calib_struct* calib = INJ_calib_active; // not changed by interrupts (only by "calib_commit", in Main Loop)
 	if ((map_number_req ==0) || (map_number_req ==INJ_MAPS_TOTAL_NUM)){ // rpm
 		for (uint8_t i=0; i<INJ_INCR_RPM_MAPS_SIZE;i++){
-			EEPROM.write(INJ_INCR_RPM_MAPS_START+i, incrementi_rpm[i]); //main data
-			EEPROM.write(INJ_INCR_RPM_MAPS_START+INJ_INCR_RPM_MAPS_SIZE+i, (uint8_t)255 - incrementi_rpm[i]); //for redundancy, this is a copy of the main data
+			EEPROM.write(INJ_INCR_RPM_MAPS_START+i, calib->incrementi_rpm[i]); //main data
+			EEPROM.write(INJ_INCR_RPM_MAPS_START+INJ_INCR_RPM_MAPS_SIZE+i, (uint8_t)255 - calib->incrementi_rpm[i]); //for redundancy, this is a copy of the main data
 		}
 	}
 	if ((map_number_req ==1) || (map_number_req ==INJ_MAPS_TOTAL_NUM)){ // throttle
 		for (uint8_t i=0; i<INJ_INCR_THR_MAPS_SIZE;i++){
-			EEPROM.write(INJ_INCR_THR_MAPS_START+i, incrementi_thr[i]); //main data
-			EEPROM.write(INJ_INCR_THR_MAPS_START+INJ_INCR_THR_MAPS_SIZE+i, (uint8_t)255 - incrementi_thr[i]); //for redundancy, this is a copy of the main data
+			EEPROM.write(INJ_INCR_THR_MAPS_START+i, calib->incrementi_thr[i]); //main data
+			EEPROM.write(INJ_INCR_THR_MAPS_START+INJ_INCR_THR_MAPS_SIZE+i, (uint8_t)255 - calib->incrementi_thr[i]); //for redundancy, this is a copy of the main data
 		}
 	}
+#if INJ_MAP_2D_ENABLE
+	if ((map_number_req ==INJ_MAP_2D_NUM) || (map_number_req ==INJ_MAPS_TOTAL_NUM)){ // 2D map
+		const uint8_t* cells_tmp = &calib->incrementi_2d.cells[0][0]; // map cells, in a row
+		for (uint16_t j=0; j<INJ_MAP_2D_CELLS; j++){
+			EEPROM.write(INJ_MAP_2D_START+j, cells_tmp[j]); //main data
+			EEPROM.write(INJ_MAP_2D_START+INJ_MAP_2D_CELLS+j, (uint8_t)255 - cells_tmp[j]); //for redundancy, this is a copy of the main data
+		}
+	}
+#endif
 }
 
 
-// Reads file number into EEPROM, increases it (+1), writes the increased number into EEPROM, and returns that value. In case of error, "0" is used.
-uint16_t EEPROM_SD_file_num_rw(){
+// Reads file number from EEPROM, and returns the next one (+1). In case of error, "0" is used. EEPROM is not written (see "EEPROM_SD_file_num_write")
+uint16_t EEPROM_SD_file_num_next(){
 	
 	// EEPROM values read
 	uint8_t valoreL = EEPROM.read(SD_FILE_NUM_ADDR); // original value
@@ -120,23 +204,23 @@ uint16_t EEPROM_SD_file_num_rw(){
 	// Deciding values
 	if ((valore_redH == ((uint8_t)255 - valoreH)) && (valore_redL == ((uint8_t)255 - valoreL))){ // checksum check OK
 		uint16_t valore = ((uint16_t)valoreL + ((uint16_t)valoreH << 8));
-		valore++; // increase value
-		valoreL = (uint8_t)(valore & (uint16_t)0x00FF); // low
-		valoreH = (uint8_t)(valore >> 8); // high
-	}else{ // initialization (standard values)
-		valoreL = (uint8_t)0;
-		valoreH = (uint8_t)0;
+		return (uint16_t)(valore + 1); // increase value
 	}
-	valore_redL=(uint8_t)255 - valoreL;
-	valore_redH=(uint8_t)255 - valoreH;
+	return 0; // initialization (standard value)
+}
+
+
+// Writes the file number used into EEPROM (with redundancy). Called once per SD initialization, after the file name has been chosen
+void EEPROM_SD_file_num_write(uint16_t file_number){
+	
+	uint8_t valoreL = (uint8_t)(file_number & (uint16_t)0x00FF); // low
+	uint8_t valoreH = (uint8_t)(file_number >> 8); // high
 	
 	// Writing new values into EEPROM
 	EEPROM.write(SD_FILE_NUM_ADDR, valoreL);
 	EEPROM.write(SD_FILE_NUM_ADDR+1, valoreH);
-	EEPROM.write(SD_FILE_NUM_ADDR+2, valore_redL);
-	EEPROM.write(SD_FILE_NUM_ADDR+3, valore_redH);
-	
-	return ((uint16_t)valoreL + ((uint16_t)valoreH << 8));
+	EEPROM.write(SD_FILE_NUM_ADDR+2, (uint8_t)255 - valoreL); // redundancy
+	EEPROM.write(SD_FILE_NUM_ADDR+3, (uint8_t)255 - valoreH); // redundancy
 }
 
 #endif
\ No newline at end of file
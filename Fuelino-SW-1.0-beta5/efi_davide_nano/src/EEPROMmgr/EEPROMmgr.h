@@ -7,7 +7,8 @@
 // Functions of EEPROMmgr to be exported
 extern void EEPROM_initialize();
 extern uint8_t EEPROM_write_standard_values(uint8_t data_number);
-extern uint16_t EEPROM_SD_file_num_rw();
+extern uint16_t EEPROM_SD_file_num_next();
+extern void EEPROM_SD_file_num_write(uint16_t file_number);
 extern void EEPROM_write_RAM_map_to_EEPROM(uint8_t map_number_req);
 
 extern uint8_t bat_check_inhibit();
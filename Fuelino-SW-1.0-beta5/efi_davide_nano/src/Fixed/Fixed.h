@@ -0,0 +1,98 @@
+#ifndef FIXED_h
+#define FIXED_h
+
+#include <stdint.h>
+
+// Fixed-point numbers: value = raw / 2^FRAC_BITS, stored in the smallest integer (8, 16 or 32 bits) holding INT_BITS + FRAC_BITS (+ sign) bits
+// INT_BITS can be negative, for formats smaller than 1 (example: map bytes, 2e8 = 50%, are Fixed<-1, 9>)
+// All format conversions are shifts decided at compile time. Multiplications use 16 x 16 -> 32 bits products only, which avr-gcc maps to its
+// widening multiply helpers (__umulhisi3, __mulhisi3, __usmulhisi3) instead of the full 32 x 32 bits multiplication
+
+// Storage type, from the number of bits
+template <uint8_t BITS, bool SIGNED> struct FixedStorage;
+template <> struct FixedStorage<8, false> { typedef uint8_t type; };
+template <> struct FixedStorage<8, true> { typedef int8_t type; };
+template <> struct FixedStorage<16, false> { typedef uint16_t type; };
+template <> struct FixedStorage<16, true> { typedef int16_t type; };
+template <> struct FixedStorage<32, false> { typedef uint32_t type; };
+template <> struct FixedStorage<32, true> { typedef int32_t type; };
+
+// Shift by a compile time amount: left if SHIFT > 0, right if SHIFT < 0 (arithmetic shift for signed values)
+template <int8_t SHIFT, bool LEFT = (SHIFT > 0)> struct FixedShift;
+template <int8_t SHIFT> struct FixedShift<SHIFT, true> { template <typename T> static inline T apply(T v) { return v << SHIFT; } };
+template <int8_t SHIFT> struct FixedShift<SHIFT, false> { template <typename T> static inline T apply(T v) { return v >> -SHIFT; } };
+
+// 16 x 16 -> 32 bits products (AVR-friendly kernels)
+inline uint32_t fixed_mul_u16(uint16_t a, uint16_t b) { return (uint32_t)a * (uint32_t)b; } // unsigned x unsigned
+inline int32_t fixed_mul_s16(int16_t a, int16_t b) { return (int32_t)a * (int32_t)b; } // signed x signed
+inline int32_t fixed_mul_su16(int16_t a, uint16_t b) { return (int32_t)a * (int32_t)b; } // signed x unsigned (example: coefficient 2e15 = 1)
+
+// Unsigned 16 x 16 bits product, shifted right by SHIFT, truncated to 16 bits (the caller guarantees the range)
+template <uint8_t SHIFT>
+inline uint16_t fixed_mul_shr_u16(uint16_t a, uint16_t b) { return (uint16_t)(fixed_mul_u16(a, b) >> SHIFT); }
+
+// Unsigned 16 x 16 bits product, shifted right by SHIFT and saturated to 16 bits
+template <uint8_t SHIFT>
+inline uint16_t fixed_mul_shr_sat_u16(uint16_t a, uint16_t b)
+{
+  uint32_t r = fixed_mul_u16(a, b) >> SHIFT;
+  return (r > 0xFFFF) ? 0xFFFF : (uint16_t)r;
+}
+
+template <int8_t INT_BITS, uint8_t FRAC_BITS, bool SIGNED = false>
+class Fixed
+{
+  public:
+
+    static const uint8_t BITS = INT_BITS + FRAC_BITS + (SIGNED ? 1 : 0); // significant bits
+    static const uint8_t FRAC = FRAC_BITS; // fractional bits
+    static const bool IS_SIGNED = SIGNED;
+    typedef typename FixedStorage<(BITS <= 8) ? 8 : ((BITS <= 16) ? 16 : 32), SIGNED>::type raw_t;
+    typedef typename FixedStorage<32, SIGNED>::type wide_t; // intermediate results
+
+    // properties
+    raw_t raw; // stored value
+
+    // methods
+    static inline Fixed from_raw(raw_t r) { Fixed f; f.raw = r; return f; }
+    static inline wide_t max_raw() { return SIGNED ? (wide_t)((((uint32_t)1) << (BITS - 1)) - 1) : (wide_t)((BITS >= 32) ? 0xFFFFFFFF : ((((uint32_t)1) << BITS) - 1)); }
+    static inline wide_t min_raw() { return SIGNED ? (wide_t)(-(int32_t)((((uint32_t)1) << (BITS - 1)) - 1) - 1) : 0; } // -2^(BITS-1), without overflow for 32 bits
+    static inline Fixed saturate(wide_t v) { return from_raw((raw_t)((v > max_raw()) ? max_raw() : ((v < min_raw()) ? min_raw() : v))); }
+
+    // Conversion to another format (fractional bits adjusted with one shift, the integer part is truncated if the format is smaller)
+    template <class F2> inline F2 to() const { return F2::from_raw((typename F2::raw_t)FixedShift<(int8_t)F2::FRAC - (int8_t)FRAC_BITS>::apply((wide_t)raw)); }
+    // Conversion to another format, saturated to its range
+    template <class F2> inline F2 to_sat() const { return F2::saturate((typename F2::wide_t)FixedShift<(int8_t)F2::FRAC - (int8_t)FRAC_BITS>::apply((wide_t)raw)); }
+
+    // Saturated addition and subtraction (same format). The limits are checked before the operation, so 32 bits formats cannot overflow, and unsigned results below 0 give 0
+    inline Fixed add_sat(Fixed b) const
+    {
+      if (SIGNED && (b.raw < 0)) return ((wide_t)raw < min_raw() - (wide_t)b.raw) ? from_raw((raw_t)min_raw()) : from_raw((raw_t)(raw + b.raw));
+      return ((wide_t)raw > max_raw() - (wide_t)b.raw) ? from_raw((raw_t)max_raw()) : from_raw((raw_t)(raw + b.raw));
+    }
+    inline Fixed sub_sat(Fixed b) const
+    {
+      if (SIGNED && (b.raw < 0)) return ((wide_t)raw > max_raw() + (wide_t)b.raw) ? from_raw((raw_t)max_raw()) : from_raw((raw_t)(raw - b.raw));
+      return ((wide_t)raw < min_raw() + (wide_t)b.raw) ? from_raw((raw_t)min_raw()) : from_raw((raw_t)(raw - b.raw));
+    }
+
+    // Multiplication: result in format FR, truncated (the caller guarantees the range). Operands up to 16 bits
+    template <class FR, class F2> inline FR mul(F2 b) const
+    {
+      static_assert((sizeof(raw_t) <= 2) && (sizeof(typename F2::raw_t) <= 2), "Fixed::mul: operands must be 16 bits or smaller");
+      typedef typename FixedStorage<32, (SIGNED || F2::IS_SIGNED)>::type prod_t;
+      prod_t p = (prod_t)raw * (prod_t)b.raw; // 16 x 16 -> 32 bits
+      return FR::from_raw((typename FR::raw_t)FixedShift<(int8_t)FR::FRAC - (int8_t)(FRAC_BITS + F2::FRAC)>::apply(p));
+    }
+
+    // Saturated multiplication: result in format FR (product has FRAC_BITS + F2::FRAC fractional bits, then one shift). Operands up to 16 bits
+    template <class FR, class F2> inline FR mul_sat(F2 b) const
+    {
+      static_assert((sizeof(raw_t) <= 2) && (sizeof(typename F2::raw_t) <= 2), "Fixed::mul_sat: operands must be 16 bits or smaller");
+      typedef typename FixedStorage<32, (SIGNED || F2::IS_SIGNED)>::type prod_t;
+      prod_t p = (prod_t)raw * (prod_t)b.raw; // 16 x 16 -> 32 bits
+      return FR::saturate((typename FR::wide_t)FixedShift<(int8_t)FR::FRAC - (int8_t)(FRAC_BITS + F2::FRAC)>::apply(p));
+    }
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,38 @@
+// Davide Cavaliere
+// www.monocilindro.com
+// dadez87-at-gmail-com
+// Fast digital pin library for Atmel ATmega 328p
+// Port and bit are template parameters, so each set / clear is compiled into one "sbi" / "cbi" instruction (2 cycles),
+// instead of "digitalWrite" (pin table lookup, interrupts disabled, about 50 cycles). Pins must be known at compile time
+
+#ifndef FASTPIN_h
+#define FASTPIN_h
+
+#include <avr/io.h>
+
+// I/O address of the PINx register of each port. DDRx is at PINx + 1, PORTx is at PINx + 2
+#define FASTPIN_PORT_B 0x03 // Arduino pins 8-13
+#define FASTPIN_PORT_C 0x06 // Arduino pins A0-A5 (14-19)
+#define FASTPIN_PORT_D 0x09 // Arduino pins 0-7
+
+template<uint8_t PORT_IO_ADDR, uint8_t BIT>
+class FastPin{
+	
+	public:
+		static const uint8_t mask = (1 << BIT); // bit mask inside the port registers
+		static inline void high() { _SFR_IO8(PORT_IO_ADDR + 2) |= mask; } // sbi PORTx
+		static inline void low() { _SFR_IO8(PORT_IO_ADDR + 2) &= (uint8_t)~mask; } // cbi PORTx
+		static inline void output() { _SFR_IO8(PORT_IO_ADDR + 1) |= mask; } // sbi DDRx
+		static inline void input_pullup() { _SFR_IO8(PORT_IO_ADDR + 1) &= (uint8_t)~mask; _SFR_IO8(PORT_IO_ADDR + 2) |= mask; } // cbi DDRx, sbi PORTx
+		static inline uint8_t read() { return (_SFR_IO8(PORT_IO_ADDR) & mask); } // sbis / sbic PINx, when used in a condition
+	
+};
+
+// Same as above, but using the Arduino pin number (0-19)
+template<uint8_t ARDUINO_PIN>
+class FastPin_arduino : public FastPin<(ARDUINO_PIN < 8) ? FASTPIN_PORT_D : ((ARDUINO_PIN < 14) ? FASTPIN_PORT_B : FASTPIN_PORT_C),
+                                       (ARDUINO_PIN < 8) ? ARDUINO_PIN : ((ARDUINO_PIN < 14) ? (ARDUINO_PIN - 8) : (ARDUINO_PIN - 14))>{
+	static_assert(ARDUINO_PIN < 20, "ATmega 328p has 20 digital pins");
+};
+
+#endif
\ No newline at end of file
@@ -4,48 +4,121 @@
 #include "INJmgr.h"
 #include "Tempo/Tempo.h"
 #include "../ADCmgr/ADCmgr.h" // ADC manager. To have access to Analog readings
+#include "../ISRmgr/ISRmgr.h" // ISR monitoring (trace pins)
+#include "../COMMmgr/COMMmgr.h" // Communication manager. To calculate the checksum of the injection trace packets
+#include <avr/wdt.h> // Watchdog (injector safety)
 
 // GLOBAL VARIABLES
 
-volatile uint16_t injection_counter=0; // counts the combustion cycles
-volatile uint16_t inj_start_tick_last=0; // time at which injection was started last time
-volatile uint16_t delta_time_tick=0; // distanza tra due iniezioni (2rpm)
-volatile uint16_t delta_inj_tick=0; // tempo di iniezione input
-volatile uint16_t extension_time_ticks=0; // extension time Timer1 ticks (0.5us)
-volatile uint16_t perc_inc=0; // percentuale di incremento (letta dalla mappa a seconda di RPM, THR, TIM)
-uint8_t incrementi_rpm[INJ_INCR_RPM_MAPS_SIZE]; // increments, based on rpm, used by SW
-uint8_t incrementi_thr[INJ_INCR_THR_MAPS_SIZE]; // increments depending on throttle
+enum INJ_signal_trigger_mode_enum : uint8_t{
+	WAIT_FOR_ON = 0,
+	WAIT_FOR_OFF
+};
+
+// Injection state, one per injector. Channel number is also the Timer1 compare channel used for the extension (0 = OCR1A, 1 = OCR1B)
+typedef struct{
+	uint16_t injection_counter; // counts the combustion cycles
+	INJ_time_stamp_t inj_start_tick_last; // time at which injection was started last time
+	INJ_time_stamp_t inj_stop_tick_last; // time of the last OFF edge (extension start)
+	uint32_t delta_time_tick; // distanza tra due iniezioni (2rpm) [1 tick = 4us]
+	uint16_t delta_inj_tick; // tempo di iniezione input (time stamp ticks: 4us, or 0.5us if INJ_TIMESTAMP_TIMER1)
+	uint16_t extension_time_ticks; // extension time Timer1 ticks (0.5us)
+	uint16_t perc_inc; // percentuale di incremento (letta dalla mappa a seconda di RPM, THR, TIM)
+	uint16_t throttle_on; // throttle (0 - 1023), latched at the ON edge
+	uint16_t lambda_on; // lambda sensor voltage (0 - 1023), latched at the ON edge
+	INJ_signal_trigger_mode_enum trigger_mode; // waiting for the injector to turn ON, or OFF
+	bool safety_inj_turned_off; // Injector was not turned OFF since the last function call
+	bool stopped; // No injections since INJ_ENGINE_STOPPED_TICKS: engine data cleared
+	bool filter_active; // cranking filter is sampling the input (the input pin change interrupt is masked, Timer1 compare channel is used for sampling)
+	uint8_t filter_samples; // cranking filter: samples taken
+	uint8_t filter_high_cnt; // cranking filter: samples found HIGH (injector OFF)
+	INJ_time_stamp_t filter_time_stamp; // cranking filter: time stamp of the edge which started the sampling
+} INJ_channel_struct;
+volatile INJ_channel_struct INJ_channel[INJ_CHANNELS_NUM]; // all zeros at startup: waiting for ON
+volatile uint8_t INJ_pins_last = 0; // Port D status at previous interrupt, to find which injector input changed
+void INJ_timer1_event(uint8_t channel); // Timer1 compare callback
+INJ_calib_struct INJ_calib_sets[2]; // active and shadow calibration sets
+INJ_calib_struct* volatile INJ_calib_active = &INJ_calib_sets[0]; // used by the injection interrupt. Changed only by "calib_commit", with interrupts disabled
+INJ_calib_struct* INJ_calib_shadow = &INJ_calib_sets[1]; // edited by Serial and EEPROM, in Main Loop
 const uint16_t incrementi_rpm_brkpts[] = {2600, 3112, 4136, 5160, 7208, 11304, 15400, 23592}; // breakpoints, size should be INJ_INCR_RPM_MAPS_SIZE
 const uint8_t incrementi_rpm_shifts[] = {9, 10, 10, 11, 12, 12, 13}; // breakpoints, size should be (INJ_INCR_RPM_MAPS_SIZE-1)
-volatile bool INJ_safety_inj_turned_off = false; // Injector was not turned OFF since the last function call
 volatile uint8_t engine_running_flag = 0; // Becomes ON when the engine is cranked
 volatile uint8_t INJ_exec_time_1 = 0; // tempo di esecuzione Inj ON
 volatile uint8_t INJ_exec_time_2 = 0; // tempo di esecuzione Inj OFF
+#if INJ_SAFETY_WDT_ENABLE
+volatile uint16_t INJ_wdt_trip_cnt[INJ_CHANNELS_NUM] = {0}; // number of times the watchdog turned OFF the injector
+#endif
+#if INJ_OPENING_TIME_VBAT_COMP
+const uint8_t INJ_opening_time_vbat_map[INJ_OPENING_TIME_VBAT_SIZE] = {150, 120, 95, 78, 66, 58, 52, 48}; // injector opening time (1 tick = 4us) at each battery voltage point. Example values: to be calibrated on the injector
+volatile uint16_t INJ_opening_time_ts = (INJ_OPENING_TIME_TICKS << INJ_TS_SHIFT); // opening time, in time stamp ticks (4us, or 0.5us if INJ_TIMESTAMP_TIMER1). Written by Main Loop, subtracted by the injection interrupt
+uint8_t INJ_opening_time_vbat_sample_last = 0; // battery voltage sample counter, at last update
+#endif
+
+// Injection trace ring buffer. Single producer (injection interrupts, "head"), single consumer (Main Loop, "tail"): 1 byte indexes, no lock needed
+#if INJ_TRACE_ENABLE
+volatile INJ_trace_record_struct INJ_trace_ring[INJ_TRACE_SIZE]; // records
+volatile uint8_t INJ_trace_head = 0; // next record to be written (changed only by interrupt)
+volatile uint8_t INJ_trace_tail = 0; // next record to be read (changed only by Main Loop)
+volatile uint16_t INJ_trace_overflow_cnt = 0; // records lost because the ring was full (wraps)
+#endif
 
 // Buffer variables, to store data before sending on Serial or storing on SD
-volatile uint16_t injection_counter_buffer=0; // counts the combustion cycles
-volatile uint16_t delta_time_tick_buffer=0; // distanza tra due iniezioni (2rpm) buffer
-volatile uint16_t delta_inj_tick_buffer=0; // tempo di iniezione input buffer
-volatile uint16_t throttle_buffer=0; // tensione del throttle pin 0-1023 buffer
-volatile uint16_t lambda_buffer=0; // lambda sensor voltage
-volatile uint16_t extension_time_ticks_buffer=0; // extension time ticks
-volatile uint8_t buffer_busy=0; // viene attivato quando sta mandando fuori i dati in seriale
-
-enum INJ_signal_trigger_mode_enum{
-	WAIT_FOR_ON = 0,
-	WAIT_FOR_OFF
-};
-volatile INJ_signal_trigger_mode_enum INJ_signal_trigger_mode = WAIT_FOR_ON; // waiting for the injector to turn ON
+volatile INJ_engine_snapshot_struct INJ_engine_snapshot; // combustion counter, 2rpm, inj time and extension time of each injector, throttle and lambda of the last injection
+volatile uint8_t INJ_engine_snapshot_seq = 0; // sequence counter: odd while the snapshot is being written, increased by 2 at each update
 
 
 // FUNCTIONS
 
+// Injector outputs and inputs, direct port access. After inlining, "channel" is a constant in most of the calls, so only one "sbi" / "cbi" is left
+#if INJ_OUT_FASTPIN
+inline void INJ_out_high(uint8_t channel){
+#if INJ_CHANNELS_NUM == 2
+	if (channel) { INJ_out_2_pin::high(); return; } // injector 2
+#endif
+	INJ_out_pin::high(); // injector 1
+}
+inline void INJ_out_low(uint8_t channel){
+#if INJ_CHANNELS_NUM == 2
+	if (channel) { INJ_out_2_pin::low(); return; } // injector 2
+#endif
+	INJ_out_pin::low(); // injector 1
+}
+inline uint8_t INJ_out_read(uint8_t channel){
+#if INJ_CHANNELS_NUM == 2
+	if (channel) return INJ_out_2_pin::read(); // injector 2
+#endif
+	return INJ_out_pin::read(); // injector 1
+}
+#else
+inline uint8_t INJ_out_arduino_pin(uint8_t channel){
+#if INJ_CHANNELS_NUM == 2
+	if (channel) return OUT_INJ_2_PIN; // injector 2
+#endif
+	return OUT_INJ_PIN; // injector 1
+}
+inline void INJ_out_high(uint8_t channel) { digitalWrite(INJ_out_arduino_pin(channel), HIGH); }
+inline void INJ_out_low(uint8_t channel) { digitalWrite(INJ_out_arduino_pin(channel), LOW); }
+inline uint8_t INJ_out_read(uint8_t channel) { return (uint8_t)digitalRead(INJ_out_arduino_pin(channel)); }
+#endif
+inline uint8_t INJ_in_mask(uint8_t channel){
+#if INJ_CHANNELS_NUM == 2
+	if (channel) return INJ_in_2_pin::mask; // injector 2
+#endif
+	return INJ_in_pin::mask; // injector 1
+}
+
 void INJmgr_class::begin(){
 	
 	// INJ pin input output settings
-	pinMode(IN_INJ_PIN, INPUT_PULLUP);
-	pinMode(OUT_INJ_PIN, OUTPUT);
-	digitalWrite(OUT_INJ_PIN, LOW);
+	INJ_in_pin::input_pullup();
+	INJ_out_pin::low();
+	INJ_out_pin::output();
+	#if INJ_CHANNELS_NUM == 2
+	INJ_in_2_pin::input_pullup();
+	INJ_out_2_pin::low();
+	INJ_out_2_pin::output();
+	#endif
+	INJ_pins_last = PIND; // initial inputs status
 	
 	// INJ pin input interrupt settings (INT0 and Timer1)
 	PCICR |=  1 << PCIE2; // PCIE2 (Port D)
@@ -53,47 +126,78 @@ void INJmgr_class::begin(){
 		PCMSK2 |= 1 << PCINT18; // PCINT18 (Port D Pin 2)
 	#elif FUELINO_HW_VERSION == 2
 		PCMSK2 |= 1 << PCINT22; // PCINT22 (Port D Pin 6)
+		#if INJ_CHANNELS_NUM == 2
+		PCMSK2 |= 1 << PCINT23; // PCINT23 (Port D Pin 7), injector 2
+		#endif
 	#endif
 	PCIFR |= 1 << PCIF2; // PCIF2 (Port D)
-	Timer1.initialize(); // Initializes Timer1 for injection time management
+	Timer1.initialize(); // Initializes Timer1 for injection time management (free running, one compare channel per injector)
+	Timer1.attachInterrupt(INJ_timer1_event); // Called when the extension time of one injector expires, or when the cranking filter has to sample
+	
+	// Watchdog in interrupt mode, 16ms (injector safety)
+	#if INJ_SAFETY_WDT_ENABLE
+	uint8_t oldSREG = SREG;
+	cli(); // timed sequence
+	wdt_reset();
+	WDTCSR = _BV(WDCE) | _BV(WDE); // change enable (next write within 4 cycles)
+	WDTCSR = _BV(WDIE); // interrupt only (WDE = 0: no reset), prescaler 2K cycles = 16ms
+	SREG = oldSREG;
+	#endif
 	
 }
 
 
+// Present time, in time stamp ticks (4us, or 0.5us if INJ_TIMESTAMP_TIMER1)
+inline INJ_time_stamp_t INJ_time_stamp_now(){
+	#if INJ_TIMESTAMP_TIMER1
+	return Timer1.read_extended(); // 1 tick = 0.5us
+	#else
+	return INJmgr.Timer0_tick_counts(); // 1 tick = 4us
+	#endif
+}
+
+
 // Returns the number of tick counts of Timer0 (1 tick = 4 us, since f=16MHz and prescaler = 64). 1 Overflow happens each 256 * 4 us = 1024 us
-// The returned data size is 2 bytes (16 bit), allowing to count up to 262144 us
+// The returned data size is 4 bytes (32 bit), allowing to count up to 4.7 hours. The overflow counter is the one already kept by Arduino core (no extra interrupt), so the cost is the same as "micros()"
+// This is the engine timebase shared by injection interrupt, ADCmgr (lambda acquisition) and logger
 extern volatile unsigned long timer0_overflow_count; // needed to read the microseconds counter
-uint16_t INJmgr_class::Timer0_tick_counts() {
+uint32_t INJmgr_class::Timer0_tick_counts() {
 	
-	uint8_t m;
+	uint32_t m;
 	uint8_t t;
 	
 	uint8_t oldSREG = SREG;
 	cli();
-	m = (uint8_t)(timer0_overflow_count & 0xFF);
+	m = timer0_overflow_count;
 	t = TCNT0;
 	if ((TIFR0 & _BV(TOV0)) && (t < 255)) m++;
 	SREG = oldSREG;
 	
-	return ((m << 8) + t);
+	return ((m << 8) | t);
 	
 }
 
 
+// Converts a map value (1 byte, 2e8 = 50%) to an increment (2 bytes, 2e16 = 100%)
+inline uint16_t INJ_map_to_perc(uint8_t map_value){
+	return INJ_map_value_t::from_raw(map_value).to<INJ_perc_t>().raw;
+}
+
+
 // Interpolates the thr map and caculates, as output, the injection time increment (%). 2 bytes. Resolution: 2e16 = 100%. Therefore, MSB (2e15) = 50%. Therefore 0xFFFF corresponds to a bit less than 100%.
-uint16_t INJmgr_class::interpolate_thr_map(){
+uint16_t INJmgr_class::interpolate_thr_map(const INJ_calib_struct* calib){
 	
 	// Finds the starting index
 	uint16_t throttle_tmp = ADCmgr_throttle_signal_read(); // Reads throttle signal (10 bits = 0 .. 1023)
 	uint8_t index_low = (uint8_t)(throttle_tmp >> 7) & 0x07; // divide by 128. 0x07 -> to make sure that the index is not over 7 (INJ_INCR_THR_MAPS_SIZE - 1)
 	
 	// Finds the basic increment, and DeltaY increment (%)
-	uint8_t y0 = incrementi_thr[index_low]; // 1e8 = 50%
-	uint16_t temp_result = y0 << 7; // 1 byte data: 2e8 = 50%. 2 byte data: 2e15 = 50%. Therefore, it is needed to shift by 7 positions.
+	uint8_t y0 = calib->incrementi_thr[index_low]; // 1e8 = 50%
+	uint16_t temp_result = INJ_map_to_perc(y0); // 1 byte data: 2e8 = 50%. 2 byte data: 2e15 = 50%
 	if (index_low >= (INJ_INCR_THR_MAPS_SIZE - 1)){ // Max value of the array
 		return temp_result; // Saturated value
 	}
-	uint8_t y1 = incrementi_thr[index_low + 1]; // Increment of next element
+	uint8_t y1 = calib->incrementi_thr[index_low + 1]; // Increment of next element
 	uint8_t dy; // "dy" for slope calculation
 	bool positive; // "dy" is positive flag
 	if (y1 >= y0){
@@ -106,7 +210,7 @@ uint16_t INJmgr_class::interpolate_thr_map(){
 	
 	// Finds the DeltaX remaining increment, multiplies it by the DeltaY
 	uint16_t rem_x = (throttle_tmp - ((uint16_t)index_low << 7)); // This should be a number between 0 and 127
-	uint16_t mult_tmp = (uint16_t)((uint32_t)rem_x * (uint32_t)dy); // No need to shift after, because it would be 7 right (division) and 7 left (multiplication)
+	uint16_t mult_tmp = INJ_map_value_t::from_raw(dy).mul<INJ_perc_t>(Fixed<0, 7>::from_raw((uint8_t)rem_x)).raw; // "rem_x" is the position between the 2 points (2e7 = 1), so no shift is needed
 	
 	// Performs addition, depending on the sign
 	if (positive == true){
@@ -118,24 +222,25 @@ uint16_t INJmgr_class::interpolate_thr_map(){
 }
 
 
-// Interpolates the rpm map and calculates, as output, the injection time increment (%). 2 bytes. Resolution: 2e16 = 100%. Therefore, MSB (2e15) = 50%. Therefore 0xFFFF corresponds to a bit less than 100%.
-uint16_t INJmgr_class::interpolate_rpm_map(){
+// Interpolates the rpm map of the shadow calibration set at "delta_ticks" by scanning the breakpoints, and calculates, as output, the injection time increment (%). 2e16 = 100%.
+// This is slow, and it is used only to build the lookup table "incrementi_rpm_lut"
+uint16_t interpolate_rpm_map_scan(uint16_t delta_ticks){
 	
 	// Search for proper index
-	if (delta_time_tick <= incrementi_rpm_brkpts[0]) return ((uint16_t)incrementi_rpm[0] << 7); // return array lowest value (the x value was lower than all the elements)
+	if (delta_ticks <= incrementi_rpm_brkpts[0]) return INJ_map_to_perc(INJ_calib_shadow->incrementi_rpm[0]); // return array lowest value (the x value was lower than all the elements)
 	uint8_t index; // index found	
 	for (index=1; index<INJ_INCR_RPM_MAPS_SIZE; index++){ // scan all breakpoints
-		if (delta_time_tick < incrementi_rpm_brkpts[index]){ // x lower is higher than next element
+		if (delta_ticks < incrementi_rpm_brkpts[index]){ // x lower is higher than next element
 			index--; // previous index
 			break; // exit cycle
 		}
 	}
-	if (index >= (INJ_INCR_RPM_MAPS_SIZE - 1)) return ((uint16_t)incrementi_rpm[INJ_INCR_RPM_MAPS_SIZE-1] << 7); // return array highest value (the x value was higher than all the elements)
+	if (index >= (INJ_INCR_RPM_MAPS_SIZE - 1)) return INJ_map_to_perc(INJ_calib_shadow->incrementi_rpm[INJ_INCR_RPM_MAPS_SIZE-1]); // return array highest value (the x value was higher than all the elements)
 	
 	// Performs subtraction and multiplication of the remaining part
-	uint16_t rem_x = delta_time_tick - incrementi_rpm_brkpts[index]; // remaining part of x value
-	uint8_t y0 = incrementi_rpm[index]; // Low Y element
-	uint8_t y1 = incrementi_rpm[index+1]; // High Y element
+	uint16_t rem_x = delta_ticks - incrementi_rpm_brkpts[index]; // remaining part of x value
+	uint8_t y0 = INJ_calib_shadow->incrementi_rpm[index]; // Low Y element
+	uint8_t y1 = INJ_calib_shadow->incrementi_rpm[index+1]; // High Y element
 	uint8_t dy; // "dy" for slope calculation
 	bool positive; // "dy" is positive flag
 	if (y1 >= y0){
@@ -145,7 +250,7 @@ uint16_t INJmgr_class::interpolate_rpm_map(){
 		dy = y0 - y1; // y increment negative
 		positive=false;
 	}
-	uint16_t mult_tmp = (uint16_t)((uint32_t)rem_x * (uint32_t)dy);
+	uint32_t mult_tmp = (uint32_t)rem_x * (uint32_t)dy; // 4 bytes, because "rem_x" can be up to 8191 (no need to save time, since this runs in Main Loop)
 	
 	// Performs division and resolution shifting
 	uint8_t div_shifts = incrementi_rpm_shifts[index]; // number of shifts on the right (division by "dx")
@@ -161,40 +266,146 @@ uint16_t INJmgr_class::interpolate_rpm_map(){
 	
 	// Performs addition
 	if (positive == true){
-		return ((uint16_t)y0 << 7) + mult_tmp; // 1e8 = 50% ==> 1e16 = 100%
+		return INJ_map_to_perc(y0) + (uint16_t)mult_tmp; // 1e8 = 50% ==> 1e16 = 100%
 	}else{
-		return ((uint16_t)y0 << 7) - mult_tmp; // 1e8 = 50% ==> 1e16 = 100%
+		return INJ_map_to_perc(y0) - (uint16_t)mult_tmp; // 1e8 = 50% ==> 1e16 = 100%
+	}
+
+}
+
+
+// Rebuilds the rpm lookup table of the shadow calibration set (not used by the interrupt, no need to disable interrupts)
+void INJmgr_class::rpm_map_lut_build(){
+#if !INJ_MAP_2D_ENABLE
+	for (uint8_t i=0; i<INJ_RPM_LUT_SIZE; i++){
+		INJ_calib_shadow->incrementi_rpm_lut[i] = interpolate_rpm_map_scan(INJ_RPM_LUT_START_TICKS + ((uint16_t)i << INJ_RPM_LUT_STEP_SHIFT)); // value on the grid point
 	}
+#endif
+}
+
+
+// Publishes the shadow calibration set: derived tables are rebuilt, then the injection interrupt is switched to it with one pointer write.
+// The next injection uses the new maps, each injection uses only one set. Called in Main Loop (Serial commit command, EEPROM loading)
+void INJmgr_class::calib_commit(){
+	rpm_map_lut_build(); // rpm lookup table update
+	INJ_calib_struct* calib_old = INJ_calib_active; // becomes the new shadow set
+	uint8_t oldSREG = SREG;
+	cli(); // 2 bytes pointer write, the pointer is read by the injection interrupt
+	INJ_calib_active = INJ_calib_shadow;
+	SREG = oldSREG;
+	*calib_old = *INJ_calib_shadow; // new shadow starts from the published maps, so editing can continue
+	INJ_calib_shadow = calib_old;
+}
+
 
+#if !INJ_MAP_2D_ENABLE
+// Interpolates the rpm map and calculates, as output, the injection time increment (%). 2 bytes. Resolution: 2e16 = 100%. Therefore, MSB (2e15) = 50%. Therefore 0xFFFF corresponds to a bit less than 100%.
+// Uses the lookup table (constant execution time): one indexed load, and one linear blend between 2 grid points
+uint16_t INJmgr_class::interpolate_rpm_map(const INJ_calib_struct* calib, uint16_t delta_ticks){
+	
+	// Finds the grid index
+	if (delta_ticks <= INJ_RPM_LUT_START_TICKS) return calib->incrementi_rpm_lut[0]; // return lowest value (the x value was lower than all the elements)
+	uint16_t x_tmp = delta_ticks - INJ_RPM_LUT_START_TICKS; // distance from first grid point
+	if (x_tmp >= ((uint16_t)(INJ_RPM_LUT_SIZE - 1) << INJ_RPM_LUT_STEP_SHIFT)) return calib->incrementi_rpm_lut[INJ_RPM_LUT_SIZE - 1]; // return highest value (the x value was higher than all the elements)
+	uint8_t index = (uint8_t)(x_tmp >> INJ_RPM_LUT_STEP_SHIFT); // grid index
+	uint16_t rem_x = x_tmp & ((1 << INJ_RPM_LUT_STEP_SHIFT) - 1); // remaining part of x value (0 .. 511)
+	
+	// Blends the 2 grid points
+	uint16_t y0 = calib->incrementi_rpm_lut[index]; // Low Y element
+	uint16_t y1 = calib->incrementi_rpm_lut[index + 1]; // High Y element
+	if (y1 >= y0){
+		return y0 + (uint16_t)(((uint32_t)(y1 - y0) * rem_x) >> INJ_RPM_LUT_STEP_SHIFT);
+	}else{
+		return y0 - (uint16_t)(((uint32_t)(y0 - y1) * rem_x) >> INJ_RPM_LUT_STEP_SHIFT);
+	}
+	
+}
+#endif
+
+
+// Updates the Engine Data snapshot with the data of one injector, for logger / serial communication. Called only inside interrupts, never skipped
+void INJmgr_class::update_info_for_logger(uint8_t channel, bool aborted) {
+	INJ_engine_snapshot_seq++; // odd: writing
+	INJ_engine_snapshot.channel[channel].injection_counter = INJ_channel[channel].injection_counter; // injection counter is increased
+	INJ_engine_snapshot.channel[channel].delta_time_tick = INJ_channel[channel].delta_time_tick; // distanza tra due iniezioni (2rpm) buffer
+	INJ_engine_snapshot.channel[channel].delta_inj_tick = INJ_channel[channel].delta_inj_tick; // tempo di iniezione input buffer
+	INJ_engine_snapshot.channel[channel].extension_time_ticks = INJ_channel[channel].extension_time_ticks; // Injection time externsion time (Timer)
+	INJ_engine_snapshot.channel[channel].aborted = aborted; // injection cut by the safety watchdog
+	INJ_engine_snapshot.throttle = INJ_channel[channel].throttle_on; // throttle at the ON edge of the same injection
+	INJ_engine_snapshot.lambda = INJ_channel[channel].lambda_on; // lambda at the ON edge of the same injection
+	INJ_engine_snapshot_seq++; // even: snapshot coherent
 }
 
 
-// Updates the info buffer for logger / serial communication
-void INJmgr_class::update_info_for_logger() {
-	if (!buffer_busy) { // the ECU is not using the buffer to send data to the logger
-		injection_counter_buffer = injection_counter; // injection counter is increased
-		delta_time_tick_buffer = delta_time_tick; // distanza tra due iniezioni (2rpm) buffer
-		delta_inj_tick_buffer = delta_inj_tick; // tempo di iniezione input buffer
-		extension_time_ticks_buffer = extension_time_ticks; // Injection time externsion time (Timer)
+// Copies the Engine Data snapshot. Called in Main Loop: interrupts are not disabled, the copy is repeated if an injection interrupt updated the snapshot during the copy
+// When the engine is stopped, throttle and lambda are read now from ADCmgr (they keep changing, and there is no injection to update them). Returns the number of repeated copies (255 max)
+uint8_t INJmgr_class::read_engine_snapshot(INJ_engine_snapshot_struct* snapshot) {
+	uint8_t seq_start; // sequence counter before the copy
+	uint8_t retries = 0; // copies repeated
+	for (;;){
+		seq_start = INJ_engine_snapshot_seq;
+		const volatile uint8_t* src = (const volatile uint8_t*)&INJ_engine_snapshot;
+		uint8_t* dst = (uint8_t*)snapshot;
+		for (uint8_t i=0; i<sizeof(INJ_engine_snapshot); i++){ // byte copy of the injector data, throttle and lambda
+			dst[i] = src[i];
+		}
+		if (!(seq_start & 0x01) && (seq_start == INJ_engine_snapshot_seq)) break; // no writing in progress, and snapshot not changed during the copy
+		if (retries < 255) retries++;
+	}
+	bool stopped = true;
+	for (uint8_t channel=0; channel<INJ_CHANNELS_NUM; channel++){
+		if (snapshot->channel[channel].delta_time_tick) stopped = false; // at least one injector is working
 	}
+	if (stopped){
+		snapshot->throttle = ADCmgr_throttle_signal_read(); // last ADC measure
+		snapshot->lambda = ADCmgr_lambda_signal_read(); // last ADC measure
+	}
+	return retries;
 }
 
 
-// Deactivates the injector when Timer1 interrupt happens
-void deactivate_inj(){
-	Timer1.stop(); // stops the timer
-	digitalWrite(OUT_INJ_PIN, LOW); // shuts down injector
-	INJ_safety_inj_turned_off = true; // Injector turned OFF (this flag is used for Safety check)
-	Timer1.detachInterrupt(); // Removes Timer 1 interrupt
-	INJmgr.update_info_for_logger(); // Updates info buffer for logger / serial
+// Deactivates the injector when its Timer1 compare channel expires (the compare interrupt is one shot, the timer keeps running)
+void deactivate_inj(uint8_t channel){
+	INJ_out_low(channel); // shuts down injector
+	INJ_channel[channel].safety_inj_turned_off = true; // Injector turned OFF (this flag is used for Safety check)
+	INJmgr.update_info_for_logger(channel, false); // Updates info buffer for logger / serial
+}
+
+
+// Cranking filter: takes one sample of the injector input. After INJ_CRANKING_INJ_PIN_FILT_MEASURES samples, the majority decides if the edge is valid.
+// Each call is short and constant: the other interrupts (ADC, SWseriale, millis) are not blocked by noise bursts
+void INJ_cranking_filter_sample(uint8_t channel){
+	volatile INJ_channel_struct* ch = &INJ_channel[channel]; // state of this injector
+	uint8_t pin_mask = INJ_in_mask(channel); // Port D bit of this injector input
+	if (PIND & pin_mask) ch->filter_high_cnt++; // HIGH (injector OFF)
+	ch->filter_samples++;
+	if (ch->filter_samples < INJ_CRANKING_INJ_PIN_FILT_MEASURES){
+		Timer1.arm(channel, INJ_CRANKING_INJ_PIN_FILT_PERIOD_TICKS); // next sample
+		return;
+	}
+	
+	// Sampling finished: input pin change interrupt enabled again
+	ch->filter_active = false;
+	INJ_pins_last = (INJ_pins_last & (uint8_t)~pin_mask) | (PIND & pin_mask); // present status, to detect next change
+	PCMSK2 |= pin_mask; // PCMSK2 bits are the Port D bits (PCINT16 .. PCINT23)
+	
+	// Majority vote
+	if (ch->filter_high_cnt <= INJ_CRANKING_INJ_PIN_FILT_LOW){
+		INJmgr.injector_edge_event(channel, 0, ch->filter_time_stamp); // Low (Injector ON), at the time the edge happened
+	}
+	else if (ch->filter_high_cnt >= INJ_CRANKING_INJ_PIN_FILT_HIGH){
+		INJmgr.injector_edge_event(channel, 1, ch->filter_time_stamp); // High (Injector OFF), at the time the edge happened
+	}
+	// else: pulses are just noise
 }
 
 
-// Acquires signal from throttle sensor
-void INJmgr_class::analog_digital_signals_acquisition(){
-	if (!buffer_busy){ // if the buffer is not being used for reading, update it
-		throttle_buffer = ADCmgr_throttle_signal_read(); // update buffer
-		lambda_buffer = ADCmgr_lambda_signal_read(); // update buffer
+// Timer1 compare channel of one injector expired: cranking filter sampling, or end of the extension time
+void INJ_timer1_event(uint8_t channel){
+	if (INJ_channel[channel].filter_active){
+		INJ_cranking_filter_sample(channel);
+	}else{
+		deactivate_inj(channel);
 	}
 }
 
@@ -207,20 +418,122 @@ void INJmgr_class::safety_check(uint32_t time_now_ms){
 	if ((time_now_ticks - INJ_safety_check_last_exec_time) >= INJ_SAFETY_EXEC_TIME){
 		INJ_safety_check_last_exec_time = time_now_ticks; // save current time
 	
-		// Checks if, from last function call, the interrupt properly turned on the flag
-		if (INJ_safety_inj_turned_off == false){ // If this flag is active, interrupt did not set the injector to OFF
-			INJ_safety_err_counter++; // Increase error counter
-		}else{
-			INJ_safety_err_counter = 0; // No error, reset the counter
+		#if !INJ_SAFETY_WDT_ENABLE // otherwise, done by the watchdog interrupt
+		for (uint8_t channel=0; channel<INJ_CHANNELS_NUM; channel++){
+			// Checks if, from last function call, the interrupt properly turned on the flag
+			if (INJ_channel[channel].safety_inj_turned_off == false){ // If this flag is active, interrupt did not set the injector to OFF
+				INJ_safety_err_counter[channel]++; // Increase error counter
+			}else{
+				INJ_safety_err_counter[channel] = 0; // No error, reset the counter
+			}
+			if(INJ_safety_err_counter[channel] >= INJ_SAFETY_MAX_ERR){ // If maximum error number is reached
+				INJ_out_low(channel); // shuts down injector
+				INJ_safety_err_counter[channel] = 0;
+				INJ_channel[channel].trigger_mode = WAIT_FOR_ON;
+			}
+			INJ_channel[channel].safety_inj_turned_off = false; // re-triggers the flag
 		}
-		if(INJ_safety_err_counter >= INJ_SAFETY_MAX_ERR){ // If maximum error number is reached
-			digitalWrite(OUT_INJ_PIN, LOW); // shuts down injector
-			INJ_safety_err_counter = 0;
-			INJ_signal_trigger_mode = WAIT_FOR_ON;
+		#endif
+		
+		engine_stopped_check(); // Engine stopped timeout
+	
+	}
+}
+
+
+// Prepares one 'T' packet with the oldest injection trace records (up to INJ_TRACE_RECORDS_PER_PACKET), and frees them in the ring buffer. Returns the packet size, 0 if there are no records
+// Packet: 'T' | records number | overflow counter (2 bytes) | records (8 bytes each) | checksum (2 bytes)
+uint8_t INJmgr_class::prepare_trace_SD_packet(uint8_t* temp_data_buffer_SD){
+	
+	#if INJ_TRACE_ENABLE
+	uint8_t tail = INJ_trace_tail;
+	uint8_t records_num = (INJ_trace_head - tail) & (INJ_TRACE_SIZE - 1); // records available
+	if (records_num == 0) return 0; // No new data available
+	if (records_num > INJ_TRACE_RECORDS_PER_PACKET) records_num = INJ_TRACE_RECORDS_PER_PACKET;
+	
+	uint8_t i = 0; // packet bytes counter
+	temp_data_buffer_SD[i++] = 'T'; // "T" for Trace
+	temp_data_buffer_SD[i++] = records_num;
+	uint8_t oldSREG = SREG;
+	cli(); // 2 bytes read, written by interrupt
+	uint16_t overflow_cnt = INJ_trace_overflow_cnt;
+	SREG = oldSREG;
+	temp_data_buffer_SD[i++] = (uint8_t)(overflow_cnt & 0xff); // LSB
+	temp_data_buffer_SD[i++] = (uint8_t)((overflow_cnt >> 8) & 0xff); // MSB
+	for (uint8_t k=0; k<records_num; k++){
+		const volatile uint8_t* rec = (const volatile uint8_t*)&INJ_trace_ring[tail]; // little endian, same as the other packets
+		for (uint8_t b=0; b<sizeof(INJ_trace_record_struct); b++) temp_data_buffer_SD[i++] = rec[b];
+		tail = (tail + 1) & (INJ_TRACE_SIZE - 1);
+	}
+	INJ_trace_tail = tail; // records copied: the interrupt can overwrite them
+	uint16_t CK_SUM = COMM_calculate_checksum(temp_data_buffer_SD, 0, i);
+	temp_data_buffer_SD[i++] = (uint8_t)(CK_SUM >> 8);
+	temp_data_buffer_SD[i++] = (uint8_t)(CK_SUM & 0xFF);
+	return i;
+	#else
+	return 0;
+	#endif
+	
+}
+
+
+// Interpolates the injector opening time on battery voltage, when a new battery sample is available, and publishes it for the injection interrupt (only one subtraction is left in the interrupt)
+void INJmgr_class::opening_time_update(){
+	
+	#if INJ_OPENING_TIME_VBAT_COMP
+	uint8_t sample_num = ADCmgr_battery_sample_count_read(); // increased by the ADC interrupt at each battery voltage sample
+	if (sample_num == INJ_opening_time_vbat_sample_last) return; // no new sample
+	INJ_opening_time_vbat_sample_last = sample_num;
+	
+	// Finds the map index
+	uint16_t vbat = ADCmgr_battery_signal_read(); // ADC value (0 - 1023)
+	uint16_t opening_time_tmp; // 1 tick = 1 / 2^INJ_OPENING_TIME_VBAT_SHIFT time stamp ticks
+	if (vbat <= INJ_OPENING_TIME_VBAT_START){ // lower than first point (also when battery is OFF)
+		opening_time_tmp = (uint16_t)INJ_opening_time_vbat_map[0] << INJ_OPENING_TIME_VBAT_SHIFT;
+	}else{
+		uint16_t x_tmp = vbat - INJ_OPENING_TIME_VBAT_START; // distance from first point
+		uint8_t index = x_tmp >> INJ_OPENING_TIME_VBAT_SHIFT; // left point
+		if (index >= (INJ_OPENING_TIME_VBAT_SIZE - 1)){ // higher than last point
+			opening_time_tmp = (uint16_t)INJ_opening_time_vbat_map[INJ_OPENING_TIME_VBAT_SIZE - 1] << INJ_OPENING_TIME_VBAT_SHIFT;
+		}else{
+			uint8_t frac = x_tmp & ((1 << INJ_OPENING_TIME_VBAT_SHIFT) - 1); // position between the 2 points
+			opening_time_tmp = (uint16_t)INJ_opening_time_vbat_map[index] * ((1 << INJ_OPENING_TIME_VBAT_SHIFT) - frac) + (uint16_t)INJ_opening_time_vbat_map[index + 1] * frac; // linear interpolation
 		}
-		INJ_safety_inj_turned_off = false; // re-triggers the flag
+	}
+	uint16_t opening_time_ts = (uint16_t)(((uint32_t)opening_time_tmp << INJ_TS_SHIFT) >> INJ_OPENING_TIME_VBAT_SHIFT); // time stamp ticks (4us, or 0.5us if INJ_TIMESTAMP_TIMER1)
+	
+	uint8_t oldSREG = SREG;
+	cli(); // 2 bytes write, the value is read by the injection interrupt
+	INJ_opening_time_ts = opening_time_ts;
+	SREG = oldSREG;
+	#endif
+	
+}
+
+
+// Checks, for each injector, the time since the last injection. After INJ_ENGINE_STOPPED_TICKS, engine data (2rpm, injection and extension time) is cleared and published, instead of keeping the values of the last injection
+// The cranking filter is enabled again, for the next engine start
+void INJmgr_class::engine_stopped_check(){
 	
+	for (uint8_t channel=0; channel<INJ_CHANNELS_NUM; channel++){
+		uint8_t oldSREG = SREG;
+		cli(); // the injection interrupt must not change the channel during the check
+		INJ_time_stamp_t time_now = INJ_time_stamp_now();
+		volatile INJ_channel_struct* ch = &INJ_channel[channel];
+		if ((!ch->stopped) && ((time_now - ch->inj_start_tick_last) >= (INJ_ENGINE_STOPPED_TICKS << INJ_TS_SHIFT))){ // no injections since too long
+			ch->stopped = true;
+			ch->delta_time_tick = 0;
+			ch->delta_inj_tick = 0;
+			ch->extension_time_ticks = 0;
+			update_info_for_logger(channel, false); // Publishes the cleared values
+			engine_running_flag = 0; // Next start goes through the cranking filter again
+			#if ADCMGR_LAMBDA_SYNC_ENABLE
+			ADCmgr_lambda_sync_abort(); // no more injections to synchronize the Lambda acquisition (ADC back to Free Running)
+			#endif
+		}
+		SREG = oldSREG;
 	}
+	
 }
 
 
@@ -233,19 +546,19 @@ void INJmgr_class::steady_state_eval(uint32_t time_now_ms){
 		steady_state_timer_last_exec = time_now_tmp; // update current execution time
 		
 		// Buffering engine variables
-		buffer_busy = 1; // Locks the buffer access (semaphore)
-		uint16_t combustion_num_val = injection_counter_buffer; // combustion-injections counter
-		uint16_t delta_ticks_val = delta_time_tick_buffer; // 2 engine rotations ticks (1 tick = 4us)
-		uint16_t injec_ticks_val = delta_inj_tick_buffer; // injection ticks
-		uint16_t throttle_val = throttle_buffer; // throttle sensor signal
-		buffer_busy = 0; // Unlocks the buffer again
+		INJ_engine_snapshot_struct engine_data; // coherent copy
+		read_engine_snapshot(&engine_data);
+		uint16_t combustion_num_val = engine_data.channel[0].injection_counter; // combustion-injections counter (first injector)
+		uint32_t delta_ticks_val = engine_data.channel[0].delta_time_tick; // 2 engine rotations ticks (1 tick = 4us)
+		uint16_t injec_ticks_val = engine_data.channel[0].delta_inj_tick; // injection ticks
+		uint16_t throttle_val = engine_data.throttle; // throttle sensor signal
 		
 		// Determine if engine steady conditions are verified or not
 		uint8_t steady_state_tmp = 0; // Initialized to "not steady state"
 		if (combustion_num_val != steady_state_combustion_number_old){ // combustion cycle number changed
 			if ((delta_ticks_val >= INJ_STEADY_STATE_DELTA_TICKS_MIN) && (delta_ticks_val <= INJ_STEADY_STATE_DELTA_TICKS_MAX)){ // rpm correct range
 				if ((throttle_val >= INJ_STEADY_STATE_THROTTLE_MIN) && (throttle_val <= INJ_STEADY_STATE_THROTTLE_MAX)){ // throttle correct range
-					uint16_t rpm_delta_max = steady_state_delta_ticks_old >> 7; // 2e7 = 128, previous value divided by 128 (0.75% variation)
+					uint32_t rpm_delta_max = steady_state_delta_ticks_old >> 7; // 2e7 = 128, previous value divided by 128 (0.75% variation)
 					if ((delta_ticks_val >= (steady_state_delta_ticks_old - rpm_delta_max)) && (delta_ticks_val <= (steady_state_delta_ticks_old + rpm_delta_max))){ // rpm variation range check
 						if ((throttle_val >= (steady_state_throttle_old - INJ_STEADY_STATE_THROTTLE_DELTA_MAX)) && (throttle_val <= (steady_state_throttle_old + INJ_STEADY_STATE_THROTTLE_DELTA_MAX))){ // throttle variation range check
 							steady_state_tmp = 1; // Steady state condition
@@ -257,19 +570,22 @@ void INJmgr_class::steady_state_eval(uint32_t time_now_ms){
 		}
 		
 		// Request the proper prescaler to ADCmgr module ("0" means acquisition OFF/finished)
-		if (steady_state_tmp){ // Setting the prescaler to the proper calculated value, only if the ADCmgr and SDmgr are not working
+		if (steady_state_tmp && (ADCmgr_lambda_acq_prescaler_max == 0) && ADCmgr_lambda_acq_buf_free()){ // Setting the prescaler to the proper calculated value, only if the ADCmgr is not acquiring and a buffer is free
+			volatile uint8_t* lambda_buf = ADCmgr_lambda_acq_buf[ADCmgr_lambda_acq_buf_fill]; // buffer of the next acquisition (changes only when an acquisition is completed)
 			uint8_t i=1; // Next: write bytes 1-8
-			ADCmgr_lambda_acq_buf[i++] = (uint8_t)(combustion_num_val & 0xff); // LSB
-			ADCmgr_lambda_acq_buf[i++] = (uint8_t)((combustion_num_val >> 8) & 0xff); // MSB
-			ADCmgr_lambda_acq_buf[i++] = (uint8_t)(delta_ticks_val & 0xff); // LSB
-			ADCmgr_lambda_acq_buf[i++] = (uint8_t)((delta_ticks_val >> 8) & 0xff); // MSB
-			ADCmgr_lambda_acq_buf[i++] = (uint8_t)(injec_ticks_val & 0xff); // LSB
-			ADCmgr_lambda_acq_buf[i++] = (uint8_t)((injec_ticks_val >> 8) & 0xff); // MSB
-			ADCmgr_lambda_acq_buf[i++] = (uint8_t)(throttle_val & 0xff); // LSB
-			ADCmgr_lambda_acq_buf[i++] = (uint8_t)((throttle_val >> 8) & 0xff); // MSB
+			lambda_buf[i++] = (uint8_t)(combustion_num_val & 0xff); // LSB
+			lambda_buf[i++] = (uint8_t)((combustion_num_val >> 8) & 0xff); // MSB
+			lambda_buf[i++] = (uint8_t)(delta_ticks_val & 0xff); // LSB
+			lambda_buf[i++] = (uint8_t)((delta_ticks_val >> 8) & 0xff); // MSB
+			lambda_buf[i++] = (uint8_t)(injec_ticks_val & 0xff); // LSB
+			lambda_buf[i++] = (uint8_t)((injec_ticks_val >> 8) & 0xff); // MSB
+			lambda_buf[i++] = (uint8_t)(throttle_val & 0xff); // LSB
+			lambda_buf[i++] = (uint8_t)((throttle_val >> 8) & 0xff); // MSB
 			if (delta_ticks_val > 8000) steady_state_tmp = 2;
 			if (delta_ticks_val > 16000) steady_state_tmp = 3;
 			if (delta_ticks_val > 24000) steady_state_tmp = 4;
+		}else{
+			steady_state_tmp = 0; // no acquisition request
 		}
 		steady_state_prescaler_tgt = steady_state_tmp;
 		
@@ -282,96 +598,230 @@ void INJmgr_class::steady_state_eval(uint32_t time_now_ms){
 }
 
 
-// Interrupt pin status changes (Original ECU injector command pin)
-ISR(PCINT2_vect){
-	
-	// For execution time measurement
-	uint16_t INJ_exec_time_start = INJmgr.Timer0_tick_counts(); // 1 tick = 4us
-	
-	// Evaluate the status of the INJ input pin
-	uint8_t INJ_signal_status; // Injector pin status (Low = ON, High = OFF)
-	if (engine_running_flag){ // Cranking finished
-		INJ_signal_status = (PIND & _BV(IN_INJ_PIN)); // acquire status of digital input (LOW = ON, HIGH = OFF) on injector input pin
-	}else{ // During cranking, signal is noisy. The following algorithm filters the signal. Only in case the signal is reliable, it is used
-		uint8_t pin_status_cnt = 0;
-		for (uint8_t i=0; i<INJ_CRANKING_INJ_PIN_FILT_MEASURES; i++){ // Performs many measurements and accumulates the status (0 or 1) in a counter
-			pin_status_cnt += ((PIND & _BV(IN_INJ_PIN)) >> IN_INJ_PIN);
-		}
-		if (pin_status_cnt <= INJ_CRANKING_INJ_PIN_FILT_LOW){
-			INJ_signal_status = 0; // Low (Injector ON)
-		}
-		else if (pin_status_cnt >= INJ_CRANKING_INJ_PIN_FILT_HIGH){
-			INJ_signal_status = 1; // High (Injector OFF)
-		}
-		else{
-			return; // pulses are just noise
-		}
-	}
+// Processes one edge of the Original ECU command of one injector ("channel"). "INJ_signal_status" is the filtered pin status (Low = ON, High = OFF), "time_stamp" is the Timer0 tick count (4us), or the Timer1 extended tick count (0.5us) if INJ_TIMESTAMP_TIMER1, at which the edge was detected.
+// This function does not access the input pin, so it can be driven by the pin change interrupt, or by any other source of edges. Returns the edge processed (INJ_EDGE_NONE, INJ_EDGE_ON, INJ_EDGE_OFF)
+uint8_t INJmgr_class::injector_edge_event(uint8_t channel, uint8_t INJ_signal_status, INJ_time_stamp_t time_stamp){
+
+	volatile INJ_channel_struct* ch = &INJ_channel[channel]; // state of this injector
 
 	// Original ECU is enabling injector (Injector valve will open and gasoline flows)
 	if (INJ_signal_status == 0){
-		if (INJ_signal_trigger_mode == WAIT_FOR_ON){ // I was waiting for this OFF -> ON transition
-			digitalWrite(OUT_INJ_PIN, HIGH); // activates injector
-			delta_time_tick = INJ_exec_time_start - inj_start_tick_last; // calculates Timer0 ticks (4us) between 2 consecutive injections (2 rpm)
-			perc_inc = INJmgr.interpolate_rpm_map(); // returns the interpolated increment based on rpm
-			inj_start_tick_last = INJ_exec_time_start; // saves old time stamp
-			injection_counter++; // increases the combustion cycles
-			INJ_signal_trigger_mode = WAIT_FOR_OFF; // Next cycle, wait for ON -> OFF transition
+		if (ch->trigger_mode == WAIT_FOR_ON){ // I was waiting for this OFF -> ON transition
+			INJ_out_high(channel); // activates injector
+			uint32_t delta_time_tick_32 = (time_stamp - ch->inj_start_tick_last) >> INJ_TS_SHIFT; // Timer0 ticks (4us) between 2 consecutive injections (2 rpm), no wrap at low rpm
+			uint16_t delta_time_tick_tmp = (delta_time_tick_32 > 0xFFFF) ? 0xFFFF : (uint16_t)delta_time_tick_32; // saturated, for the maps (their last point is above 0xFFFF ticks anyway)
+			ch->delta_time_tick = ch->stopped ? 0 : delta_time_tick_32; // first injection after a stop: time since the last injection is not an engine speed
+			ch->stopped = false; // engine is turning
+			ch->inj_start_tick_last = time_stamp; // saves old time stamp
+			ch->injection_counter++; // increases the combustion cycles
+			ch->trigger_mode = WAIT_FOR_OFF; // Next cycle, wait for ON -> OFF transition
+			uint16_t throttle_tmp = ADCmgr_throttle_signal_read(); // throttle used by this injection (maps, Engine Data snapshot)
+			ch->throttle_on = throttle_tmp;
+			ch->lambda_on = ADCmgr_lambda_signal_read(); // published with this injection
+			#if ADCMGR_LAMBDA_SYNC_ENABLE
+			#if INJ_TIMESTAMP_TIMER1
+			ADCmgr_lambda_sync_injection((uint16_t)time_stamp, ch->delta_time_tick); // Lambda sample slots start at the edge time
+			#else
+			ADCmgr_lambda_sync_injection(Timer1.read(), ch->delta_time_tick); // Lambda sample slots start now (edge time is in Timer0 ticks)
+			#endif
+			#endif
+			// Calculate final percentage increment now, so that the OFF edge only has to multiply it and start Timer1
+			const INJ_calib_struct* calib = INJ_calib_active; // calibration set used for this injection
+			#if INJ_MAP_2D_ENABLE
+			uint16_t perc_inc_tmp = calib->incrementi_2d.interpolate(delta_time_tick_tmp, throttle_tmp); // percentage increment depending on rpm and throttle position (1e16 = 100%)
+			#else
+			uint16_t perc_inc_tmp = interpolate_rpm_map(calib, delta_time_tick_tmp) + interpolate_thr_map(calib); // percentage increment depending on rpm and throttle position (1e16 = 100%)
+			#endif
+			if (perc_inc_tmp > MAX_PERCENTAGE_INJ) perc_inc_tmp = MAX_PERCENTAGE_INJ; // saturates the maximum injection percentage, for safety
+			ch->perc_inc = perc_inc_tmp; // used at next OFF edge
+			return INJ_EDGE_ON;
 		}
 	}
 
 	// Original ECU is disabling injector (Injector valve will close and gasoline stops, after Timer1 expires)
 	else{ // OFF
-		if (INJ_signal_trigger_mode == WAIT_FOR_OFF){ // I was waiting for this ON -> OFF transition
-			delta_inj_tick = INJ_exec_time_start - inj_start_tick_last; // delta injetion time, in Timer0 tiks (4 us)
+		if (ch->trigger_mode == WAIT_FOR_OFF){ // I was waiting for this ON -> OFF transition
+			ch->inj_stop_tick_last = time_stamp; // extension starts now
+			uint32_t delta_inj_ts = time_stamp - ch->inj_start_tick_last; // delta injetion time, in time stamp tiks (4us, or 0.5 us if INJ_TIMESTAMP_TIMER1)
+			uint16_t delta_inj_tick_tmp = (delta_inj_ts > 0xFFFF) ? 0xFFFF : (uint16_t)delta_inj_ts; // saturated (out of range anyway)
+			uint16_t extension_time_ticks_tmp = 0; // no extension time programmed
 			bool extension_timer_activated = false; // Timer1 not yet initialized
-			if ((delta_inj_tick >= INJ_TIME_TICKS_MIN) && (delta_inj_tick <= INJ_TIME_TICKS_MAX)) { // injection range check
+			if ((delta_inj_tick_tmp >= (INJ_TIME_TICKS_MIN << INJ_TS_SHIFT)) && (delta_inj_tick_tmp <= (INJ_TIME_TICKS_MAX << INJ_TS_SHIFT))) { // injection range check
 				// Remove the offset (delay and opening time from measured ticks)
-				if (delta_inj_tick > INJ_OPENING_TIME_TICKS) { // remove the opening time from the time measured
-					delta_inj_tick -= INJ_OPENING_TIME_TICKS; // real injection time (removed the opening time)
+				#if INJ_OPENING_TIME_VBAT_COMP
+				uint16_t opening_time_ts = INJ_opening_time_ts; // battery compensated, already calculated by Main Loop
+				#else
+				const uint16_t opening_time_ts = (INJ_OPENING_TIME_TICKS << INJ_TS_SHIFT); // constant
+				#endif
+				if (delta_inj_tick_tmp > opening_time_ts) { // remove the opening time from the time measured
+					delta_inj_tick_tmp -= opening_time_ts; // real injection time (removed the opening time)
 				}
 				else {
-					delta_inj_tick = 0; // if time is lower than estimated injector opening time, real injection time is considered 0
+					delta_inj_tick_tmp = 0; // if time is lower than estimated injector opening time, real injection time is considered 0
 				}
-				// Calculate final percentage increment
-				perc_inc+=INJmgr.interpolate_thr_map(); // percentage increment depending on throttle position (1e16 = 100%)
-				if (perc_inc > MAX_PERCENTAGE_INJ) perc_inc = MAX_PERCENTAGE_INJ; // saturates the maximum injection percentage, for safety
-				extension_time_ticks = (uint16_t)(((uint32_t)delta_inj_tick * (uint32_t)perc_inc) >> (16 - 3)); // calculates extension time, in Timer1 ticks (0.5us). Need to shift 16 pos (because 1e16 = 100%)
-				if ((extension_time_ticks >= MIN_EXTENSION_TIME_TICKS) && (extension_time_ticks <= MAX_EXTENSION_TIME_TICKS)){ // Checks if the extension time ticks (Timer1) is acceptable
-					if (extension_time_ticks > INJ_CALCULATION_TIME_TICKS) { // Removes the calculation time requested
-						extension_time_ticks -= INJ_CALCULATION_TIME_TICKS; // real extension time
-						Timer1.setPeriod(extension_time_ticks); // Sets the timer (Timer1) overflow threshold
-						Timer1.attachInterrupt(deactivate_inj); // Attachs Timer1 interrupt
-						Timer1.start(); // Starts the timer
-						extension_timer_activated = true; // Timer has been activated
-						INJ_signal_trigger_mode = WAIT_FOR_ON; // Waiting for next ON event
-					}
+				// Extension time, using the percentage increment calculated at ON edge
+				extension_time_ticks_tmp = fixed_mul_shr_u16<16 - 3 + INJ_TS_SHIFT>(delta_inj_tick_tmp, ch->perc_inc); // calculates extension time, in Timer1 ticks (0.5us). Need to shift 16 pos (because 1e16 = 100%). Fits 16 bits: injection time and increment are limited above
+				if ((extension_time_ticks_tmp >= MIN_EXTENSION_TIME_TICKS) && (extension_time_ticks_tmp <= MAX_EXTENSION_TIME_TICKS)){ // Checks if the extension time ticks (Timer1) is acceptable
+					Timer1.arm(channel, extension_time_ticks_tmp); // The compare channel of this injector expires after the extension time
+					extension_timer_activated = true; // Timer has been activated
+				}else{
+					extension_time_ticks_tmp = 0; // no extension time programmed
 				}
 			}
+			ch->delta_inj_tick = delta_inj_tick_tmp;
+			ch->extension_time_ticks = extension_time_ticks_tmp;
+			#if INJ_TRACE_ENABLE
+			uint8_t head = INJ_trace_head;
+			uint8_t head_next = (head + 1) & (INJ_TRACE_SIZE - 1);
+			if (head_next != INJ_trace_tail){ // ring not full
+				volatile INJ_trace_record_struct* rec = &INJ_trace_ring[head];
+				uint32_t ts_on = ch->inj_start_tick_last >> INJ_TS_SHIFT; // 4us ticks: Timer0 ticks, or Timer1 extended ticks / 8 if INJ_TIMESTAMP_TIMER1
+				rec->time_stamp_l = (uint16_t)ts_on;
+				rec->time_stamp_h = (uint8_t)(ts_on >> 16);
+				rec->throttle = (uint8_t)(ADCmgr_throttle_signal_read() >> 2); // 10 bits to 8 bits
+				rec->inj_ticks = delta_inj_tick_tmp;
+				rec->extension_ticks = extension_time_ticks_tmp | ((uint16_t)channel << 15);
+				INJ_trace_head = head_next; // publish the record (after it is completely written)
+			}else{
+				INJ_trace_overflow_cnt++; // record lost
+			}
+			#endif
+			ch->trigger_mode = WAIT_FOR_ON; // Waiting for next ON event
 			// In case the previous calculaton stopped somewhere before activating the timer, do the following (deactivate injector, and so on)
 			if (extension_timer_activated == false){ // timer was not activated, so need to disable the output now
-				digitalWrite(OUT_INJ_PIN, LOW); // shuts down injector
-				INJ_safety_inj_turned_off = true; // Injector turned OFF (this flag is used for Safety check)
-				extension_time_ticks = 0; // no extension time programmed
-				INJ_signal_trigger_mode = WAIT_FOR_ON; // Waiting for next ON event
-				INJmgr.update_info_for_logger(); // Updates the data inside buffer
+				INJ_out_low(channel); // shuts down injector
+				ch->safety_inj_turned_off = true; // Injector turned OFF (this flag is used for Safety check)
+				update_info_for_logger(channel, false); // Updates the data inside buffer
 			}
-			if ((ADCmgr_lambda_acq_prescaler_max == 0) && (!ADCmgr_lambda_acq_buf_filled)){ // Makes sure that the acquisition is not in progress, and that the buffer is not being written on SD
-				ADCmgr_lambda_acq_prescaler_max = INJmgr.steady_state_prescaler_tgt; // Start the Lambda ADC acquisition, if in Steady State condition
-				INJmgr.steady_state_prescaler_tgt = 0; // Resets the request flag
+			if (channel == 0){ // Lambda acquisition is synchronized with the first injector only
+				if ((ADCmgr_lambda_acq_prescaler_max == 0) && ADCmgr_lambda_acq_buf_free()){ // Makes sure that the acquisition is not in progress, and that a buffer of the pool is not waiting to be written on SD
+					ADCmgr_lambda_acq_prescaler_max = steady_state_prescaler_tgt; // Start the Lambda ADC acquisition, if in Steady State condition
+					steady_state_prescaler_tgt = 0; // Resets the request flag
+				}
 			}
+			return INJ_EDGE_OFF;
 		}
 	}
 	
+	return INJ_EDGE_NONE; // edge not expected (noise, or repeated status)
+
+}
+
+
+// Watchdog interrupt (each 16ms): injector safety, independent from Main Loop and from Timer1. An open injector is turned OFF, and the injection is aborted and published, if:
+// - the ECU command is ON since more than INJ_SAFETY_WDT_MAX_ECU_ON_TICKS (stuck input). Shorter commands are followed, also if longer than INJ_TIME_TICKS_MAX (cranking, prime pulse)
+// - the ECU command is OFF, but its OFF edge was not processed, nor it is pending or being filtered (missing OFF edge)
+// - the OFF edge was processed more than INJ_SAFETY_WDT_MAX_EXT_TICKS ago (stuck extension timer)
+#if INJ_SAFETY_WDT_ENABLE
+ISR(WDT_vect){
+	
+	INJ_time_stamp_t time_now = INJ_time_stamp_now();
+	for (uint8_t channel=0; channel<INJ_CHANNELS_NUM; channel++){
+		volatile INJ_channel_struct* ch = &INJ_channel[channel];
+		if (!INJ_out_read(channel)) continue; // injector closed
+		bool edge_missing = false; // injection without OFF edge
+		bool trip;
+		if (ch->trigger_mode == WAIT_FOR_OFF){ // ECU command in progress
+			edge_missing = (PIND & INJ_in_mask(channel)) && !ch->filter_active && !(PCIFR & _BV(PCIF2)); // input is OFF, and its edge is not waiting for the pin change interrupt or for the cranking filter
+			trip = edge_missing || ((time_now - ch->inj_start_tick_last) > (INJ_SAFETY_WDT_MAX_ECU_ON_TICKS << INJ_TS_SHIFT));
+		}else{ // OFF edge processed: only the extension keeps the injector open
+			trip = (time_now - ch->inj_stop_tick_last) > ((uint32_t)INJ_SAFETY_WDT_MAX_EXT_TICKS << INJ_TS_SHIFT);
+		}
+		if (trip){
+			INJ_out_low(channel); // shuts down injector
+			Timer1.disarm(channel); // extension (or cranking filter) aborted
+			uint8_t pin_mask = INJ_in_mask(channel);
+			if (ch->filter_active || edge_missing){ // input edges not seen by the pin change interrupt
+				INJ_pins_last = (INJ_pins_last & (uint8_t)~pin_mask) | (PIND & pin_mask); // present status, to detect next change
+			}
+			if (ch->filter_active){ // input pin change interrupt was masked by the cranking filter
+				ch->filter_active = false;
+				PCMSK2 |= pin_mask;
+			}
+			if (ch->trigger_mode == WAIT_FOR_OFF){ // no OFF edge: injection data of the open time, no extension
+				uint32_t open_ts = time_now - ch->inj_start_tick_last;
+				ch->delta_inj_tick = (open_ts > 0xFFFF) ? 0xFFFF : (uint16_t)open_ts;
+				ch->extension_time_ticks = 0;
+			}
+			ch->trigger_mode = WAIT_FOR_ON; // Waiting for next ON event
+			ch->safety_inj_turned_off = true;
+			INJ_wdt_trip_cnt[channel]++;
+			INJmgr.update_info_for_logger(channel, true); // Publishes the aborted injection
+		}
+	}
+	
+}
+#endif
+
+
+// Interrupt pin status changes (Original ECU injector command pins). With 2 injectors, both inputs are on Port D, so the same interrupt serves both
+ISR(PCINT2_vect){
+	
+	// Finds which injector inputs changed since the last interrupt
+	uint8_t pins_now = PIND; // Port D status
+	uint8_t pins_changed = pins_now ^ INJ_pins_last; // bits changed since last interrupt
+	INJ_pins_last = pins_now;
+	
+	// First action: the injector output follows the ECU OFF -> ON command (minimum edge-to-output latency). During cranking, the output is activated only after the input filter.
+	// Only inputs that changed are considered, as in the edge loop below: an interrupt of the other injector, or a noise pulse already gone, does not activate this output
+	if (engine_running_flag){ // Cranking finished
+		if ((pins_changed & INJ_in_pin::mask) && !(pins_now & INJ_in_pin::mask) && (INJ_channel[0].trigger_mode == WAIT_FOR_ON)) INJ_out_high(0); // activates injector 1
+		#if INJ_CHANNELS_NUM == 2
+		if ((pins_changed & INJ_in_2_pin::mask) && !(pins_now & INJ_in_2_pin::mask) && (INJ_channel[1].trigger_mode == WAIT_FOR_ON)) INJ_out_high(1); // activates injector 2
+		#endif
+	}
+	
+	// Edge time stamp, taken at a fixed delay from the interrupt entry
+	#if INJ_TIMESTAMP_TIMER1
+	INJ_time_stamp_t INJ_time_stamp = Timer1.read_extended(); // 1 tick = 0.5us (input capture emulation: ICP1 is used as injector output on Fuelino V2)
+	#endif
+	
+	ISR_TRACE_INJ_BEGIN(); // Trace pin HIGH
+	ISR_STATS_BEGIN(); // Execution time statistics
+	
 	// For execution time measurement
-	uint16_t INJ_exec_time_end = INJmgr.Timer0_tick_counts(); // 1 tick = 4us
+	uint32_t INJ_tick_now = INJmgr.Timer0_tick_counts(); // 1 tick = 4us
+	uint16_t INJ_exec_time_start = (uint16_t)INJ_tick_now; // lower 2 bytes are enough for the execution time
+	#if !INJ_TIMESTAMP_TIMER1
+	INJ_time_stamp_t INJ_time_stamp = INJ_tick_now; // 1 tick = 4us
+	#endif
+	
+	uint8_t edges_processed = INJ_EDGE_NONE; // edges processed in this interrupt (ON, OFF)
+	for (uint8_t channel=0; channel<INJ_CHANNELS_NUM; channel++){
+		
+		// Evaluate the status of the INJ input pin
+		uint8_t pin_mask = INJ_in_mask(channel); // Port D bit of this injector input
+		if (!(pins_changed & pin_mask)) continue; // this input did not change (the other injector triggered the interrupt)
+		if (!engine_running_flag){ // During cranking, signal is noisy. The signal is sampled by Timer1 after this edge, and used only in case it is reliable (INJ_cranking_filter_sample)
+			if (INJ_channel[channel].filter_active || Timer1.armed(channel)) continue; // already sampling, or extension time running (next injection cannot start yet)
+			INJ_channel[channel].filter_active = true;
+			INJ_channel[channel].filter_samples = 0;
+			INJ_channel[channel].filter_high_cnt = 0;
+			INJ_channel[channel].filter_time_stamp = INJ_time_stamp; // edge time
+			PCMSK2 &= (uint8_t)~pin_mask; // no more interrupts from this input, until the sampling is finished
+			Timer1.arm(channel, INJ_CRANKING_INJ_PIN_FILT_PERIOD_TICKS); // first sample
+			continue;
+		}
+		uint8_t INJ_signal_status = (pins_now & pin_mask); // Injector pin status, digital input (LOW = ON, HIGH = OFF) on injector input pin
+
+		// Injection management (ON and OFF edges)
+		edges_processed |= INJmgr.injector_edge_event(channel, INJ_signal_status, INJ_time_stamp);
+		
+	}
+	
+	// For execution time measurement
+	uint16_t INJ_exec_time_end = (uint16_t)INJmgr.Timer0_tick_counts(); // 1 tick = 4us
 	uint16_t INJ_exec_time = INJ_exec_time_end - INJ_exec_time_start; // Measure interrupt execution time
-	if (!INJ_signal_status){ // Low = Injector ON
+	if (edges_processed & INJ_EDGE_ON){ // Injector ON
 		INJ_exec_time_1 = (uint8_t)INJ_exec_time; // ON
-	}else{
+	}
+	if (edges_processed & INJ_EDGE_OFF){ // Injector OFF
 		INJ_exec_time_2 = (uint8_t)INJ_exec_time; // OFF
 	}
 	
+	ISR_STATS_END(ISR_ID_INJ); // Execution time statistics
+	ISR_TRACE_INJ_END(); // Trace pin LOW
+	
 	//PCIFR |= 1 << PCIF2; // PCIF2 (Port D) | Clears any interrupt request on Port D, as double check, to filter any noise
 	
 }
@@ -3,6 +3,9 @@
 
 #include <Arduino.h>
 #include "../compile_options.h"
+#include "Map2D/Map2D.h"
+#include "FastPin/FastPin.h"
+#include "../Fixed/Fixed.h"
 
 #if FUELINO_HW_VERSION == 1
 	#define IN_INJ_PIN 2 // input pin injector from ECU
@@ -10,65 +13,165 @@
 #elif FUELINO_HW_VERSION == 2
 	#define IN_INJ_PIN 6 // input pin injector from ECU
 	#define OUT_INJ_PIN 8 // output pin injector to physical injector
+	#define IN_INJ_2_PIN 7 // input pin injector 2 from ECU (twin engines only)
+	#define OUT_INJ_2_PIN 9 // output pin injector 2 to physical injector (twin engines only)
 #endif
 
+// Injector pins, direct port access (pins are selected at compile time, depending on FUELINO_HW_VERSION)
+typedef FastPin_arduino<IN_INJ_PIN> INJ_in_pin; // must be on Port D (pin change interrupt PCINT2)
+typedef FastPin_arduino<OUT_INJ_PIN> INJ_out_pin;
+#if INJ_CHANNELS_NUM == 2
+typedef FastPin_arduino<IN_INJ_2_PIN> INJ_in_2_pin; // must be on Port D (pin change interrupt PCINT2)
+typedef FastPin_arduino<OUT_INJ_2_PIN> INJ_out_2_pin;
+#endif
+
+#if (INJ_CHANNELS_NUM < 1) || (INJ_CHANNELS_NUM > 2)
+	#error "INJ_CHANNELS_NUM must be 1 or 2"
+#endif
+#if (INJ_CHANNELS_NUM == 2) && (FUELINO_HW_VERSION != 2)
+	#error "Twin injector management (INJ_CHANNELS_NUM = 2) is available only on Fuelino V2"
+#endif
+#if (INJ_CHANNELS_NUM == 2) && ISR_TRACE_PINS_ENABLE
+	#error "Injector 2 pins (7 and 9) are used also as ISR trace pins"
+#endif
+
+#define INJ_OUT_FASTPIN 1 // 1: injector outputs are written on the port registers (FastPin: one "sbi" / "cbi", 2 clock cycles). 0: Arduino "digitalWrite" / "digitalRead" (pin tables, PWM check, interrupts disabled: about 50 clock cycles), as before FastPin, for comparison
+#define INJ_TIMESTAMP_TIMER1 0 // 1: injector edges are time stamped with free running Timer1 (0.5us, extended to 32 bits), instead of Timer0 (4us). Injection time is then logged in 0.5us ticks
+typedef uint32_t INJ_time_stamp_t; // Time stamp, 32 bits: Timer0 ticks (4us, wraps after 4.7 hours), or Timer1 ticks (0.5us, wraps after 35 minutes)
+#if INJ_TIMESTAMP_TIMER1
+	#define INJ_TS_SHIFT 3 // 1 Timer0 tick (4us) = 2^3 time stamp ticks (0.5us)
+#else
+	#define INJ_TS_SHIFT 0 // time stamp ticks are Timer0 ticks (4us)
+#endif
 #define INJ_TIME_TICKS_MIN (uint16_t)50 // minima iniezione 200us (1 Timer0 tick = 4us)
 #define INJ_TIME_TICKS_MAX (uint16_t)2000 // massima iniezione 8ms = 8000us (1 Timer0 tick = 4us)
 #define MAX_PERCENTAGE_INJ (uint16_t)32768 // maximum increment percentage (for safety) [32768 corresponds to 50% increment, because 2e16 = 100%]
 #define MIN_EXTENSION_TIME_TICKS (uint16_t)100 // minimum time of Timer1 extension time ticks (0.5us), for injection time extension [100 = 50us]
 #define MAX_EXTENSION_TIME_TICKS (uint16_t)6000 // minimum time of Timer1 extension time ticks (0.5us), for injection time extension [6000 = 3000us]
 #define INJ_OPENING_TIME_TICKS (uint16_t)0 // time ticks (4us) required for the injector to open [example: 6 == 24us]
-#define INJ_CALCULATION_TIME_TICKS (uint16_t)54 // time ticks (0.5us) required for calculation of extension time [example: 60 == 30us]
+#define INJ_OPENING_TIME_VBAT_COMP 0 // 1: the opening time is interpolated from "INJ_opening_time_vbat_map" (battery voltage), instead of INJ_OPENING_TIME_TICKS
+#define INJ_OPENING_TIME_VBAT_SIZE 8 // opening time map size (battery voltage axis)
+#define INJ_OPENING_TIME_VBAT_START (uint16_t)384 // first battery voltage point, ADC value (0 - 1023) on ADCMGR_VBATTERY_PIN
+#define INJ_OPENING_TIME_VBAT_SHIFT 6 // battery voltage points spacing: 2^6 = 64 ADC values. Last point: 832
 #define INJ_INCREMENT_RPM_STD (uint8_t)128 // Injection increment standard (50/256 %)
 #define INJ_INCREMENT_THR_STD (uint8_t)0 // Injection increment standard (50/256 %)
 #define INJ_INCR_RPM_MAPS_SIZE 8 // Engine Speed compensation map size
 #define INJ_INCR_THR_MAPS_SIZE 8 // Throttle compensation map size [if you change this, you should also change "index_thr_tmp" calculation]
-#define INJ_MAPS_TOTAL_NUM 2 // total number of calibration maps is 2 ("incrementi_rpm" and "incrementi_thr")
+#define INJ_RPM_LUT_START_TICKS (uint16_t)2600 // delta_time_tick of the first rpm breakpoint ("incrementi_rpm_brkpts[0]")
+#define INJ_RPM_LUT_STEP_SHIFT 9 // rpm lookup table step is 2^9 = 512 ticks. All rpm breakpoints must be placed on this grid
+#define INJ_RPM_LUT_SIZE 42 // rpm lookup table points: (23592 - 2600) / 512 + 1
+#define INJ_MAP_2D_ENABLE 0 // 1: the increment is read from the 2D map "incrementi_2d" (rpm x throttle), instead of the sum of "incrementi_rpm" and "incrementi_thr" [calibration sets (active and shadow) grow from 2 x 100 to 2 x 144 bytes of RAM: +256 bytes of 2D map, -168 bytes of rpm lookup table, not needed]
+#define INJ_MAP_2D_RPM_SIZE 16 // 2D map size, rpm axis (delta_time_tick)
+#define INJ_MAP_2D_RPM_START (uint16_t)2048 // 2D map first rpm point: 2048 ticks = 8192us = 14648rpm
+#define INJ_MAP_2D_RPM_SHIFT 11 // 2D map rpm points spacing: 2^11 = 2048 ticks. Last point: 32768 ticks = 915rpm
+#define INJ_MAP_2D_THR_SIZE 8 // 2D map size, throttle axis (same points of "incrementi_thr"). 16 x 8 cells: a 16 x 16 map does not fit in RAM, together with the 512 bytes SD cache
+#define INJ_MAP_2D_THR_START (uint16_t)0 // 2D map first throttle point
+#define INJ_MAP_2D_THR_SHIFT 7 // 2D map throttle points spacing: 2^7 = 128. Last point: 896
+#define INJ_INCREMENT_2D_STD (uint8_t)128 // Injection increment standard for the 2D map (50/256 %)
+#define INJ_MAPS_TOTAL_NUM 2 // total number of 1D calibration maps is 2 ("incrementi_rpm" and "incrementi_thr"). In Serial commands, this number means "all maps"
+#define INJ_MAP_2D_NUM 3 // map number of the 2D map, in Serial commands
+#define INJ_TRACE_ENABLE 0 // 1: each injection is recorded in a ring buffer (8 bytes per injection), written on SD in 'T' packets [uses INJ_TRACE_SIZE * 8 bytes of RAM]
+#define INJ_TRACE_SIZE 16 // Injection trace ring buffer records (power of 2, max 128). 16 records = 160ms at 12000rpm (one injection each 2 rotations)
+#define INJ_TRACE_RECORDS_PER_PACKET 8 // Maximum records per 'T' packet
+#define INJ_TRACE_SD_PACKET_MAX_SIZE (1 + 1 + 2 + 8 * INJ_TRACE_RECORDS_PER_PACKET + 2) // 'T' packet: header, records number, overflow counter, records, checksum
+#define INJ_EDGE_NONE (uint8_t)0 // "injector_edge_event" return value: edge ignored
+#define INJ_EDGE_ON (uint8_t)1 // "injector_edge_event" return value: injector turned ON
+#define INJ_EDGE_OFF (uint8_t)2 // "injector_edge_event" return value: injector turned OFF (extension started)
 #define INJ_SAFETY_MAX_ERR (uint8_t)10 // maximum number of tolerable Safety errors, then turn OFF the injector
 #define INJ_SAFETY_EXEC_TIME (uint16_t)100 // safety execution time (ms)
+#define INJ_SAFETY_WDT_ENABLE 1 // 1: injector safety is done by the watchdog interrupt (each 16ms), instead of polling in "safety_check" (Main Loop). The watchdog does not reset the CPU (interrupt mode)
+#define INJ_SAFETY_WDT_MAX_ECU_ON_TICKS (uint32_t)250000 // 1 tick = 4us. Longest ECU command followed by the injector: 250000 = 1s (cranking and prime pulses are longer than INJ_TIME_TICKS_MAX). A longer command is a stuck input, and the injector is turned OFF
+#define INJ_SAFETY_WDT_MAX_EXT_TICKS (uint16_t)((MAX_EXTENSION_TIME_TICKS >> 3) + 250) // 1 tick = 4us. Longest open time after the ECU OFF edge: extension (Timer1 ticks / 8) + 1ms margin = 4ms. Worst case open time: 4ms + 16ms (watchdog period)
+#define INJ_ENGINE_STOPPED_TICKS (uint32_t)250000 // 1 tick = 4us. 250000 = 1s without injections: engine stopped (below 120rpm)
 #define INJ_STEADY_STATE_MIN_TIME_BTW_TASKS (uint16_t)500 // minimum time between tasks (ms)
 #define INJ_STEADY_STATE_DELTA_TICKS_MIN (uint16_t)2500 // 1 tick = 4us. 2500 = 10000us = 12000rpm
 #define INJ_STEADY_STATE_DELTA_TICKS_MAX (uint16_t)40000 // 1 tick = 4us. 40000 = 160000us = 750rpm
 #define INJ_STEADY_STATE_THROTTLE_MIN (uint16_t)0 // Minimum throttle for steady state evaluation
 #define INJ_STEADY_STATE_THROTTLE_MAX (uint16_t)1023 // Maximum throttle for steady state evaluation
 #define INJ_STEADY_STATE_THROTTLE_DELTA_MAX (uint16_t)16 // Maximum throttle variation allowed (1/64 = 1.5% variation)
-#define INJ_CRANKING_INJ_PIN_FILT_MEASURES (uint8_t)64 // Total number of sampling, for filtering, during cranking phase
-#define INJ_CRANKING_INJ_PIN_FILT_LOW (uint8_t)16 // Threshold value to be considered "low" (Injector ON)
-#define INJ_CRANKING_INJ_PIN_FILT_HIGH (uint8_t)48 // Threshold value to be considered "high" (Injector OFF)
+#define INJ_CRANKING_INJ_PIN_FILT_MEASURES (uint8_t)8 // Total number of sampling, for filtering, during cranking phase (one sample per Timer1 compare interrupt)
+#define INJ_CRANKING_INJ_PIN_FILT_PERIOD_TICKS (uint16_t)40 // Time between 2 samples, in Timer1 ticks (0.5us) [40 = 20us, the edge is decided 160us after it happened]
+#define INJ_CRANKING_INJ_PIN_FILT_LOW (uint8_t)2 // Threshold value to be considered "low" (Injector ON)
+#define INJ_CRANKING_INJ_PIN_FILT_HIGH (uint8_t)6 // Threshold value to be considered "high" (Injector OFF)
+
+// Fixed-point formats
+typedef Fixed<0, 16> INJ_perc_t; // injection time increment, 2e16 = 100% ("perc_inc", interpolated maps)
+typedef Fixed<-1, 9> INJ_map_value_t; // 1 byte calibration map value, 2e8 = 50% ("incrementi_rpm", "incrementi_thr")
 
 // Variables to be exported
-extern uint8_t incrementi_rpm[]; // increments depending on rpm
-extern uint8_t incrementi_thr[]; // increments depending on throttle
+#if INJ_MAP_2D_ENABLE
+typedef Map2D<INJ_MAP_2D_RPM_SIZE, INJ_MAP_2D_THR_SIZE, INJ_MAP_2D_RPM_START, INJ_MAP_2D_RPM_SHIFT, INJ_MAP_2D_THR_START, INJ_MAP_2D_THR_SHIFT> INJ_map_2d_class;
+#endif
+
+// Calibration set (all the maps used by the injection interrupt, and the tables derived from them). There are 2 sets:
+// "active" is read by the injection interrupt, "shadow" is edited by Serial commands and EEPROM loading. "INJmgr.calib_commit()" publishes the shadow set (one pointer swap)
+typedef struct{
+	uint8_t incrementi_rpm[INJ_INCR_RPM_MAPS_SIZE]; // increments depending on rpm
+	uint8_t incrementi_thr[INJ_INCR_THR_MAPS_SIZE]; // increments depending on throttle
+#if !INJ_MAP_2D_ENABLE
+	uint16_t incrementi_rpm_lut[INJ_RPM_LUT_SIZE]; // "incrementi_rpm" interpolated every 512 ticks, starting from INJ_RPM_LUT_START_TICKS (2e16 = 100%). Built by "calib_commit"
+#else
+	INJ_map_2d_class incrementi_2d; // increments depending on rpm and throttle
+#endif
+} INJ_calib_struct;
+extern INJ_calib_struct* INJ_calib_shadow; // calibration set to be edited (not used by the injection, until committed)
+extern INJ_calib_struct* volatile INJ_calib_active; // calibration set used by the injection (not to be edited: changed only by "INJmgr.calib_commit()")
 
-// Variables related to the Engine Data buffer (for SD card logging)
-extern volatile uint16_t injection_counter_buffer; // counts the combustion cycles
-extern volatile uint16_t delta_time_tick_buffer; // time between 2 consecutive injections (2rpm) buffer [1 tick = 4us]
-extern volatile uint16_t delta_inj_tick_buffer; // injection time buffer [1 tick = 4us]
-extern volatile uint16_t throttle_buffer; // voltage on throttle pin 0-1023 buffer
-extern volatile uint16_t lambda_buffer; // lambda sensor voltage
-extern volatile uint16_t extension_time_ticks_buffer; // extension time Timer1 ticks (0.5us)
+// Engine Data snapshot (for SD card logging, Serial, Display, steady state evaluation). Injector data is written only by the injection interrupts (PCINT2, Timer1), at the end of each injection.
+// Main Loop reads it with "INJmgr.read_engine_snapshot()": the copy is retried if an interrupt updated the snapshot meanwhile (sequence counter), so the writer is never blocked and all injector values belong to the same injection.
+// Throttle and lambda are latched at the ON edge of the published injection. When the engine is stopped, "read_engine_snapshot()" replaces them with the last ADC measures
+typedef struct{
+	uint16_t injection_counter; // counts the combustion cycles
+	uint32_t delta_time_tick; // time between 2 consecutive injections (2rpm) [1 tick = 4us]. 0 when the engine is stopped
+	uint16_t delta_inj_tick; // injection time [1 tick = 4us, or 0.5us if INJ_TIMESTAMP_TIMER1]
+	uint16_t extension_time_ticks; // extension time Timer1 ticks (0.5us)
+	uint8_t aborted; // 1: injection aborted by the safety watchdog (then "delta_inj_tick" is the time the injector was open, if the OFF edge was missing)
+} INJ_channel_snapshot_struct;
+typedef struct{
+	INJ_channel_snapshot_struct channel[INJ_CHANNELS_NUM]; // one per injector (channel 0 is the first injector)
+	uint16_t throttle; // voltage on throttle pin 0-1023, at the ON edge of the last injection
+	uint16_t lambda; // lambda sensor voltage, at the ON edge of the last injection
+} INJ_engine_snapshot_struct;
+// Injection trace record (8 bytes), one per injection, written at the OFF edge
+typedef struct{
+	uint16_t time_stamp_l; // injection start (ON edge) time in 4us ticks, bits 0-15: Timer0 ticks, or Timer1 extended ticks >> INJ_TS_SHIFT if INJ_TIMESTAMP_TIMER1 (other epoch, not comparable with Timer0 / millis)
+	uint8_t time_stamp_h; // injection start time, bits 16-23 (wraps after 67s)
+	uint8_t throttle; // throttle (0 - 255), at the OFF edge
+	uint16_t inj_ticks; // injection time, opening time removed [1 tick = 4us, or 0.5us if INJ_TIMESTAMP_TIMER1]
+	uint16_t extension_ticks; // extension time Timer1 ticks (0.5us), bits 0-14. Bit 15: injector (0 = first, 1 = second)
+} INJ_trace_record_struct;
+#if INJ_SAFETY_WDT_ENABLE
+extern volatile uint16_t INJ_wdt_trip_cnt[INJ_CHANNELS_NUM]; // number of times the watchdog turned OFF the injector (one per injector)
+#endif
 extern volatile uint8_t INJ_exec_time_1; // execution time for the interrupt (ON)
 extern volatile uint8_t INJ_exec_time_2; // execution time for the interrupt (OFF)
-extern volatile uint8_t buffer_busy; // activated when SD packet (and serial packet) are built, to avoid corruption
 
 class INJmgr_class{
 	
 	public:
 		void begin(); // Called in MAIN Setup
-		uint16_t Timer0_tick_counts();
-		uint16_t interpolate_rpm_map();
-		uint16_t interpolate_thr_map();
-		void update_info_for_logger();
-		void analog_digital_signals_acquisition();
+		uint32_t Timer0_tick_counts(); // Engine timebase: Timer0 ticks (4us), 32 bits
+#if !INJ_MAP_2D_ENABLE
+		uint16_t interpolate_rpm_map(const INJ_calib_struct* calib, uint16_t delta_ticks);
+#endif
+		void rpm_map_lut_build(); // Rebuilds the rpm lookup table of the shadow calibration set (nothing to do, if the 2D map is enabled)
+		void calib_commit(); // Publishes the shadow calibration set to the injection interrupt
+		uint16_t interpolate_thr_map(const INJ_calib_struct* calib);
+		void update_info_for_logger(uint8_t channel, bool aborted); // Writes the Engine Data snapshot (interrupts only). "aborted": injection cut by the safety watchdog
+		uint8_t read_engine_snapshot(INJ_engine_snapshot_struct* snapshot); // Reads a coherent copy of the Engine Data snapshot (Main Loop). Returns the number of repeated copies
+		void opening_time_update(); // Interpolates the injector opening time from battery voltage (Main Loop)
 		void safety_check(uint32_t time_now_ms);
+		uint8_t prepare_trace_SD_packet(uint8_t* temp_data_buffer_SD); // Moves the oldest injection trace records into a 'T' packet. Returns the packet size (0: no records)
+		void engine_stopped_check(); // Clears the engine data of the injectors without injections since INJ_ENGINE_STOPPED_TICKS
 		void steady_state_eval(uint32_t time_now_ms);
+		uint8_t injector_edge_event(uint8_t channel, uint8_t INJ_signal_status, INJ_time_stamp_t time_stamp); // Processes one filtered edge of the ECU injector command
 		
-		uint8_t INJ_safety_err_counter = 0; // Safety error counter
+		uint8_t INJ_safety_err_counter[INJ_CHANNELS_NUM] = {0}; // Safety error counter (one per injector)
 		uint16_t INJ_safety_check_last_exec_time = 0; // Last time that safety check was executed (1 LSB = 4us)
 		
 		// Variables for engine steady state condition determination
 		uint16_t steady_state_throttle_old = 0; // Old value of throttle (0..1023), for steady state evaluation
-		uint16_t steady_state_delta_ticks_old = 0; // Old value of delta ticks (2 engine rotations, 1 tick 4us), for steady state evaluation
+		uint32_t steady_state_delta_ticks_old = 0; // Old value of delta ticks (2 engine rotations, 1 tick 4us), for steady state evaluation
 		uint16_t steady_state_combustion_number_old = 0xFFFF; // Old value of combustion cycle (must be set to 0xFFFF since this value is different than 0)
 		uint8_t steady_state_prescaler_tgt = 0; // prescaler target
 		uint16_t steady_state_timer_last_exec = 0; // counter for steady state execution
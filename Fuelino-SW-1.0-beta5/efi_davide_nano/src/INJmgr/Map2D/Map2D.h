@@ -0,0 +1,76 @@
+#ifndef MAP2D_h
+#define MAP2D_h
+
+#include <stdint.h>
+
+// Two-dimensional calibration map (1 byte per cell, 2e8 = 50%), with fixed-point bilinear interpolation
+// X axis: X_SIZE points, starting from X_START, spaced by 2^X_SHIFT (example: delta_time_tick)
+// Y axis: Y_SIZE points, starting from Y_START, spaced by 2^Y_SHIFT (example: throttle 0 .. 1023)
+// Since all the axes spacings are powers of 2, index and fraction are found with shifts only (constant execution time)
+template <uint8_t X_SIZE, uint8_t Y_SIZE, uint16_t X_START, uint8_t X_SHIFT, uint16_t Y_START, uint8_t Y_SHIFT>
+class Map2D
+{
+  public:
+  
+    // properties
+    uint8_t cells[X_SIZE][Y_SIZE]; // map values [x][y] (2e8 = 50%)
+    
+    // methods
+    uint16_t interpolate(uint16_t x, uint16_t y) const; // returns the increment, 2e16 = 100%
+    
+  private:
+    static void axis_position(uint16_t value, uint16_t start, uint8_t shift, uint8_t size, uint8_t* index_low, uint8_t* index_high, uint8_t* fraction);
+};
+
+
+// Finds the 2 surrounding axis points, and the position between them (fraction: 0 .. 255, 2e8 = 1)
+template <uint8_t X_SIZE, uint8_t Y_SIZE, uint16_t X_START, uint8_t X_SHIFT, uint16_t Y_START, uint8_t Y_SHIFT>
+inline void Map2D<X_SIZE, Y_SIZE, X_START, X_SHIFT, Y_START, Y_SHIFT>::axis_position(uint16_t value, uint16_t start, uint8_t shift, uint8_t size, uint8_t* index_low, uint8_t* index_high, uint8_t* fraction)
+{
+  if (value <= start){ // lower than all the elements
+    *index_low = 0;
+    *index_high = 0;
+    *fraction = 0;
+    return;
+  }
+  uint16_t offset = value - start; // distance from the first point
+  uint16_t index = offset >> shift; // lower point
+  if (index >= (uint16_t)(size - 1)){ // higher than all the elements
+    *index_low = size - 1;
+    *index_high = size - 1;
+    *fraction = 0;
+    return;
+  }
+  *index_low = (uint8_t)index;
+  *index_high = (uint8_t)index + 1;
+  uint16_t remainder = offset & ((1 << shift) - 1); // remaining part (0 .. 2^shift - 1)
+  if (shift >= 8){
+    *fraction = (uint8_t)(remainder >> (shift - 8)); // 8 bits resolution
+  }else{
+    *fraction = (uint8_t)(remainder << (8 - shift)); // 8 bits resolution
+  }
+}
+
+
+// Bilinear interpolation. Result: 2e16 = 100% (same format of "incrementi_rpm" and "incrementi_thr" interpolation)
+// Each blend multiplies the difference between 2 points by the fraction: three multiplications instead of six, and no branches.
+// The differences are signed, they are used as unsigned modular values: partial results can wrap around, but the final value (0 .. 0xFF00) is always exact
+template <uint8_t X_SIZE, uint8_t Y_SIZE, uint16_t X_START, uint8_t X_SHIFT, uint16_t Y_START, uint8_t Y_SHIFT>
+uint16_t Map2D<X_SIZE, Y_SIZE, X_START, X_SHIFT, Y_START, Y_SHIFT>::interpolate(uint16_t x, uint16_t y) const
+{
+  uint8_t x0, x1, fx, y0, y1, fy;
+  axis_position(x, X_START, X_SHIFT, X_SIZE, &x0, &x1, &fx);
+  axis_position(y, Y_START, Y_SHIFT, Y_SIZE, &y0, &y1, &fy);
+  const uint8_t* row0 = cells[x0]; // lower X point
+  const uint8_t* row1 = cells[x1]; // upper X point
+  
+  // Y direction (16 bits modular multiplications). 2e16 = 100%
+  uint16_t r0 = ((uint16_t)row0[y0] << 8) + (uint16_t)((uint16_t)(row0[y1] - row0[y0]) * fy);
+  uint16_t r1 = ((uint16_t)row1[y0] << 8) + (uint16_t)((uint16_t)(row1[y1] - row1[y0]) * fy);
+  
+  // X direction (32 bits modular multiplication). 2e24 = 100%, then shifted to 2e16 = 100% (2e8 = 50% in the cells)
+  uint32_t r = ((uint32_t)r0 << 8) + (uint32_t)((int32_t)r1 - (int32_t)r0) * fx;
+  return (uint16_t)(r >> 9);
+}
+
+#endif
@@ -1,70 +1,79 @@
 #ifndef TEMPO_cpp
 #define TEMPO_cpp
 
-#include "tempo.h"
+#include "Tempo.h"
+#include "../../ISRmgr/ISRmgr.h" // ISR monitoring (trace pins)
 
 Tempo Timer1;              // preinstatiate
 
 ISR(TIMER1_COMPA_vect)          // interrupt service routine that wraps a user defined function supplied by attachInterrupt
 {
-  Timer1.isrCallback();
+  ISR_TRACE_TIMER1_BEGIN(); // Trace pin HIGH
+  ISR_STATS_BEGIN(); // Execution time statistics
+  TIMSK1 &= ~_BV(OCIE1A); // one shot: channel A expired
+  Timer1.isrCallback(0);
+  ISR_STATS_END(ISR_ID_TIMER1); // Execution time statistics
+  ISR_TRACE_TIMER1_END(); // Trace pin LOW
 }
 
-void Tempo::initialize()
+ISR(TIMER1_COMPB_vect)          // same as above, for compare channel B
 {
-  TCCR1A = 0; // clear control register A 
-  TCCR1B = _BV(WGM12); // turn on CTC mode
-  clockSelectBits = _BV(CS11); // prescale by /8 = 0.5us at 16MHz
+  ISR_TRACE_TIMER1_BEGIN(); // Trace pin HIGH
+  ISR_STATS_BEGIN(); // Execution time statistics
+  TIMSK1 &= ~_BV(OCIE1B); // one shot: channel B expired
+  Timer1.isrCallback(1);
+  ISR_STATS_END(ISR_ID_TIMER1); // Execution time statistics
+  ISR_TRACE_TIMER1_END(); // Trace pin LOW
 }
 
-void Tempo::setPeriod(uint16_t ticks_num) // sets the period (in ticks), 1 tick = 0.5 us
+ISR(TIMER1_OVF_vect)          // counts the overflows, to extend the counter to 32 bits
 {
-  oldSREG = SREG;				
-  cli(); // Disable interrupts for 16 bit register access
-  OCR1A = ticks_num; // 2 bytes write
-  SREG = oldSREG;
+  Timer1.overflow_count++;
 }
 
-
-// Attaches an interrupt to the Timer1 interrupt event
-void Tempo::attachInterrupt(void (*isr)())
+void Tempo::initialize()
 {
-  isrCallback = isr; // register the user's callback with the real ISR
-  TIMSK1 = _BV(OCIE1A); // sets the timer overflow interrupt enable bit on compare
-  //sei(); //might be running with interrupts disabled (eg inside an ISR), so don't touch the global state
+  overflow_count = 0;
+  TIMSK1 = _BV(TOIE1); // overflow interrupt only, until a channel is armed
+  TCCR1A = 0; // clear control register A (normal mode, OC1A/OC1B pins disconnected)
+  TCCR1B = _BV(CS11); // normal mode (free running, overflows every 32768 us), prescale by /8 = 0.5us at 16MHz
 }
 
 
-// Removes the Timer1 interrupt
-void Tempo::detachInterrupt()
+// Attaches the callback called by both compare channels. The channel number (0 = A, 1 = B) is passed to the callback
+void Tempo::attachInterrupt(void (*isr)(uint8_t channel))
 {
-  TIMSK1 &= ~_BV(OCIE1A); // clears the timer overflow interrupt enable bit, timer continues to count without calling the isr 
-}
-
-
-// Starts the timer
-void Tempo::start()
-{ 
-  TCCR1B &= ~(_BV(CS10) | _BV(CS11) | _BV(CS12));
-  TCCR1B |= clockSelectBits; // fa partire il timer
+  isrCallback = isr; // register the user's callback with the real ISR
 }
 
 
-// Stops the timer
-void Tempo::stop()
+// Arms the compare channel (0 = A, 1 = B), so that it expires "ticks_num" ticks from now. The timer is never stopped, so each channel is independent
+void Tempo::arm(uint8_t channel, uint16_t ticks_num)
 {
-  TCCR1B &= ~(_BV(CS10) | _BV(CS11) | _BV(CS12)); // clears all clock selects bits
+  oldSREG = SREG;
+  cli(); // Disable interrupts for 16 bit register access
+  uint16_t compare_tmp = TCNT1 + ticks_num; // expiry time (wraps around at 65536)
+  if (channel == 0){
+    OCR1A = compare_tmp; // 2 bytes write
+    TIFR1 = _BV(OCF1A); // clears any old compare match (flag is cleared writing 1)
+    TIMSK1 |= _BV(OCIE1A); // enables the interrupt on compare match A
+  }else{
+    OCR1B = compare_tmp; // 2 bytes write
+    TIFR1 = _BV(OCF1B); // clears any old compare match (flag is cleared writing 1)
+    TIMSK1 |= _BV(OCIE1B); // enables the interrupt on compare match B
+  }
+  SREG = oldSREG;
 }
 
 
-// Resets the counter
-void Tempo::reset()
-{ 
-	oldSREG= SREG;
-  	cli();	
-	TCNT1H=0;
-	TCNT1L=0;
-	SREG = oldSREG;
+// Disarms the compare channel, timer continues to count without calling the isr 
+void Tempo::disarm(uint8_t channel)
+{
+  if (channel == 0){
+    TIMSK1 &= ~_BV(OCIE1A); // clears the interrupt enable bit on compare match A
+  }else{
+    TIMSK1 &= ~_BV(OCIE1B); // clears the interrupt enable bit on compare match B
+  }
 }
 
 
@@ -77,4 +86,16 @@ uint16_t Tempo::read(){
 	return tmp;
 }
 
+
+// Return the number of Timer1 ticks, extended to 32 bits (wraps around every 35 minutes)
+uint32_t Tempo::read_extended(){
+	oldSREG= SREG;
+  	cli();
+  	uint16_t ovf=overflow_count;
+  	uint16_t tmp=TCNT1;
+  	if ((TIFR1 & _BV(TOV1)) && (tmp < 0x8000)) ovf++; // overflow happened, but its interrupt is not yet served
+	SREG = oldSREG;
+	return ((uint32_t)ovf << 16) | tmp;
+}
+
 #endif
\ No newline at end of file
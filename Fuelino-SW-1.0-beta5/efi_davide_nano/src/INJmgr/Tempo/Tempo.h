@@ -4,24 +4,25 @@
 #include <avr/io.h>
 #include <avr/interrupt.h>
 
+#define TEMPO_CHANNELS_NUM 2 // number of compare channels (OCR1A and OCR1B)
+
 class Tempo
 {
   public:
   
     // properties
-    unsigned char clockSelectBits; // 
 	char oldSREG; // To hold Status Register while ints disabled
 
     // methods
-    void initialize();
-    void start(); // starts the timer
-	void reset(); // resets the timer
-    void stop(); // stops the timer
+    void initialize(); // starts Timer1 free running (never stopped)
 	uint16_t read(); // returns the time of the counter
-    void attachInterrupt(void (*isr)());
-    void detachInterrupt();
-    void setPeriod(uint16_t ticks_num);
-	void (*isrCallback)();
+	uint32_t read_extended(); // returns the time of the counter, extended to 32 bits with the overflows count
+    void attachInterrupt(void (*isr)(uint8_t channel)); // callback called when a compare channel expires
+    void arm(uint8_t channel, uint16_t ticks_num); // compare channel expires "ticks_num" ticks from now, 1 tick = 0.5 us
+    void disarm(uint8_t channel); // compare channel does not call the callback anymore
+    bool armed(uint8_t channel) { return (TIMSK1 & (channel ? _BV(OCIE1B) : _BV(OCIE1A))); } // compare channel is armed and not yet expired
+	void (*isrCallback)(uint8_t channel);
+	volatile uint16_t overflow_count; // Timer1 overflows (1 overflow = 32768 us)
 };
 
 extern Tempo Timer1;
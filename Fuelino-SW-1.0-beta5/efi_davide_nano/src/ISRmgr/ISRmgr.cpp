@@ -0,0 +1,68 @@
+#ifndef ISRmgr_cpp
+#define ISRmgr_cpp
+
+#include "ISRmgr.h"
+#include <avr/interrupt.h>
+
+#if ISR_STATS_ENABLE
+
+volatile ISRmgr_stats_struct ISRmgr_stats[ISR_IDS_NUM]; // execution time statistics, one per ISR
+volatile uint16_t ISRmgr_stats_hist[ISR_STATS_HIST_NUM][ISR_STATS_HIST_SIZE]; // histograms (Timer1, SWseriale)
+
+
+// Resets one ISR statistics (interrupts must be disabled)
+void ISRmgr_stats_reset_one(uint8_t isr_id){
+	volatile ISRmgr_stats_struct* st = &ISRmgr_stats[isr_id];
+	st->count = 0;
+	st->count_overflow = 0;
+	st->time_min = 0xFFFF; // any execution is lower
+	st->time_max = 0;
+	int8_t h = ISR_STATS_HIST_INDEX(isr_id);
+	if (h >= 0) for (uint8_t i=0; i<ISR_STATS_HIST_SIZE; i++) ISRmgr_stats_hist[h][i] = 0;
+}
+
+
+// Resets the statistics of all ISRs
+void ISRmgr_stats_reset(){
+	uint8_t oldSREG = SREG;
+	cli(); // statistics are written by the ISRs
+	for (uint8_t isr_id=0; isr_id<ISR_IDS_NUM; isr_id++) ISRmgr_stats_reset_one(isr_id);
+	SREG = oldSREG;
+}
+
+
+// Prepares the packet for COMM send (Serial Service protocol): 'H' | ISR number | count (2 bytes) | count overflows | min (2 bytes) | max (2 bytes) | histogram (2 bytes each, zeros for PCINT2 and ADC). Times in Timer1 ticks (0.5us)
+// Copy and reset are done with interrupts disabled, so no execution is lost between them
+void ISRmgr_prepare_COMM_packet(uint8_t* temp_data_buffer_COMM, uint8_t isr_id, bool reset){
+	ISRmgr_stats_struct st; // coherent copy
+	uint16_t hist[ISR_STATS_HIST_SIZE];
+	int8_t h = ISR_STATS_HIST_INDEX(isr_id);
+	uint8_t oldSREG = SREG;
+	cli(); // statistics are written by the ISRs
+	st.count = ISRmgr_stats[isr_id].count;
+	st.count_overflow = ISRmgr_stats[isr_id].count_overflow;
+	st.time_min = ISRmgr_stats[isr_id].time_min;
+	st.time_max = ISRmgr_stats[isr_id].time_max;
+	for (uint8_t i=0; i<ISR_STATS_HIST_SIZE; i++) hist[i] = (h >= 0) ? ISRmgr_stats_hist[h][i] : 0;
+	if (reset) ISRmgr_stats_reset_one(isr_id);
+	SREG = oldSREG;
+	
+	uint8_t i=0; // packet bytes counter
+	temp_data_buffer_COMM[i++] = 'H'; // "H" for ISR Histogram
+	temp_data_buffer_COMM[i++] = isr_id;
+	temp_data_buffer_COMM[i++] = (uint8_t)(st.count & 0xff); // LSB
+	temp_data_buffer_COMM[i++] = (uint8_t)((st.count >> 8) & 0xff); // MSB
+	temp_data_buffer_COMM[i++] = st.count_overflow;
+	temp_data_buffer_COMM[i++] = (uint8_t)(st.time_min & 0xff); // LSB
+	temp_data_buffer_COMM[i++] = (uint8_t)((st.time_min >> 8) & 0xff); // MSB
+	temp_data_buffer_COMM[i++] = (uint8_t)(st.time_max & 0xff); // LSB
+	temp_data_buffer_COMM[i++] = (uint8_t)((st.time_max >> 8) & 0xff); // MSB
+	for (uint8_t k=0; k<ISR_STATS_HIST_SIZE; k++){
+		temp_data_buffer_COMM[i++] = (uint8_t)(hist[k] & 0xff); // LSB
+		temp_data_buffer_COMM[i++] = (uint8_t)((hist[k] >> 8) & 0xff); // MSB
+	}
+}
+
+#endif
+
+#endif
\ No newline at end of file
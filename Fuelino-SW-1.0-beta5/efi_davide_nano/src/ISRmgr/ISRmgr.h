@@ -0,0 +1,105 @@
+// Davide Cavaliere
+// www.monocilindro.com
+// dadez87-at-gmail-com
+// ISR monitoring library for Atmel ATmega 328p
+// This library is used, on Fuelino project, to observe the timing of the interrupt service routines (injector, Timer1, ADC, SWseriale)
+// Execution time statistics (ISR_STATS_ENABLE, always on by default, read with Serial command "d 2 x n" on any build) and trace pins (ISR_TRACE_PINS_ENABLE, debug option for logic analyzer or simavr, disabled by default)
+
+#ifndef ISRmgr_h
+#define ISRmgr_h
+
+#include <avr/io.h>
+#include "../compile_options.h"
+
+#define ISR_ID_INJ 0 // ISR(PCINT2_vect), injector input
+#define ISR_ID_TIMER1 1 // ISR(TIMER1_COMPA_vect), ISR(TIMER1_COMPB_vect), injector extension and cranking filter
+#define ISR_ID_ADC 2 // ISR(ADC_vect)
+#define ISR_ID_SWSERIALE 3 // ISR(TIMER2_COMPA_vect), SWseriale bits
+#define ISR_IDS_NUM 4 // Number of ISRs monitored
+#define ISR_STATS_HIST_SIZE 8 // Histogram buckets: below 8us, 16us, 32us, 64us, 128us, 256us, 512us, and above 512us
+#define ISR_STATS_HIST_FIRST_SHIFT 4 // First bucket: below 2^4 Timer1 ticks (8us). Each next bucket doubles the limit
+#define ISR_STATS_HIST_INDEX(isr_id) (((isr_id) == ISR_ID_TIMER1) ? 0 : (((isr_id) == ISR_ID_SWSERIALE) ? 1 : -1)) // Histogram of the ISR (-1: none). PCINT2 and ADC have no histogram, to keep their statistics cost low (they run at each injector edge, and each 104us)
+#define ISR_STATS_HIST_NUM 2 // ISRs with histogram
+#define ISR_STATS_COMM_SIZE (2 + 2 + 1 + 2 + 2 + 2 * ISR_STATS_HIST_SIZE) // packet for COMM Service via Serial (header, ISR number, counters, min, max, histogram: zeros for PCINT2 and ADC) | 25 bytes
+
+// Trace pins: each pin is HIGH while the related ISR is executing. Entry latency, execution time and blocking between ISRs
+// can be measured cycle-exact with a logic analyzer, or with the simavr benchmark "test/simavr" (injector, ADC and GPS stimuli, latency and jitter report)
+#if ISR_TRACE_PINS_ENABLE
+	#if FUELINO_HW_VERSION != 2
+		#error "ISR trace pins are available only on Fuelino V2 (on Fuelino V1, pins 2 and 9 are used for the injector)"
+	#endif
+	#define ISR_TRACE_INJ_BEGIN() (PORTD |= _BV(PORTD3)) // D3: ISR(PCINT2_vect), injector input
+	#define ISR_TRACE_INJ_END() (PORTD &= ~_BV(PORTD3))
+	#define ISR_TRACE_TIMER1_BEGIN() (PORTD |= _BV(PORTD5)) // D5: ISR(TIMER1_COMPA_vect), injector extension
+	#define ISR_TRACE_TIMER1_END() (PORTD &= ~_BV(PORTD5))
+	#define ISR_TRACE_ADC_BEGIN() (PORTD |= _BV(PORTD7)) // D7: ISR(ADC_vect)
+	#define ISR_TRACE_ADC_END() (PORTD &= ~_BV(PORTD7))
+	#define ISR_TRACE_TIMER2_BEGIN() (PORTB |= _BV(PORTB1)) // D9: ISR(TIMER2_COMPA_vect), SWseriale bits
+	#define ISR_TRACE_TIMER2_END() (PORTB &= ~_BV(PORTB1))
+#else
+	#define ISR_TRACE_INJ_BEGIN()
+	#define ISR_TRACE_INJ_END()
+	#define ISR_TRACE_TIMER1_BEGIN()
+	#define ISR_TRACE_TIMER1_END()
+	#define ISR_TRACE_ADC_BEGIN()
+	#define ISR_TRACE_ADC_END()
+	#define ISR_TRACE_TIMER2_BEGIN()
+	#define ISR_TRACE_TIMER2_END()
+#endif
+
+#if ISR_STATS_ENABLE
+// Execution time statistics of one ISR (min, max, counters), measured with Timer1 (0.5us). Written only by the ISR itself, read and reset by Main Loop with interrupts disabled
+typedef struct{
+	uint16_t count; // executions (wraps)
+	uint8_t count_overflow; // number of times "count" wrapped
+	uint16_t time_min; // minimum execution time (Timer1 ticks, 0.5us)
+	uint16_t time_max; // maximum execution time (Timer1 ticks, 0.5us)
+} ISRmgr_stats_struct;
+extern volatile ISRmgr_stats_struct ISRmgr_stats[ISR_IDS_NUM];
+extern volatile uint16_t ISRmgr_stats_hist[ISR_STATS_HIST_NUM][ISR_STATS_HIST_SIZE]; // executions per time bucket (saturated to 0xFFFF), Timer1 and SWseriale ISRs only
+
+// Updates the statistics of one ISR, with its execution time. Inlined inside the ISRs (no call), "isr_id" is a constant, so the statistics are accessed at fixed addresses.
+// Cost, with the Timer1 readings of the macros below: about 40 clock cycles without histogram (PCINT2, ADC), about 60 - 110 with histogram (Timer1, SWseriale: the log2 loop takes
+// about 7 cycles per bucket), plus the registers saved at the ISR entry. The statistics are updated after the injector output is written, so they do not delay it
+inline void ISRmgr_stats_update(uint8_t isr_id, uint16_t exec_ticks){
+	volatile ISRmgr_stats_struct* st = &ISRmgr_stats[isr_id];
+	if (++st->count == 0) st->count_overflow++;
+	if (exec_ticks < st->time_min) st->time_min = exec_ticks;
+	if (exec_ticks > st->time_max) st->time_max = exec_ticks;
+	if (ISR_STATS_HIST_INDEX(isr_id) >= 0){ // removed by the compiler for the ISRs without histogram
+		volatile uint16_t* hist = ISRmgr_stats_hist[ISR_STATS_HIST_INDEX(isr_id)];
+		uint8_t bucket = 0;
+		uint16_t t = exec_ticks >> ISR_STATS_HIST_FIRST_SHIFT;
+		while (t && (bucket < (ISR_STATS_HIST_SIZE - 1))){ // log2 bucket
+			t >>= 1;
+			bucket++;
+		}
+		if (hist[bucket] != 0xFFFF) hist[bucket]++; // saturated
+	}
+}
+
+// Macros used inside the ISRs: "BEGIN" at the ISR entry, "END" before each exit
+	#define ISR_STATS_BEGIN() uint16_t ISRmgr_time_start = TCNT1 // Timer1, free running (0.5us)
+	#define ISR_STATS_END(isr_id) ISRmgr_stats_update((isr_id), (uint16_t)(TCNT1 - ISRmgr_time_start))
+
+extern void ISRmgr_stats_reset(); // Resets the statistics of all ISRs
+extern void ISRmgr_prepare_COMM_packet(uint8_t* temp_data_buffer_COMM, uint8_t isr_id, bool reset); // Copies the statistics of one ISR into a packet, and optionally resets them
+#else
+	#define ISR_STATS_BEGIN()
+	#define ISR_STATS_END(isr_id)
+#endif
+
+// Sets the trace pins as outputs (LOW). Called in MAIN Setup, before any interrupt is enabled
+inline void ISRmgr_init(){
+#if ISR_TRACE_PINS_ENABLE
+	PORTD &= ~(_BV(PORTD3) | _BV(PORTD5) | _BV(PORTD7)); // LOW
+	DDRD |= (_BV(PORTD3) | _BV(PORTD5) | _BV(PORTD7)); // Outputs
+	PORTB &= ~_BV(PORTB1); // LOW
+	DDRB |= _BV(PORTB1); // Output
+#endif
+#if ISR_STATS_ENABLE
+	ISRmgr_stats_reset(); // Minimum times at maximum value
+#endif
+}
+
+#endif
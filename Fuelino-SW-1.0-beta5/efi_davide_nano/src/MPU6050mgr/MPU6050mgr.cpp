@@ -6,10 +6,13 @@
 #include "MPU6050mgr.h"
 #include "../COMMmgr/COMMmgr.h" // Communication manager (for checksum calculation)
 #include "../compile_options.h"
+#include "../Fixed/Fixed.h" // Fixed-point arithmetic (signal filter)
 
 #define MPU6050_I2C_ADDRESS 0x68  // I2C address of the MPU-6050
 #define MPU6050_TASK_TIME_TARGET (uint16_t)10 // Task time target, in ms
 #define MPU6050_TASK_TIME_MULT (uint8_t)5 // Multiplier for polling time [the sampling time is the multiplication of this value and polling time]
+typedef Fixed<0, 15, true> MPU6050_q15_t; // filtered signals (Q15)
+typedef Fixed<1, 30, true> MPU6050_q30_t; // filter accumulator (Q30)
 #define MPU6050_SIG_FILT_CNST (int16_t)10000 // Filtering constant for newly received signals (0 = No filtering. Max value: 2^15 -1)
 
 
@@ -68,17 +71,10 @@ void MPU6050mgr_class::begin(){
 int16_t MPU6050mgr_class::filter_signal(int16_t sig_old, int16_t sig_new){
 	
 	int32_t acc = 1 << 14; // accumulator for MACs // load rounding constant
-	acc += ((int32_t)sig_old * (int32_t)MPU6050_SIG_FILT_CNST);
-	acc += ((int32_t)sig_new * ((int32_t)32768 - (int32_t)MPU6050_SIG_FILT_CNST));
+	acc += fixed_mul_s16(sig_old, MPU6050_SIG_FILT_CNST); // Q15 x Q15 = Q30
+	acc += fixed_mul_su16(sig_new, (uint16_t)32768 - (uint16_t)MPU6050_SIG_FILT_CNST); // coefficient up to 32768 (1.0), unsigned
 	
-	// saturate the result 
-	if ( acc > 0x3fffffff ) {
-		acc = 0x3fffffff;
-	} else if ( acc < -0x40000000 ) { 
-		acc = -0x40000000; 
-	} 
-	
-	return ((int16_t)(acc >> 15)); // convert from Q30 to Q15 
+	return MPU6050_q30_t::from_raw(acc).to_sat<MPU6050_q15_t>().raw; // convert from Q30 to Q15, saturated
 }
 
 // Reads data from MPU-6050, filters the signals, and saves the signals in the temporary buffer
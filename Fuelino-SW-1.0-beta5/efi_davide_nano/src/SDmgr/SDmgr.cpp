@@ -12,6 +12,8 @@
 #define SD_CS_PIN_NUM A1 // CS pin for SD card (SPI) - Slave Select
 #define MAX_WRITE_ERRORS 10 // Maximum consecutive write errors that will cause a re-init. 
 #define MAX_DELAY_POWERON 20 // This is used as time delay at power ON before performing an "init"
+#define SD_BEGIN_DELAY_MAX 400 // Maximum delay between two SD initialization attempts (Main Loop cycles, 10s): the delay starts from MAX_DELAY_POWERON, and is doubled after each failed attempt
+#define SD_FILE_NUM_TRIES 20 // File numbers tried to find a file name not yet used on the card (existing logs are never overwritten)
 
 SdFat SD; // needed to manage SD card
 
@@ -33,6 +35,16 @@ SDmgr_class::SDmgr_class(){
 	SD_init_OK = false; // NG
 	packet_cnt = 0; // packet counter init value
 	write_errors_cnt = 0;
+	begin_delay = MAX_DELAY_POWERON; // first attempt
+	begin_delay_cnt = 0;
+#if SD_CONTIGUOUS_LOG
+	log_contiguous = false;
+	log_block_buf = 0; // no multi-block write in progress
+	log_block_bytes = 0;
+	log_blocks_left = 0;
+	bat_off_cnt = 0;
+	bat_sample_last = 0;
+#endif
 	
 }
 
@@ -47,21 +59,36 @@ bool SDmgr_class::begin(){
 	SdFile::dateTimeCallback(dateTime);
 	
 	// SD INITIALIZATION
+#if SD_CONTIGUOUS_LOG
+	log_block_buf = 0; // a multi-block write in progress (if any) is abandoned by the card re-initialization
+#endif
 	if (!SD.begin(SD_CS_PIN_NUM, SPI_HALF_SPEED)) { // CS pin for SD card is pin #10
 		SD_init_OK = false; // NG
+		if (begin_delay < SD_BEGIN_DELAY_MAX) begin_delay <<= 1; // back-off: next attempt later (no card, or card not responding)
 		return false;
 	}
 	SD_init_OK = true; // OK
+	begin_delay = MAX_DELAY_POWERON; // card working: after a log stop, the next attempt is done quickly
 
-	// Read file name from EEPROM and stores file name as string (8.3 format)
-	uint16_t file_number = EEPROM_SD_file_num_rw();
-	file_name="fln";
-	if (file_number < 10) file_name+='0';
-	if (file_number < 100) file_name+='0';
-	if (file_number < 1000) file_name+='0';
-	if (file_number < 10000) file_name+='0';
-	file_name+=(unsigned int)file_number;
-	file_name+=".log";
+	// Read file number from EEPROM and stores file name as string (8.3 format). Numbers already used on the card are skipped (counted in RAM), the number chosen is written into EEPROM once
+	uint16_t file_number = EEPROM_SD_file_num_next();
+	uint8_t tries = 0;
+	for (;;){
+		file_name="fln";
+		if (file_number < 10) file_name+='0';
+		if (file_number < 100) file_name+='0';
+		if (file_number < 1000) file_name+='0';
+		if (file_number < 10000) file_name+='0';
+		file_name+=(unsigned int)file_number;
+		file_name+=".log";
+		if (!SD.exists(file_name.c_str()) || (++tries >= SD_FILE_NUM_TRIES)) break; // if all the numbers tried are used, the last file is appended
+		file_number++;
+	}
+	EEPROM_SD_file_num_write(file_number);
+	
+#if SD_CONTIGUOUS_LOG
+	log_contiguous = log_contiguous_start(); // if the contiguous file cannot be created, the log is appended as with SD_CONTIGUOUS_LOG = 0
+#endif
 	
 	MPU6050mgr.flush_buffer(); // flushes the IMU buffer (sets no data to write)
 	
@@ -72,14 +99,39 @@ bool SDmgr_class::begin(){
 }
 
 
+#if SD_CONTIGUOUS_LOG
+// Pre-allocates the contiguous log file "file_name", and starts the multi-block write on its first block (the directory and the FAT are not accessed anymore while logging).
+// Returns false if the file cannot be created (name already used, card full or too fragmented): nothing is left on the card
+bool SDmgr_class::log_contiguous_start(){
+	
+	SdFile log_file;
+	uint32_t block_first, block_last; // raw block addresses of the file
+	if (SD.exists(file_name.c_str())) return false; // existing log: appended, never overwritten
+	if (!log_file.createContiguous(SD.vwd(), file_name.c_str(), SD_CONTIGUOUS_LOG_BLOCKS * SD_BLOCK_SIZE)) return false; // card full or too fragmented
+	bool range_OK = log_file.contiguousRange(&block_first, &block_last);
+	log_file.close(); // directory entry written now
+	uint8_t* block_buf = (uint8_t*)SD.vol()->cacheClear(); // the SdFat cache becomes the block buffer
+	if (!range_OK || (block_buf == 0) || !SD.card()->writeStart(block_first, SD_CONTIGUOUS_LOG_BLOCKS)){ // blocks pre-erased by the card
+		SD.remove(file_name.c_str()); // the file just created (no data): the log is appended in a new empty file
+		return false;
+	}
+	log_block_buf = block_buf;
+	log_block_bytes = 0;
+	log_blocks_left = SD_CONTIGUOUS_LOG_BLOCKS;
+	return true;
+	
+}
+#endif
+
+
 bool SDmgr_class::log_SD_data(){
 
 	// Performs SD Initialization, in case it is necessary (in case it was not possible before, or it is the first time to call this function)
 	if (SD_init_OK == false) {
-		write_errors_cnt++; // this is for delay purposes, to avoid continuous "begin()" calls
-		if (write_errors_cnt >= MAX_DELAY_POWERON) {
+		begin_delay_cnt++; // this is for delay purposes, to avoid continuous "begin()" calls (the delay grows after each failed attempt)
+		if (begin_delay_cnt >= begin_delay) {
 			begin(); // Initializes SD memory
-			write_errors_cnt = 0; // reset counter
+			begin_delay_cnt = 0; // reset counter
 		} 
 	}
 
@@ -87,7 +139,7 @@ bool SDmgr_class::log_SD_data(){
 
 	// Preparation of Engine Data array (this is needed also for Serial communication - service protocol)
 	uint8_t i=0; // packet bytes counter
-	SD_writing_buffer[i++] = 'd';
+	SD_writing_buffer[i++] = SD_ENGINE_PACKET_ID; // Engine data, 4 bytes delta_time_tick (layout in SDmgr.h)
 	SD_writing_buffer[i++] = packet_cnt; // packet counter
 	packet_cnt++; // increase packet counter
 	unsigned long time_stamp_temp = millis(); // read time stamp
@@ -95,23 +147,39 @@ bool SDmgr_class::log_SD_data(){
     SD_writing_buffer[i++] = (uint8_t)((time_stamp_temp >> 8) & 0xff);
     SD_writing_buffer[i++] = (uint8_t)((time_stamp_temp >> 16) & 0xff);
     SD_writing_buffer[i++] = (uint8_t)((time_stamp_temp >> 24) & 0xff); // MSB
-	buffer_busy = 1; // Locks the buffer access (semaphore)
-	SD_writing_buffer[i++] = (uint8_t)(injection_counter_buffer & 0xff); // LSB
-	SD_writing_buffer[i++] = (uint8_t)((injection_counter_buffer >> 8) & 0xff); // MSB
-    SD_writing_buffer[i++] = (uint8_t)(delta_time_tick_buffer & 0xff); // LSB
-	SD_writing_buffer[i++] = (uint8_t)((delta_time_tick_buffer >> 8) & 0xff); // MSB
-    SD_writing_buffer[i++] = (uint8_t)(delta_inj_tick_buffer & 0xff); // LSB
-    SD_writing_buffer[i++] = (uint8_t)((delta_inj_tick_buffer >> 8) & 0xff); // MSB
-    SD_writing_buffer[i++] = (uint8_t)(throttle_buffer & 0xff); // LSB
-    SD_writing_buffer[i++] = (uint8_t)((throttle_buffer >> 8) & 0xff); // MSB
-	SD_writing_buffer[i++] = (uint8_t)(lambda_buffer & 0xff); // LSB
-    SD_writing_buffer[i++] = (uint8_t)((lambda_buffer >> 8) & 0xff); // MSB
-	SD_writing_buffer[i++] = (uint8_t)(extension_time_ticks_buffer & 0xff); // LSB
-	SD_writing_buffer[i++] = (uint8_t)((extension_time_ticks_buffer >> 8) & 0xff); // MSB
-	buffer_busy = 0; // Opens the buffer again
+	INJ_engine_snapshot_struct engine_data; // coherent copy of engine data
+	INJmgr.read_engine_snapshot(&engine_data);
+	SD_writing_buffer[i++] = (uint8_t)(engine_data.channel[0].injection_counter & 0xff); // LSB
+	SD_writing_buffer[i++] = (uint8_t)((engine_data.channel[0].injection_counter >> 8) & 0xff); // MSB
+    SD_writing_buffer[i++] = (uint8_t)(engine_data.channel[0].delta_time_tick & 0xff); // LSB
+	SD_writing_buffer[i++] = (uint8_t)((engine_data.channel[0].delta_time_tick >> 8) & 0xff);
+	SD_writing_buffer[i++] = (uint8_t)((engine_data.channel[0].delta_time_tick >> 16) & 0xff);
+	SD_writing_buffer[i++] = (uint8_t)((engine_data.channel[0].delta_time_tick >> 24) & 0xff); // MSB
+    SD_writing_buffer[i++] = (uint8_t)(engine_data.channel[0].delta_inj_tick & 0xff); // LSB
+    SD_writing_buffer[i++] = (uint8_t)((engine_data.channel[0].delta_inj_tick >> 8) & 0xff); // MSB
+    SD_writing_buffer[i++] = (uint8_t)(engine_data.throttle & 0xff); // LSB
+    SD_writing_buffer[i++] = (uint8_t)((engine_data.throttle >> 8) & 0xff); // MSB
+	SD_writing_buffer[i++] = (uint8_t)(engine_data.lambda & 0xff); // LSB
+    SD_writing_buffer[i++] = (uint8_t)((engine_data.lambda >> 8) & 0xff); // MSB
+	uint16_t extension_log = engine_data.channel[0].extension_time_ticks | (engine_data.channel[0].aborted ? SD_ENGINE_ABORTED_FLAG : 0); // extension time, with the aborted flag
+	SD_writing_buffer[i++] = (uint8_t)(extension_log & 0xff); // LSB
+	SD_writing_buffer[i++] = (uint8_t)((extension_log >> 8) & 0xff); // MSB
 	SD_writing_buffer[i++] = (uint8_t)INJ_exec_time_1; // LSB
 	SD_writing_buffer[i++] = (uint8_t)INJ_exec_time_2; // LSB
 	SD_writing_buffer[i++] = ADCmgr_binary_inputs_status_read(); // digital inputs status
+#if INJ_CHANNELS_NUM == 2
+	SD_writing_buffer[i++] = (uint8_t)(engine_data.channel[1].injection_counter & 0xff); // LSB, injector 2
+	SD_writing_buffer[i++] = (uint8_t)((engine_data.channel[1].injection_counter >> 8) & 0xff); // MSB
+	SD_writing_buffer[i++] = (uint8_t)(engine_data.channel[1].delta_time_tick & 0xff); // LSB
+	SD_writing_buffer[i++] = (uint8_t)((engine_data.channel[1].delta_time_tick >> 8) & 0xff);
+	SD_writing_buffer[i++] = (uint8_t)((engine_data.channel[1].delta_time_tick >> 16) & 0xff);
+	SD_writing_buffer[i++] = (uint8_t)((engine_data.channel[1].delta_time_tick >> 24) & 0xff); // MSB
+	SD_writing_buffer[i++] = (uint8_t)(engine_data.channel[1].delta_inj_tick & 0xff); // LSB
+	SD_writing_buffer[i++] = (uint8_t)((engine_data.channel[1].delta_inj_tick >> 8) & 0xff); // MSB
+	extension_log = engine_data.channel[1].extension_time_ticks | (engine_data.channel[1].aborted ? SD_ENGINE_ABORTED_FLAG : 0); // extension time, with the aborted flag
+	SD_writing_buffer[i++] = (uint8_t)(extension_log & 0xff); // LSB
+	SD_writing_buffer[i++] = (uint8_t)((extension_log >> 8) & 0xff); // MSB
+#endif
     uint16_t CK_SUM = COMM_calculate_checksum(SD_writing_buffer, 0, i);
     SD_writing_buffer[i++] = (uint8_t)(CK_SUM >> 8);
     SD_writing_buffer[i++] = (uint8_t)(CK_SUM & 0xFF);
@@ -121,42 +189,66 @@ bool SDmgr_class::log_SD_data(){
 	if (SD_init_OK == true){ // SD card initialized properly
 	
 		if (ADCmgr_battery_status_read() || bat_check_inhibit()){ // logs only if Battery is ON (or if battery check inhibit config flag is active)
-			File dataFile = SD.open(file_name, FILE_WRITE); // Opens the file only if there is battery voltage
-			if (dataFile){ // log only when the file is open, and when battery is connected (to avoid memory corruption)
+#if SD_CONTIGUOUS_LOG
+			bat_off_cnt = 0; // battery OFF debounce restarts
+#endif
+			File dataFile; // log file in append mode, opened and closed at each call (not used by the contiguous log)
+#if SD_CONTIGUOUS_LOG
+			if (!log_contiguous) dataFile = SD.open(file_name, FILE_WRITE); // Opens the file only if there is battery voltage
+			bool log_ready = log_contiguous ? (log_block_buf != 0) : (bool)dataFile; // multi-block write in progress, or file open
+#else
+			dataFile = SD.open(file_name, FILE_WRITE); // Opens the file only if there is battery voltage
+			bool log_ready = (bool)dataFile; // file open
+#endif
+			if (log_ready){ // log only when the file is ready, and when battery is connected (to avoid memory corruption)
 				
-				uint8_t data_bytes_written; // Data bytes effectively written on the SD card
 				bool error_status = false; // Error status
 
 				// Engine info
 				if (!eng_log_inhibit()){
-					data_bytes_written = dataFile.write(SD_writing_buffer, SD_WRITE_BUFFER_SIZE); // Writes engine related info (calculated above)
-					if (data_bytes_written != SD_WRITE_BUFFER_SIZE) error_status = true; // not all bytes were written
+					if (!log_write(dataFile, SD_writing_buffer, SD_WRITE_BUFFER_SIZE)) error_status = true; // Writes engine related info (calculated above), not all bytes were written
 				}
 				
-				// GPS info or Lambda info
+				// GPS info
 				if ((GPS_SD_writing_request == true) && !gps_log_inhibit()) {
-					data_bytes_written = dataFile.write(GPS_recv_buffer, GPS_SD_writing_request_size); // Write GPS data
-					if (data_bytes_written != GPS_SD_writing_request_size) error_status = true; // not all bytes were written
+					if (!log_write(dataFile, GPS_recv_buffer, GPS_SD_writing_request_size)) error_status = true; // Write GPS data, not all bytes were written
 					GPS_SD_writing_request = false; // reset flag (necessary to re-enable filling the buffer from GPS module)
-				}else if ((ADCmgr_lambda_acq_buf_filled == true)  && !lam_log_inhibit()){ // Write LAMBDA info
-					buffer_busy = 1; // Locks the buffer access (semaphore)
-					ADCmgr_lambda_acq_buf[ADCMGR_LAMBDA_ACQ_BUF_TOT-4] = (uint8_t)(delta_inj_tick_buffer & 0xff); // LSB
-					ADCmgr_lambda_acq_buf[ADCMGR_LAMBDA_ACQ_BUF_TOT-3] = (uint8_t)((delta_inj_tick_buffer >> 8) & 0xff); // MSB
-					buffer_busy = 0; // Opens the buffer again
-					CK_SUM = COMM_calculate_checksum((uint8_t*)ADCmgr_lambda_acq_buf, 0, (ADCMGR_LAMBDA_ACQ_BUF_TOT-2));
-					ADCmgr_lambda_acq_buf[(ADCMGR_LAMBDA_ACQ_BUF_TOT-2)] = (uint8_t)(CK_SUM >> 8);
-					ADCmgr_lambda_acq_buf[(ADCMGR_LAMBDA_ACQ_BUF_TOT-1)] = (uint8_t)(CK_SUM & 0xFF);
-					data_bytes_written = dataFile.write((uint8_t*)ADCmgr_lambda_acq_buf, ADCMGR_LAMBDA_ACQ_BUF_TOT); // Write Lambda data
-					if (data_bytes_written != ADCMGR_LAMBDA_ACQ_BUF_TOT) error_status = true; // not all bytes were written
-					ADCmgr_lambda_acq_buf_filled = false; // reset Lambda writing flag, so the buffer can be filled in again if necessary
 				}
 				
+				// Lambda info (all the filled buffers of the pool, oldest first: the pool is filled round robin)
+				if (!lam_log_inhibit()){
+					uint8_t n = ADCmgr_lambda_acq_buf_fill; // buffer being filled: if already filled, it is the oldest one
+					for (uint8_t k=0; k<ADCMGR_LAMBDA_ACQ_BUF_NUM; k++){
+						if (ADCmgr_lambda_acq_buf_filled[n] == true){ // owned by SDmgr until the flag is reset
+							volatile uint8_t* lambda_buf = ADCmgr_lambda_acq_buf[n];
+							lambda_buf[ADCMGR_LAMBDA_ACQ_BUF_TOT-4] = (uint8_t)(engine_data.channel[0].delta_inj_tick & 0xff); // LSB
+							lambda_buf[ADCMGR_LAMBDA_ACQ_BUF_TOT-3] = (uint8_t)((engine_data.channel[0].delta_inj_tick >> 8) & 0xff); // MSB
+							CK_SUM = COMM_calculate_checksum((uint8_t*)lambda_buf, 0, (ADCMGR_LAMBDA_ACQ_BUF_TOT-2));
+							lambda_buf[(ADCMGR_LAMBDA_ACQ_BUF_TOT-2)] = (uint8_t)(CK_SUM >> 8);
+							lambda_buf[(ADCMGR_LAMBDA_ACQ_BUF_TOT-1)] = (uint8_t)(CK_SUM & 0xFF);
+							if (!log_write(dataFile, (uint8_t*)lambda_buf, ADCMGR_LAMBDA_ACQ_BUF_TOT)) error_status = true; // Write Lambda data, not all bytes were written
+							ADCmgr_lambda_acq_buf_filled[n] = false; // reset Lambda writing flag, so the buffer can be filled in again if necessary
+						}
+						if (++n >= ADCMGR_LAMBDA_ACQ_BUF_NUM) n = 0; // rollover
+					}
+				}
+				
+				// Injection trace (all records accumulated in the ring buffer)
+				#if INJ_TRACE_ENABLE
+				if (!eng_log_inhibit()){
+					uint8_t buffer_trace[INJ_TRACE_SD_PACKET_MAX_SIZE]; // create temporary writing buffer
+					uint8_t packet_size;
+					while ((packet_size = INJmgr.prepare_trace_SD_packet(buffer_trace)) != 0){
+						if (!log_write(dataFile, buffer_trace, packet_size)) error_status = true; // Write trace data, not all bytes were written
+					}
+				}
+				#endif
+				
 				// IMU info (many packets accumulated in the buffer)
 				if (!imu_log_inhibit()){
 					uint8_t buffer_temporary[MPU6050_BUFFER_SD_WRITE_SIZE]; // create temporary writing buffer
 					while (MPU6050mgr.prepare_SD_packet(buffer_temporary)){
-						data_bytes_written = dataFile.write(buffer_temporary, MPU6050_BUFFER_SD_WRITE_SIZE); // Write IMU data
-						if (data_bytes_written != MPU6050_BUFFER_SD_WRITE_SIZE) error_status = true; // not all bytes were written
+						if (!log_write(dataFile, buffer_temporary, MPU6050_BUFFER_SD_WRITE_SIZE)) error_status = true; // Write IMU data, not all bytes were written
 					}
 				}
 
@@ -167,6 +259,13 @@ bool SDmgr_class::log_SD_data(){
 					write_errors_cnt = 0; // No error
 				}
 				
+#if SD_CONTIGUOUS_LOG
+				if (log_contiguous){
+					if (error_status == false) { // No error found (data of the block being filled is written on the SD when the block is full)
+						temp_reply = true; // Data log considered completed successfully
+					}
+				}else
+#endif
 				if (ADCmgr_battery_status_read() || bat_check_inhibit()) { // Data written only in case battery voltage is present, or if bypass flag is active
 					dataFile.close(); // Really write the data on the SD, only if battery voltage is present
 					if (error_status == false) { // No error found
@@ -174,10 +273,22 @@ bool SDmgr_class::log_SD_data(){
 					}
 				}
 				
-			}else{ // Could not open the file
+			}else{ // Could not open the file, or contiguous file full, or multi-block write stopped
 				write_errors_cnt++; // Increase error counter
 			}
 		}
+#if SD_CONTIGUOUS_LOG
+		else if (log_contiguous){ // Battery OFF (packets are not logged while it is debounced)
+			uint8_t sample_num = ADCmgr_battery_sample_count_read(); // increased by the ADC interrupt at each battery voltage sample
+			if (sample_num != bat_sample_last){ // new sample, still OFF
+				bat_sample_last = sample_num;
+				if (++bat_off_cnt >= SD_BAT_OFF_SAMPLES){ // battery really OFF
+					bat_off_cnt = 0;
+					log_stop(); // short partial flush, before the supply goes OFF
+				}
+			}
+		}
+#endif
 		
 		// Errors max check
 		if (write_errors_cnt >= MAX_WRITE_ERRORS) {
@@ -192,6 +303,75 @@ bool SDmgr_class::log_SD_data(){
 	
 }
 
+
+// Writes one packet in the log file ("data_file": open in append mode, not used by the contiguous log). Returns true if all the bytes were written
+bool SDmgr_class::log_write(File& data_file, const uint8_t* data, uint16_t size){
+	
+#if SD_CONTIGUOUS_LOG
+	if (log_contiguous) return log_contiguous_write(data, size);
+#endif
+	return (data_file.write(data, size) == size); // append mode
+	
+}
+
+
+#if SD_CONTIGUOUS_LOG
+// Contiguous log: copies the packet in the block buffer. Each full block is sent to the card with the multi-block write (no directory or FAT access). Returns true if all the bytes were written
+bool SDmgr_class::log_contiguous_write(const uint8_t* data, uint16_t size){
+	
+	while (size){
+		if (log_block_buf == 0) return false; // file full, or multi-block write stopped by an error
+		uint16_t chunk = SD_BLOCK_SIZE - log_block_bytes; // free space in the block
+		if (chunk > size) chunk = size;
+		memcpy(log_block_buf + log_block_bytes, data, chunk);
+		log_block_bytes += chunk;
+		data += chunk;
+		size -= chunk;
+		if (log_block_bytes >= SD_BLOCK_SIZE){ // block full
+			if (!SD.card()->writeData(log_block_buf)){ // 512 bytes sent, the card programs them while the next block is filled
+				log_block_buf = 0; // the multi-block write cannot continue: SD re-init needed
+				return false;
+			}
+			log_block_bytes = 0;
+			if (--log_blocks_left == 0) log_stop(); // file full: a new file is created at next "begin()"
+		}
+	}
+	return true;
+	
+}
+
+
+// Writes the End packet and the block being filled (padded with zeros, not a packet identifier), then stops the multi-block write: the card is idle when the supply goes OFF.
+// Used when the battery goes OFF, and when the file is full. A new file is created at next "begin()"
+void SDmgr_class::log_stop(){
+	
+	if (log_block_buf == 0) return; // no multi-block write in progress
+	uint32_t log_bytes = ((SD_CONTIGUOUS_LOG_BLOCKS - log_blocks_left) * SD_BLOCK_SIZE) + log_block_bytes; // valid data written in the file
+	if (log_bytes <= ((SD_CONTIGUOUS_LOG_BLOCKS * SD_BLOCK_SIZE) - SD_END_PACKET_SIZE)){ // room for the End packet (layout in SDmgr.h)
+		uint8_t end_packet[SD_END_PACKET_SIZE];
+		end_packet[0] = SD_END_PACKET_ID;
+		end_packet[1] = (uint8_t)(log_bytes & 0xff); // LSB
+		end_packet[2] = (uint8_t)((log_bytes >> 8) & 0xff);
+		end_packet[3] = (uint8_t)((log_bytes >> 16) & 0xff);
+		end_packet[4] = (uint8_t)((log_bytes >> 24) & 0xff); // MSB
+		uint16_t CK_SUM = COMM_calculate_checksum(end_packet, 0, SD_END_PACKET_SIZE - 2);
+		end_packet[5] = (uint8_t)(CK_SUM >> 8);
+		end_packet[6] = (uint8_t)(CK_SUM & 0xFF);
+		log_contiguous_write(end_packet, SD_END_PACKET_SIZE); // if it fills the last block, the log is already stopped (file full)
+		if (log_block_buf == 0) return;
+	}
+	if (log_block_bytes){ // partial sector
+		memset(log_block_buf + log_block_bytes, 0, SD_BLOCK_SIZE - log_block_bytes);
+		SD.card()->writeData(log_block_buf);
+		log_block_bytes = 0;
+	}
+	SD.card()->writeStop();
+	log_block_buf = 0;
+	SD_init_OK = false; // SD re-init (new file) at next "begin()", when the battery is ON again
+	
+}
+#endif
+
 SDmgr_class SDmgr;
 
 #endif
\ No newline at end of file
@@ -1,23 +1,62 @@
-#ifndef SDmgr_h
-#define SDmgr_h
-
-#define SD_WRITE_BUFFER_SIZE 23 // Size of buffer for SD writing (Engine data only)
-
-class SDmgr_class
-{
-  public:
-    String file_name; // SD file name where to log data
-	bool SD_init_OK; // if SD card was initialized correctly
-	uint8_t SD_writing_buffer[SD_WRITE_BUFFER_SIZE]; // buffer for SD writing
-	uint8_t packet_cnt; // increasing counter
-	uint8_t write_errors_cnt; // increases when there is a writing fault. After reaching the maximum, an SD re-init (begin) is done.
-	
-	SDmgr_class(); // Constructor
-	bool begin(); // SD initialization
-	bool log_SD_data(); // Logs information
-
-};
-
-extern SDmgr_class SDmgr;
+#ifndef SDmgr_h
+#define SDmgr_h
+
+#include "../compile_options.h"
+
+class File; // SdFat file (SDFatYield.h)
+
+// Engine Data packet, little endian (LSB first). Also sent by Serial, "d 1 0 0" binary request
+// 'E' (1 injector, 25 bytes) or 'F' (2 injectors, 35 bytes) | packet counter (1) | millis (4) | injection counter (2) | delta_time_tick (4, 4us, 0 when the engine is stopped) | injection time (2) |
+// throttle (2) | lambda (2) | extension time (2, 0.5us, bit 15: aborted) | ISR exec time ON (1) | ISR exec time OFF (1) | digital inputs (1) | ['F' only, injector 2: injection counter (2) | delta_time_tick (4) | injection time (2) | extension time (2)] |
+// checksum (2, MSB first). Up to version 1.0 beta5, the Engine Data packet was 'd' (23 bytes), with 2 bytes delta_time_tick: logs of both versions can be decoded
+#define SD_ENGINE_ABORTED_FLAG (uint16_t)0x8000 // extension time bit 15: injection aborted by the safety watchdog (extension time is at most MAX_EXTENSION_TIME_TICKS)
+#if INJ_CHANNELS_NUM == 2
+#define SD_ENGINE_PACKET_ID 'F' // Engine Data packet identifier, 2 injectors
+#else
+#define SD_ENGINE_PACKET_ID 'E' // Engine Data packet identifier, 1 injector
+#endif
+#define SD_WRITE_BUFFER_SIZE (25 + 10 * (INJ_CHANNELS_NUM - 1)) // Size of buffer for SD writing (Engine data only). Injector 2 adds 10 bytes
+#define SD_CONTIGUOUS_LOG 1 // 1: the log file is pre-allocated contiguous by "begin()", and written with raw multi-block writes of 512 bytes (no directory or FAT access while logging). All packets are staged in one sector (SdFat cache), only full sectors are written, the last partial one when the battery goes OFF. If the file cannot be pre-allocated (card full or too fragmented), the log is appended as with 0. 0: the file is opened, appended and closed at each loop
+#define SD_CONTIGUOUS_LOG_BLOCKS 32768UL // Contiguous log file size, in blocks of 512 bytes (16MB, about one hour at 4kB/s). When the file is full, the log continues in a new file. Bigger files take longer to pre-allocate (free clusters search in the FAT)
+#define SD_BLOCK_SIZE 512 // SD block (sector) size
+#define SD_BAT_OFF_SAMPLES 4 // Consecutive battery samples OFF (new samples only, checked once per Main Loop cycle: 100ms) before the contiguous log is stopped. A voltage dip (cranking) does not close the log file
+// End of the contiguous log: the file keeps its pre-allocated size, the valid data end before the End packet, written when the log is stopped (battery OFF), then zeros up to the end of the block:
+// 'Z' | valid data length (4, = offset of the End packet in the file) | checksum (2, MSB first). A reader takes the first 'Z' byte whose length field equals its own offset and whose checksum is right.
+// No End packet: the file is full (all data valid), or the supply was lost (or a write error stopped the log) while logging (the data end at the first block not written: erased by the card, all 0x00 or all 0xFF). Append mode files have the exact length
+#define SD_END_PACKET_ID 'Z' // End packet identifier
+#define SD_END_PACKET_SIZE 7 // End packet size
+
+class SDmgr_class
+{
+  public:
+    String file_name; // SD file name where to log data
+	bool SD_init_OK; // if SD card was initialized correctly
+	uint8_t SD_writing_buffer[SD_WRITE_BUFFER_SIZE]; // buffer for SD writing
+	uint8_t packet_cnt; // increasing counter
+	uint8_t write_errors_cnt; // increases when there is a writing fault. After reaching the maximum, an SD re-init (begin) is done.
+	uint16_t begin_delay; // Main Loop cycles between two SD initialization attempts (doubled after each failed attempt)
+	uint16_t begin_delay_cnt; // Main Loop cycles since the last SD initialization attempt
+#if SD_CONTIGUOUS_LOG
+	bool log_contiguous; // true: contiguous log file (multi-block write). false: append mode (the contiguous file could not be created)
+	uint8_t* log_block_buf; // block being filled: SdFat cache (not used by the library while the multi-block write is in progress). 0 if no multi-block write is in progress
+	uint16_t log_block_bytes; // bytes already in the block being filled
+	uint32_t log_blocks_left; // blocks of the contiguous file not yet written
+	uint8_t bat_off_cnt; // consecutive battery samples OFF
+	uint8_t bat_sample_last; // battery sample counter at the last check (ADCmgr)
+#endif
+	
+	SDmgr_class(); // Constructor
+	bool begin(); // SD initialization
+	bool log_SD_data(); // Logs information
+	bool log_write(File& data_file, const uint8_t* data, uint16_t size); // Writes one packet in the log file: "data_file" in append mode, or the contiguous log (true if written completely)
+#if SD_CONTIGUOUS_LOG
+	bool log_contiguous_start(); // Creates the contiguous log file, and starts the multi-block write (false if not possible)
+	bool log_contiguous_write(const uint8_t* data, uint16_t size); // Writes one packet in the contiguous log file (true if written completely)
+	void log_stop(); // Writes the partial sector, and stops the multi-block write
+#endif
+
+};
+
+extern SDmgr_class SDmgr;
 
 #endif
\ No newline at end of file
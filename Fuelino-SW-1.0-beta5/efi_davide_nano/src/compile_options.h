@@ -3,6 +3,7 @@
 
 // Arduino internal options
 #define FUELINO_HW_VERSION 2 // HW version of Fuelino. Fuelino V1 does not have SWseriale, and also, for injector management, input and output pins are different. For Fuelino Proto3, please enter "2"
+#define INJ_CHANNELS_NUM 1 // Number of injectors managed (1 or 2). "2" is for twin (2 cylinders) engines, and is available only on Fuelino V2: injector 2 input on pin 7, output on pin 9
 #define ENABLE_BUILT_IN_HW_SERIAL 1 // Enables the communication HW Serial port (USB connection with PC) on pins 0 and 1. Default is "1". I suggest to keep it as "1", since it does not create problems.
 
 // External modules
@@ -12,6 +13,10 @@
 #define GPS_PRESENT 1 // GPS module on SW Serial
 #define BLUETOOTH_PRESENT 0 // Enables packets forwarding (sending and receiving) through SW Serial, in case FUELINO_HW_VERSION>=2, and a Bluetoooth (or Wifi module) is connected on SWseriale
 
+// Monitoring and debug options
+#define ISR_TRACE_PINS_ENABLE 0 // Drives spare pins D3, D5, D7, D9 HIGH while the injector, Timer1, ADC and Timer2 interrupts are executing, to measure latency and jitter with a logic analyzer or AVR simulator (Fuelino V2 only)
+#define ISR_STATS_ENABLE 1 // Execution time statistics of the injector, Timer1, ADC and Timer2 interrupts, always on, read with Serial command "d 2 x n" without a debug build (adds about 40 clock cycles to the injector and ADC interrupts, 60 - 110 to Timer1 and Timer2, and 60 bytes of RAM). 0 removes them
+
 // Main Loop execution time
 #define LOOP_MIN_EXEC_TIME 25 // Main Loop minimum execution time [ms]
 
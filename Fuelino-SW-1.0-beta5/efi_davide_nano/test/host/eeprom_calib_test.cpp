@@ -0,0 +1,54 @@
+// Davide Cavaliere
+// www.monocilindro.com
+// dadez87-at-gmail-com
+// Calibration EEPROM test (host): "c n 2 00 001" saves the active calibration set (uncommitted Serial edits are not saved),
+// and "c n 2 00 000" writes the standard values into both sets, without committing the Serial edits of the other maps
+
+#include <Arduino.h>
+#include <stdio.h>
+#include "INJmgr/INJmgr.h"
+#include "EEPROMmgr/EEPROMmgr.h"
+
+#define EDIT_RPM 200 // Serial edit of "incrementi_rpm", not committed
+#define EDIT_THR 77 // Serial edit of "incrementi_thr", committed
+
+static uint32_t errors = 0;
+#define CHECK(cond, ...) do{ if (!(cond)){ if (errors++ < 10) { printf("FAIL %s:%d: ", __FILE__, __LINE__); printf(__VA_ARGS__); printf("\n"); } } }while(0)
+
+int main(){
+
+	EEPROM_initialize(); // erased EEPROM: standard maps are written and committed
+
+	// Committed throttle edit, then uncommitted rpm edit
+	INJ_calib_shadow->incrementi_thr[3] = EDIT_THR;
+	INJmgr.calib_commit();
+	INJ_calib_shadow->incrementi_rpm[2] = EDIT_RPM;
+
+	// Save: the active set goes into EEPROM (rpm map: standard value, the edit is not committed)
+	EEPROM_write_RAM_map_to_EEPROM(INJ_MAPS_TOTAL_NUM);
+	CHECK(hal_eeprom[2] == INJ_INCREMENT_RPM_STD, "rpm map saved %u, expected the active value %u", hal_eeprom[2], INJ_INCREMENT_RPM_STD);
+	CHECK(hal_eeprom[2 + INJ_INCR_RPM_MAPS_SIZE] == (uint8_t)(255 - INJ_INCREMENT_RPM_STD), "rpm map redundancy %u", hal_eeprom[2 + INJ_INCR_RPM_MAPS_SIZE]);
+	CHECK(hal_eeprom[2 * INJ_INCR_RPM_MAPS_SIZE + 3] == EDIT_THR, "throttle map saved %u, expected %u", hal_eeprom[2 * INJ_INCR_RPM_MAPS_SIZE + 3], EDIT_THR);
+
+	// Standard values of the throttle map: both sets, the rpm edit stays in the shadow set only
+	EEPROM_write_standard_values(1);
+	CHECK(INJ_calib_active->incrementi_thr[3] == INJ_INCREMENT_THR_STD, "active throttle map %u, expected %u", INJ_calib_active->incrementi_thr[3], INJ_INCREMENT_THR_STD);
+	CHECK(INJ_calib_shadow->incrementi_thr[3] == INJ_INCREMENT_THR_STD, "shadow throttle map %u, expected %u", INJ_calib_shadow->incrementi_thr[3], INJ_INCREMENT_THR_STD);
+	CHECK(INJ_calib_active->incrementi_rpm[2] == INJ_INCREMENT_RPM_STD, "active rpm map %u: uncommitted edit was committed", INJ_calib_active->incrementi_rpm[2]);
+	CHECK(INJ_calib_shadow->incrementi_rpm[2] == EDIT_RPM, "shadow rpm map %u: uncommitted edit lost", INJ_calib_shadow->incrementi_rpm[2]);
+	CHECK(INJmgr.interpolate_rpm_map(INJ_calib_active, 3112) == ((uint16_t)INJ_INCREMENT_RPM_STD << 7), "active rpm lookup table does not match the active map");
+	CHECK(hal_eeprom[2 * INJ_INCR_RPM_MAPS_SIZE + 3] == INJ_INCREMENT_THR_STD, "throttle map in EEPROM %u, expected %u", hal_eeprom[2 * INJ_INCR_RPM_MAPS_SIZE + 3], INJ_INCREMENT_THR_STD);
+
+	// Commit: the rpm edit is used, with its lookup table
+	INJmgr.calib_commit();
+	CHECK(INJ_calib_active->incrementi_rpm[2] == EDIT_RPM, "active rpm map %u after commit, expected %u", INJ_calib_active->incrementi_rpm[2], EDIT_RPM);
+	CHECK(INJmgr.interpolate_rpm_map(INJ_calib_active, 4136) == ((uint16_t)EDIT_RPM << 7), "active rpm lookup table does not match the committed edit");
+
+	if (errors){
+		printf("%u errors\n", errors);
+		return 1;
+	}
+	printf("OK\n");
+	return 0;
+
+}
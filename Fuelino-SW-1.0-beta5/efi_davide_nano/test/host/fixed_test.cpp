@@ -0,0 +1,133 @@
+// Davide Cavaliere
+// www.monocilindro.com
+// dadez87-at-gmail-com
+// Fixed-point test (host): each use of "Fixed.h" in the firmware is compared with the integer code it replaced (version 1.0 beta5), exhaustively where the operand ranges allow it,
+// then the generic operations (conversion, saturated addition, multiplication) are compared with a 64 bits reference. Old and new code are timed on the host
+
+#include <Arduino.h>
+#include <stdio.h>
+#include <time.h>
+#include "Fixed/Fixed.h"
+#include "INJmgr/INJmgr.h"
+
+#define RANDOM_SAMPLES 8000000UL // random samples for the 32 bits operand ranges
+#define MPU6050_SIG_FILT_CNST (int16_t)10000 // same as MPU6050mgr.cpp
+typedef Fixed<0, 15, true> q15_t; // same as MPU6050mgr.cpp
+typedef Fixed<1, 30, true> q30_t;
+
+static uint32_t errors = 0;
+#define CHECK(cond, ...) do{ if (!(cond)){ if (errors++ < 10) { printf("FAIL %s:%d: ", __FILE__, __LINE__); printf(__VA_ARGS__); printf("\n"); } } }while(0)
+
+static uint32_t lcg = 1;
+static uint32_t rnd32() { lcg = lcg * 1103515245u + 12345u; uint32_t h = lcg >> 16; lcg = lcg * 1103515245u + 12345u; return (h << 16) | (lcg >> 16); }
+
+static inline uint64_t now_ns(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// 1.0 beta5 code
+static uint16_t old_map_to_perc(uint8_t v) { return (uint16_t)v << 7; }
+static uint16_t old_thr_slope(uint8_t dy, uint16_t rem_x) { return (uint16_t)((uint32_t)rem_x * (uint32_t)dy); }
+static uint16_t old_extension(uint16_t inj, uint16_t perc) { return (uint16_t)(((uint32_t)inj * (uint32_t)perc) >> (16 - 3 + INJ_TS_SHIFT)); }
+static int16_t old_filter(int16_t sig_old, int16_t sig_new){
+	int32_t acc = 1 << 14;
+	acc += ((int32_t)sig_old * (int32_t)MPU6050_SIG_FILT_CNST);
+	acc += ((int32_t)sig_new * ((int32_t)32768 - (int32_t)MPU6050_SIG_FILT_CNST));
+	if ( acc > 0x3fffffff ) {
+		acc = 0x3fffffff;
+	} else if ( acc < -0x40000000 ) {
+		acc = -0x40000000;
+	}
+	return ((int16_t)(acc >> 15));
+}
+
+// Present code (INJmgr.cpp, MPU6050mgr.cpp)
+static uint16_t new_map_to_perc(uint8_t v) { return INJ_map_value_t::from_raw(v).to<INJ_perc_t>().raw; }
+static uint16_t new_thr_slope(uint8_t dy, uint16_t rem_x) { return INJ_map_value_t::from_raw(dy).mul<INJ_perc_t>(Fixed<0, 7>::from_raw((uint8_t)rem_x)).raw; }
+static uint16_t new_extension(uint16_t inj, uint16_t perc) { return fixed_mul_shr_u16<16 - 3 + INJ_TS_SHIFT>(inj, perc); }
+static int16_t new_filter(int16_t sig_old, int16_t sig_new){
+	int32_t acc = 1 << 14;
+	acc += fixed_mul_s16(sig_old, MPU6050_SIG_FILT_CNST);
+	acc += fixed_mul_su16(sig_new, (uint16_t)32768 - (uint16_t)MPU6050_SIG_FILT_CNST);
+	return q30_t::from_raw(acc).to_sat<q15_t>().raw;
+}
+
+// Generic operations of one format, against 64 bits arithmetic
+template <class F> static void check_format(const char* name){
+	int64_t max_raw = F::max_raw(), min_raw = F::min_raw();
+	for (uint32_t k=0; k<100000; k++){
+		int64_t a = min_raw + (int64_t)(rnd32() % (uint64_t)(max_raw - min_raw + 1));
+		int64_t b = min_raw + (int64_t)(rnd32() % (uint64_t)(max_raw - min_raw + 1));
+		F fa = F::from_raw((typename F::raw_t)a), fb = F::from_raw((typename F::raw_t)b);
+		int64_t sum = a + b, dif = a - b;
+		sum = (sum > max_raw) ? max_raw : ((sum < min_raw) ? min_raw : sum);
+		dif = (dif > max_raw) ? max_raw : ((dif < min_raw) ? min_raw : dif);
+		CHECK((int64_t)fa.add_sat(fb).raw == sum, "%s: %lld + %lld = %lld, expected %lld", name, (long long)a, (long long)b, (long long)fa.add_sat(fb).raw, (long long)sum);
+		CHECK((int64_t)fa.sub_sat(fb).raw == dif, "%s: %lld - %lld = %lld, expected %lld", name, (long long)a, (long long)b, (long long)fa.sub_sat(fb).raw, (long long)dif);
+		typedef Fixed<(int8_t)(F::BITS - F::FRAC - (F::IS_SIGNED ? 1 : 0)), (uint8_t)(F::FRAC - 1), F::IS_SIGNED> F_short; // one less fractional bit: value truncated, always in range
+		int64_t conv = (int64_t)fa.template to_sat<F_short>().raw;
+		CHECK(conv == (a >> 1), "%s: to_sat of %lld = %lld", name, (long long)a, (long long)conv);
+	}
+}
+
+int main(){
+
+	// Map value to increment: all the map values
+	for (uint16_t v=0; v<256; v++) CHECK(new_map_to_perc((uint8_t)v) == old_map_to_perc((uint8_t)v), "map to perc %u", v);
+
+	// Throttle map slope: all the slopes and positions
+	for (uint16_t dy=0; dy<256; dy++) for (uint16_t x=0; x<128; x++) CHECK(new_thr_slope((uint8_t)dy, x) == old_thr_slope((uint8_t)dy, x), "throttle slope %u x %u", dy, x);
+
+	// Extension time: all the injection times accepted by the injection range check, all the increments up to MAX_PERCENTAGE_INJ
+	for (uint32_t inj=(uint32_t)INJ_TIME_TICKS_MIN << INJ_TS_SHIFT; inj<=((uint32_t)INJ_TIME_TICKS_MAX << INJ_TS_SHIFT); inj+=(INJ_TS_SHIFT ? 7 : 1)){
+		for (uint32_t perc=0; perc<=MAX_PERCENTAGE_INJ; perc++){
+			CHECK(new_extension((uint16_t)inj, (uint16_t)perc) == old_extension((uint16_t)inj, (uint16_t)perc), "extension %u x %u", inj, perc);
+		}
+	}
+
+	// MPU6050 filter: saturation corners, then random signals
+	static const int16_t corners[] = {-32768, -32767, -16384, -1, 0, 1, 16383, 32766, 32767};
+	for (uint8_t i=0; i<sizeof(corners)/sizeof(corners[0]); i++) for (uint8_t j=0; j<sizeof(corners)/sizeof(corners[0]); j++){
+		CHECK(new_filter(corners[i], corners[j]) == old_filter(corners[i], corners[j]), "filter %d, %d", corners[i], corners[j]);
+	}
+	for (uint32_t k=0; k<RANDOM_SAMPLES; k++){
+		uint32_t r = rnd32();
+		CHECK(new_filter((int16_t)r, (int16_t)(r >> 16)) == old_filter((int16_t)r, (int16_t)(r >> 16)), "filter %d, %d", (int16_t)r, (int16_t)(r >> 16));
+	}
+
+	// Generic operations
+	check_format<INJ_perc_t>("Fixed<0, 16>");
+	check_format<INJ_map_value_t>("Fixed<-1, 9>");
+	check_format<q15_t>("Fixed<0, 15, true>");
+	check_format<q30_t>("Fixed<1, 30, true>");
+	typedef Fixed<0, 16> u16_t;
+	for (uint32_t k=0; k<RANDOM_SAMPLES; k++){ // 16 x 16 bits multiplications
+		uint32_t r = rnd32();
+		int64_t exact_u = ((int64_t)(uint16_t)r * (int64_t)(uint16_t)(r >> 16)) >> 16; // Fixed<0, 16> x Fixed<0, 16> -> Fixed<0, 16>
+		CHECK(u16_t::from_raw((uint16_t)r).mul<u16_t>(u16_t::from_raw((uint16_t)(r >> 16))).raw == exact_u, "mul u16 %u", r);
+		int64_t exact_s = ((int64_t)(int16_t)r * (int64_t)(int16_t)(r >> 16)) >> 15; // Q15 x Q15 -> Q15, saturated (only -1 x -1 saturates)
+		if (exact_s > 32767) exact_s = 32767;
+		CHECK(q15_t::from_raw((int16_t)r).mul_sat<q15_t>(q15_t::from_raw((int16_t)(r >> 16))).raw == exact_s, "mul_sat q15 %u", r);
+	}
+	CHECK(q15_t::from_raw(-32768).mul_sat<q15_t>(q15_t::from_raw(-32768)).raw == 32767, "mul_sat q15 -1 x -1");
+	printf("Fixed: injection and filter code bit exact with version 1.0 beta5, generic operations exact\n");
+
+	// Timing (host ns per call, old and new code on the same operands). On the AVR, both use the same 16 x 16 -> 32 bits products
+	volatile uint32_t sink = 0;
+	uint64_t t0 = now_ns();
+	for (uint32_t k=0; k<RANDOM_SAMPLES; k++) sink += old_filter((int16_t)k, (int16_t)(k * 7)) + old_extension((uint16_t)k, (uint16_t)(k >> 8));
+	uint64_t t1 = now_ns();
+	for (uint32_t k=0; k<RANDOM_SAMPLES; k++) sink += new_filter((int16_t)k, (int16_t)(k * 7)) + new_extension((uint16_t)k, (uint16_t)(k >> 8));
+	uint64_t t2 = now_ns();
+	printf("host time per filter + extension: 1.0 beta5 code %.2f ns, Fixed %.2f ns\n", (double)(t1 - t0) / RANDOM_SAMPLES, (double)(t2 - t1) / RANDOM_SAMPLES);
+
+	if (errors){
+		printf("%u errors\n", errors);
+		return 1;
+	}
+	printf("OK\n");
+	return 0;
+
+}
@@ -0,0 +1,194 @@
+// Davide Cavaliere
+// www.monocilindro.com
+// dadez87-at-gmail-com
+// Host HAL shim: Arduino core and ATmega 328p registers, to compile the firmware modules on Linux (test/host)
+// Registers are a 256 bytes memory, at the same data addresses as on the ATmega 328p. Each write can be observed by a hook (see "hal.h"), so the tests can time stamp the pin and timer changes made by the ISRs
+
+#ifndef HAL_Arduino_h
+#define HAL_Arduino_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+
+// One 8 bits register (operands are "int", as after the C integer promotions: "REG &= ~_BV(bit)" is a valid 8 bits write). Each write calls the hook "hal_write_hook" (if any). Interrupt flag registers are cleared writing 1, as on the AVR
+struct hal_reg8{
+	volatile uint8_t value;
+	operator uint8_t() const { return value; }
+	hal_reg8& operator=(int v) { write((uint8_t)(v)); return *this; }
+	hal_reg8& operator|=(int v) { write((uint8_t)(value | v)); return *this; }
+	hal_reg8& operator&=(int v) { write((uint8_t)(value & v)); return *this; }
+	hal_reg8& operator^=(int v) { write((uint8_t)(value ^ v)); return *this; }
+	void write(uint8_t v);
+};
+extern hal_reg8 hal_mem[256]; // data memory 0x00 - 0xFF: I/O registers and extended I/O registers
+
+// One 16 bits register (2 consecutive 8 bits registers, low byte first). High byte is written first, as the AVR temporary register requires
+struct hal_reg16{
+	uint8_t addr;
+	operator uint16_t() const { return (uint16_t)(hal_mem[addr].value | ((uint16_t)hal_mem[addr + 1].value << 8)); }
+	const hal_reg16& operator=(uint16_t v) const { hal_mem[addr + 1].write((uint8_t)(v >> 8)); hal_mem[addr].write((uint8_t)v); return *this; }
+};
+
+#define _SFR_MEM8(a) (hal_mem[(a)])
+#define _SFR_MEM16(a) (hal_reg16{(uint8_t)(a)})
+#define _SFR_IO8(a) _SFR_MEM8((a) + 0x20)
+#define _BV(b) (1 << (b))
+
+// ATmega 328p registers (data memory addresses)
+#define PINB _SFR_MEM8(0x23)
+#define DDRB _SFR_MEM8(0x24)
+#define PORTB _SFR_MEM8(0x25)
+#define PINC _SFR_MEM8(0x26)
+#define DDRC _SFR_MEM8(0x27)
+#define PORTC _SFR_MEM8(0x28)
+#define PIND _SFR_MEM8(0x29)
+#define DDRD _SFR_MEM8(0x2A)
+#define PORTD _SFR_MEM8(0x2B)
+#define TIFR0 _SFR_MEM8(0x35)
+#define TIFR1 _SFR_MEM8(0x36)
+#define TIFR2 _SFR_MEM8(0x37)
+#define PCIFR _SFR_MEM8(0x3B)
+#define EIFR _SFR_MEM8(0x3C)
+#define EIMSK _SFR_MEM8(0x3D)
+#define TCCR0A _SFR_MEM8(0x44)
+#define TCCR0B _SFR_MEM8(0x45)
+#define TCNT0 _SFR_MEM8(0x46)
+#define OCR0A _SFR_MEM8(0x47)
+#define OCR0B _SFR_MEM8(0x48)
+#define MCUSR _SFR_MEM8(0x54)
+#define SREG _SFR_MEM8(0x5F)
+#define WDTCSR _SFR_MEM8(0x60)
+#define PCICR _SFR_MEM8(0x68)
+#define EICRA _SFR_MEM8(0x69)
+#define PCMSK0 _SFR_MEM8(0x6B)
+#define PCMSK1 _SFR_MEM8(0x6C)
+#define PCMSK2 _SFR_MEM8(0x6D)
+#define TIMSK0 _SFR_MEM8(0x6E)
+#define TIMSK1 _SFR_MEM8(0x6F)
+#define TIMSK2 _SFR_MEM8(0x70)
+#define ADC _SFR_MEM16(0x78)
+#define ADCL _SFR_MEM8(0x78)
+#define ADCH _SFR_MEM8(0x79)
+#define ADCSRA _SFR_MEM8(0x7A)
+#define ADCSRB _SFR_MEM8(0x7B)
+#define ADMUX _SFR_MEM8(0x7C)
+#define DIDR0 _SFR_MEM8(0x7E)
+#define TCCR1A _SFR_MEM8(0x80)
+#define TCCR1B _SFR_MEM8(0x81)
+#define TCCR1C _SFR_MEM8(0x82)
+#define TCNT1 _SFR_MEM16(0x84)
+#define ICR1 _SFR_MEM16(0x86)
+#define OCR1A _SFR_MEM16(0x88)
+#define OCR1B _SFR_MEM16(0x8A)
+#define TCCR2A _SFR_MEM8(0xB0)
+#define TCCR2B _SFR_MEM8(0xB1)
+#define TCNT2 _SFR_MEM8(0xB2)
+#define OCR2A _SFR_MEM8(0xB3)
+#define OCR2B _SFR_MEM8(0xB4)
+
+// Register bits
+enum{
+	PORTB0 = 0, PORTB1, PORTB2, PORTB3, PORTB4, PORTB5,
+	PORTD0 = 0, PORTD1, PORTD2, PORTD3, PORTD4, PORTD5, PORTD6, PORTD7,
+	PB0 = 0, PB1, PB2, PB3, PB4, PB5,
+	PD0 = 0, PD1, PD2, PD3, PD4, PD5, PD6, PD7,
+	TOV0 = 0, OCF0A = 1, OCF0B = 2,
+	TOV1 = 0, OCF1A = 1, OCF1B = 2, ICF1 = 5,
+	TOV2 = 0, OCF2A = 1, OCF2B = 2,
+	TOIE0 = 0, OCIE0A = 1, OCIE0B = 2,
+	TOIE1 = 0, OCIE1A = 1, OCIE1B = 2, ICIE1 = 5,
+	TOIE2 = 0, OCIE2A = 1, OCIE2B = 2,
+	CS10 = 0, CS11 = 1, CS12 = 2, WGM12 = 3, WGM13 = 4, ICES1 = 6, ICNC1 = 7,
+	CS20 = 0, CS21 = 1, CS22 = 2, WGM20 = 0, WGM21 = 1,
+	PCIE0 = 0, PCIE1 = 1, PCIE2 = 2, PCIF0 = 0, PCIF1 = 1, PCIF2 = 2,
+	PCINT16 = 0, PCINT17, PCINT18, PCINT19, PCINT20, PCINT21, PCINT22, PCINT23,
+	INT0 = 0, INT1 = 1, INTF0 = 0, INTF1 = 1, ISC00 = 0, ISC01 = 1, ISC10 = 2, ISC11 = 3,
+	ADPS0 = 0, ADPS1 = 1, ADPS2 = 2, ADIE = 3, ADIF = 4, ADATE = 5, ADSC = 6, ADEN = 7,
+	ADTS0 = 0, ADTS1 = 1, ADTS2 = 2,
+	MUX0 = 0, ADLAR = 5, REFS0 = 6, REFS1 = 7,
+	WDP0 = 0, WDP1 = 1, WDP2 = 2, WDE = 3, WDCE = 4, WDP3 = 5, WDIE = 6, WDIF = 7,
+	WDRF = 3
+};
+
+// Interrupts: an ISR is a plain function, called by the tests
+#define ISR(vector) extern "C" void vector(void)
+#define cli() (SREG &= (uint8_t)~0x80)
+#define sei() (SREG |= 0x80)
+
+// Program memory is plain memory
+#define PROGMEM
+#define pgm_read_byte(p) (*(const uint8_t*)(p))
+#define pgm_read_word(p) (*(const uint16_t*)(p))
+
+// Arduino core
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+enum { A0 = 14, A1, A2, A3, A4, A5, A6, A7 };
+typedef uint8_t byte;
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+// Strings (fixed size buffer, enough for the firmware messages)
+class __FlashStringHelper;
+#define F(s) ((const __FlashStringHelper*)(s))
+class String{
+	public:
+		String(const char* s = "");
+		String(const __FlashStringHelper* s) : String((const char*)s) {}
+		String& operator+=(const String& s) { return append(s.buf); }
+		String& operator+=(const char* s) { return append(s); }
+		String& operator+=(const __FlashStringHelper* s) { return append((const char*)s); }
+		String& operator+=(char c);
+		String& operator+=(unsigned char n) { return append_number(n); }
+		String& operator+=(int n) { return append_number(n); }
+		String& operator+=(unsigned int n) { return append_number(n); }
+		String& operator+=(long n) { return append_number(n); }
+		String& operator+=(unsigned long n) { return append_number((long)n); }
+		const char* c_str() const { return buf; }
+		unsigned int length() const { return (unsigned int)strlen(buf); }
+		void toCharArray(char* dst, unsigned int size) const;
+	private:
+		String& append(const char* s);
+		String& append_number(long n);
+		char buf[128];
+};
+
+// Print (base of the display driver) and Serial
+class Print{
+	public:
+		virtual ~Print() {}
+		virtual size_t write(uint8_t c) = 0;
+		virtual size_t write(const uint8_t* data, size_t size);
+		size_t write(char c) { return write((uint8_t)c); }
+		size_t print(const char* s) { return write((const uint8_t*)s, strlen(s)); }
+		size_t print(const String& s) { return print(s.c_str()); }
+		size_t print(const __FlashStringHelper* s) { return print((const char*)s); }
+		size_t print(long n);
+		size_t print(int n) { return print((long)n); }
+		size_t print(unsigned int n) { return print((long)n); }
+		size_t print(unsigned long n) { return print((long)n); }
+		template<class T> size_t println(T v) { size_t n = print(v); return n + print("\r\n"); }
+};
+class HardwareSerial : public Print{
+	public:
+		void begin(unsigned long baud) { (void)baud; }
+		int available();
+		int read();
+		size_t write(uint8_t c);
+		using Print::write;
+};
+extern HardwareSerial Serial;
+
+#include "hal.h"
+
+#endif
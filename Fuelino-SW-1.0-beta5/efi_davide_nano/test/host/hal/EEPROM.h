@@ -0,0 +1,15 @@
+// Host HAL shim: EEPROM library, backed by "hal_eeprom"
+
+#ifndef HAL_EEPROM_h
+#define HAL_EEPROM_h
+
+#include <Arduino.h>
+
+struct EEPROMClass{
+	uint8_t read(int addr) { return hal_eeprom[addr & 0x3FF]; }
+	void write(int addr, uint8_t value) { hal_eeprom[addr & 0x3FF] = value; }
+	void update(int addr, uint8_t value) { write(addr, value); }
+};
+extern EEPROMClass EEPROM;
+
+#endif
@@ -0,0 +1,2 @@
+// Host HAL shim: "Print" is defined in "Arduino.h"
+#include <Arduino.h>
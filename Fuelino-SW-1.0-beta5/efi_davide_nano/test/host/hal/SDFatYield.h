@@ -0,0 +1,73 @@
+// Host HAL shim: SDFatYield library (SdFat). No card is inserted on the host: "SdFat::begin()" fails, so the logger keeps retrying as on a board without SD card
+
+#ifndef HAL_SDFatYield_h
+#define HAL_SDFatYield_h
+
+#include <Arduino.h>
+
+#define FAT_DATE(year, month, day) (uint16_t)((((year) - 1980) << 9) | ((month) << 5) | (day))
+#define FAT_TIME(hour, minute, second) (uint16_t)(((hour) << 11) | ((minute) << 5) | ((second) >> 1))
+#define SPI_FULL_SPEED 2
+#define SPI_HALF_SPEED 4
+#define O_READ 0x01
+#define O_WRITE 0x02
+#define O_RDWR 0x03
+#define O_APPEND 0x04
+#define O_CREAT 0x10
+#define O_EXCL 0x20
+#define FILE_WRITE (O_RDWR | O_CREAT | O_APPEND)
+
+typedef union{ uint8_t data[512]; } cache_t;
+
+class SdSpiCard{
+	public:
+		bool writeStart(uint32_t block, uint32_t count) { (void)block; (void)count; return false; }
+		bool writeData(const uint8_t* src) { (void)src; return false; }
+		bool writeStop() { return false; }
+};
+
+class FatVolume{
+	public:
+		cache_t* cacheClear() { return &cache; }
+	private:
+		cache_t cache;
+};
+
+class FatFile{
+	public:
+		bool open(FatFile* dir, const char* path, uint8_t oflag) { (void)dir; (void)path; (void)oflag; return false; }
+		bool createContiguous(FatFile* dir, const char* path, uint32_t size) { (void)dir; (void)path; (void)size; return false; }
+		bool contiguousRange(uint32_t* first, uint32_t* last) { (void)first; (void)last; return false; }
+		bool truncate(uint32_t length) { (void)length; return false; }
+		bool sync() { return false; }
+		bool close() { return true; }
+		bool isOpen() const { return false; }
+		uint32_t fileSize() const { return 0; }
+		int write(const void* data, size_t size) { (void)data; (void)size; return -1; }
+		static void dateTimeCallback(void (*callback)(uint16_t* date, uint16_t* time)) { (void)callback; }
+};
+
+class SdFile : public FatFile{};
+
+class File : public FatFile{
+	public:
+		operator bool() const { return isOpen(); }
+};
+
+class SdFat{
+	public:
+		bool begin(uint8_t cs_pin, uint8_t spi_divisor) { (void)cs_pin; (void)spi_divisor; return false; }
+		File open(const char* path, uint8_t mode) { (void)path; (void)mode; return File(); }
+		File open(const String& path, uint8_t mode) { return open(path.c_str(), mode); }
+		bool exists(const char* path) { (void)path; return false; }
+		bool remove(const char* path) { (void)path; return false; }
+		SdSpiCard* card() { return &spi_card; }
+		FatVolume* vol() { return &volume; }
+		FatFile* vwd() { return &root; }
+	private:
+		SdSpiCard spi_card;
+		FatVolume volume;
+		FatFile root;
+};
+
+#endif
@@ -0,0 +1,21 @@
+// Host HAL shim: Wire library (I2C). No device answers on the host bus: transmissions end with NACK, reads return no bytes
+
+#ifndef HAL_Wire_h
+#define HAL_Wire_h
+
+#include <Arduino.h>
+
+struct TwoWire{
+	void begin() {}
+	void setClock(long clock) { (void)clock; }
+	void beginTransmission(uint8_t addr) { (void)addr; }
+	uint8_t endTransmission(bool stop = true) { (void)stop; return 2; } // 2: address NACK
+	uint8_t requestFrom(int addr, int size, bool stop = true) { (void)addr; (void)size; (void)stop; return 0; }
+	size_t write(uint8_t data) { (void)data; return 1; }
+	size_t write(const uint8_t* data, size_t size) { (void)data; return size; }
+	int available() { return 0; }
+	int read() { return -1; }
+};
+extern TwoWire Wire;
+
+#endif
@@ -0,0 +1,2 @@
+// Host HAL shim: registers, interrupts and program memory are defined in "Arduino.h"
+#include <Arduino.h>
@@ -0,0 +1,4 @@
+// Host HAL shim: watchdog (no reset on the host, WDTCSR is a plain register)
+#include <Arduino.h>
+#define wdt_reset() do{}while(0)
+#define wdt_disable() (WDTCSR = 0)
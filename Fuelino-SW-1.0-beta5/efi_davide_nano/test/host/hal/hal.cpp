@@ -0,0 +1,227 @@
+// Davide Cavaliere
+// www.monocilindro.com
+// dadez87-at-gmail-com
+// Host HAL shim: definitions of the Arduino core, libraries and registers used by the firmware modules
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <Wire.h>
+#include <stdio.h>
+
+hal_reg8 hal_mem[256]; // registers, all zeros at reset
+hal_write_hook_t hal_write_hook = 0; // no observer
+uint8_t hal_eeprom[1024];
+volatile unsigned long timer0_overflow_count = 0; // Arduino core (wiring.c), read by "INJmgr.Timer0_tick_counts()"
+HardwareSerial Serial;
+EEPROMClass EEPROM;
+TwoWire Wire;
+
+static uint64_t hal_time_ticks = 0; // simulated time, Timer1 ticks (0.5us)
+static uint8_t hal_serial_in[256]; // Serial input ring
+static uint8_t hal_serial_in_head = 0;
+static uint8_t hal_serial_in_tail = 0;
+static uint8_t hal_serial_out[1024]; // Serial output, since the last "hal_serial_output()"
+static uint16_t hal_serial_out_size = 0;
+
+// EEPROM is erased (0xFF) before the firmware runs
+static struct hal_eeprom_init_struct{ hal_eeprom_init_struct() { memset(hal_eeprom, 0xFF, sizeof(hal_eeprom)); } } hal_eeprom_init;
+
+
+// REGISTERS
+
+// Interrupt flags of each register: cleared writing 1, unchanged writing 0
+static uint8_t hal_flags_mask(uint8_t addr){
+	switch (addr){
+		case 0x35: return 0x07; // TIFR0: TOV0, OCF0A, OCF0B
+		case 0x36: return 0x27; // TIFR1: TOV1, OCF1A, OCF1B, ICF1
+		case 0x37: return 0x07; // TIFR2: TOV2, OCF2A, OCF2B
+		case 0x3B: return 0x07; // PCIFR: PCIF0, PCIF1, PCIF2
+		case 0x3C: return 0x03; // EIFR: INTF0, INTF1
+		case 0x60: return 0x80; // WDTCSR: WDIF
+		case 0x7A: return 0x10; // ADCSRA: ADIF
+		default: return 0x00;
+	}
+}
+
+void hal_reg8::write(uint8_t v){
+	uint8_t addr = (uint8_t)(this - hal_mem);
+	uint8_t old_value = value;
+	uint8_t flags = hal_flags_mask(addr);
+	value = (uint8_t)((v & (uint8_t)~flags) | (old_value & flags & (uint8_t)~v));
+	if ((addr == 0x7A) && (value & _BV(ADSC))) value = (uint8_t)((value & (uint8_t)~_BV(ADSC)) | _BV(ADIF)); // ADCSRA: the conversion ends immediately (the tests write ADC and call the ADC ISR)
+	if (hal_write_hook) hal_write_hook(addr, old_value, value);
+	if ((addr >= 0x24) && (addr <= 0x2B) && ((addr % 3) != 2)){ // DDRx, PORTx: PINx reads the output pins as they are driven (input pins are written by the tests). After the hook: not part of the measured write
+		uint8_t pin_addr = (uint8_t)(addr - ((addr % 3) == 0 ? 1 : 2)); // PINB 0x23, PINC 0x26, PIND 0x29
+		uint8_t ddr = hal_mem[pin_addr + 1].value;
+		hal_mem[pin_addr].value = (uint8_t)((hal_mem[pin_addr].value & (uint8_t)~ddr) | (hal_mem[pin_addr + 2].value & ddr));
+	}
+}
+
+
+// TIME
+
+void hal_time_set(uint64_t ticks){
+	hal_time_ticks = ticks; // registers are written without calling the hook (the timers count by themselves)
+	hal_mem[0x84].value = (uint8_t)ticks; // TCNT1L
+	hal_mem[0x85].value = (uint8_t)(ticks >> 8); // TCNT1H
+	hal_mem[0x46].value = (uint8_t)(ticks >> 3); // TCNT0: 1 tick = 4us
+	timer0_overflow_count = (unsigned long)(ticks >> 11); // Timer0 overflows each 1024us
+}
+
+uint64_t hal_time_get(){
+	return hal_time_ticks;
+}
+
+unsigned long millis(){
+	return (unsigned long)(hal_time_ticks / 2000);
+}
+
+unsigned long micros(){
+	return (unsigned long)(hal_time_ticks / 2);
+}
+
+// Delays move the simulated time forward (nothing else runs meanwhile)
+void delay(unsigned long ms){
+	hal_time_set(hal_time_ticks + (uint64_t)ms * 2000);
+}
+
+void delayMicroseconds(unsigned int us){
+	hal_time_set(hal_time_ticks + (uint64_t)us * 2);
+}
+
+
+// DIGITAL PINS (Arduino pin numbers: 0-7 Port D, 8-13 Port B, 14-19 Port C)
+
+static uint8_t hal_pin_port(uint8_t pin){
+	if (pin < 8) return 0x29; // PIND
+	if (pin < 14) return 0x23; // PINB
+	return 0x26; // PINC
+}
+
+static uint8_t hal_pin_mask(uint8_t pin){
+	if (pin < 8) return (uint8_t)(1 << pin);
+	if (pin < 14) return (uint8_t)(1 << (pin - 8));
+	return (uint8_t)(1 << (pin - 14));
+}
+
+void pinMode(uint8_t pin, uint8_t mode){
+	uint8_t port = hal_pin_port(pin);
+	uint8_t mask = hal_pin_mask(pin);
+	if (mode == OUTPUT){
+		hal_mem[port + 1] |= mask; // DDRx
+	}else{
+		hal_mem[port + 1] &= (uint8_t)~mask;
+		if (mode == INPUT_PULLUP) hal_mem[port + 2] |= mask; else hal_mem[port + 2] &= (uint8_t)~mask; // PORTx
+	}
+}
+
+// "digitalWrite" and "digitalRead" follow the Arduino core (wiring_digital.c): pin tables, PWM output turned OFF, interrupts disabled during the port write.
+// Their cost is then comparable with the one of the core, when they are benchmarked against direct port access
+#define HAL_PINS_NUM 20
+#define HAL_NOT_ON_TIMER 0
+static const uint8_t hal_pin_to_port[HAL_PINS_NUM] = {0x29, 0x29, 0x29, 0x29, 0x29, 0x29, 0x29, 0x29, 0x23, 0x23, 0x23, 0x23, 0x23, 0x23, 0x26, 0x26, 0x26, 0x26, 0x26, 0x26}; // PINx
+static const uint8_t hal_pin_to_bit_mask[HAL_PINS_NUM] = {0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x01, 0x02, 0x04, 0x08, 0x10, 0x20};
+static const uint8_t hal_pin_to_timer[HAL_PINS_NUM] = {0, 0, 0, 0x22, 0, 0x02, 0x01, 0, 0, 0x11, 0x12, 0x21, 0, 0, 0, 0, 0, 0, 0, 0}; // PWM output: timer (high nibble: 0 - 2) and channel (low nibble: 1 = A, 2 = B). 0: no PWM
+
+static void hal_turn_off_pwm(uint8_t timer){
+	static const uint8_t tccra[3] = {0x44, 0x80, 0xB0}; // TCCR0A, TCCR1A, TCCR2A
+	uint8_t reg = tccra[(timer >> 4) & 0x03];
+	hal_mem[reg] &= (uint8_t)~(((timer & 0x0F) == 1) ? _BV(7) : _BV(5)); // COMxA1 or COMxB1
+}
+
+void digitalWrite(uint8_t pin, uint8_t value){
+	if (pin >= HAL_PINS_NUM) return;
+	uint8_t timer = pgm_read_byte(&hal_pin_to_timer[pin]);
+	uint8_t mask = pgm_read_byte(&hal_pin_to_bit_mask[pin]);
+	uint8_t port = pgm_read_byte(&hal_pin_to_port[pin]);
+	if (timer != HAL_NOT_ON_TIMER) hal_turn_off_pwm(timer);
+	uint8_t oldSREG = SREG;
+	cli();
+	if (value) hal_mem[port + 2] |= mask; else hal_mem[port + 2] &= (uint8_t)~mask; // PORTx
+	SREG = oldSREG;
+}
+
+int digitalRead(uint8_t pin){
+	if (pin >= HAL_PINS_NUM) return LOW;
+	uint8_t timer = pgm_read_byte(&hal_pin_to_timer[pin]);
+	uint8_t mask = pgm_read_byte(&hal_pin_to_bit_mask[pin]);
+	uint8_t port = pgm_read_byte(&hal_pin_to_port[pin]);
+	if (timer != HAL_NOT_ON_TIMER) hal_turn_off_pwm(timer);
+	return (hal_mem[port] & mask) ? HIGH : LOW;
+}
+
+
+// STRING
+
+String::String(const char* s){
+	buf[0] = 0;
+	append(s);
+}
+
+String& String::append(const char* s){
+	size_t len = strlen(buf);
+	size_t add = strlen(s);
+	if (len + add >= sizeof(buf)) add = sizeof(buf) - 1 - len; // truncated
+	memcpy(buf + len, s, add);
+	buf[len + add] = 0;
+	return *this;
+}
+
+String& String::append_number(long n){
+	char tmp[24];
+	snprintf(tmp, sizeof(tmp), "%ld", n);
+	return append(tmp);
+}
+
+String& String::operator+=(char c){
+	char tmp[2] = {c, 0};
+	return append(tmp);
+}
+
+void String::toCharArray(char* dst, unsigned int size) const{
+	if (size == 0) return;
+	strncpy(dst, buf, size - 1);
+	dst[size - 1] = 0;
+}
+
+
+// PRINT AND SERIAL
+
+size_t Print::write(const uint8_t* data, size_t size){
+	size_t n = 0;
+	while (size--) n += write(*data++);
+	return n;
+}
+
+size_t Print::print(long n){
+	char tmp[24];
+	snprintf(tmp, sizeof(tmp), "%ld", n);
+	return print(tmp);
+}
+
+int HardwareSerial::available(){
+	return (uint8_t)(hal_serial_in_head - hal_serial_in_tail);
+}
+
+int HardwareSerial::read(){
+	if (hal_serial_in_head == hal_serial_in_tail) return -1;
+	return hal_serial_in[hal_serial_in_tail++];
+}
+
+size_t HardwareSerial::write(uint8_t c){
+	if (hal_serial_out_size >= sizeof(hal_serial_out)) return 0; // full: byte lost
+	hal_serial_out[hal_serial_out_size++] = c;
+	return 1;
+}
+
+void hal_serial_input(const uint8_t* data, uint16_t size){
+	while (size--) hal_serial_in[hal_serial_in_head++] = *data++;
+}
+
+uint16_t hal_serial_output(uint8_t* data, uint16_t size_max){
+	uint16_t n = (hal_serial_out_size < size_max) ? hal_serial_out_size : size_max;
+	memcpy(data, hal_serial_out, n);
+	memmove(hal_serial_out, hal_serial_out + n, hal_serial_out_size - n);
+	hal_serial_out_size -= n;
+	return n;
+}
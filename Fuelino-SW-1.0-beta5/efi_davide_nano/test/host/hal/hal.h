@@ -0,0 +1,29 @@
+// Davide Cavaliere
+// www.monocilindro.com
+// dadez87-at-gmail-com
+// Host HAL shim: simulated time and register observation, used by the host tests and benchmarks (not by the firmware modules)
+
+#ifndef HAL_h
+#define HAL_h
+
+#include <stdint.h>
+
+// Called after each register write: data address, old value, new value
+typedef void (*hal_write_hook_t)(uint8_t addr, uint8_t old_value, uint8_t new_value);
+extern hal_write_hook_t hal_write_hook;
+
+// Peripherals are not simulated: registers keep the values written by the firmware. Exceptions: interrupt flags are cleared writing 1, and an ADC conversion ends as soon as it is started (ADSC reads 0, ADIF is set)
+
+// Simulated time, in Timer1 ticks (0.5us, 16MHz / 8) since reset. "hal_time_set" updates TCNT0, TCNT1 and the Timer0 overflow counter of the Arduino core (millis, micros),
+// as if Timer0 (/64) and Timer1 (/8) were running from reset. It does not call the overflow ISRs: the tests call them, when needed
+void hal_time_set(uint64_t ticks);
+uint64_t hal_time_get();
+
+// Serial input (bytes returned by "Serial.read()") and output (bytes written by "Serial.write()")
+void hal_serial_input(const uint8_t* data, uint16_t size);
+uint16_t hal_serial_output(uint8_t* data, uint16_t size_max); // moves the bytes written since the last call (up to size_max)
+
+// EEPROM contents (1024 bytes, 0xFF after reset as on a new chip)
+extern uint8_t hal_eeprom[1024];
+
+#endif
@@ -0,0 +1,496 @@
+// Davide Cavaliere
+// www.monocilindro.com
+// dadez87-at-gmail-com
+// Injector ISR latency benchmark (host): the real INJmgr, Tempo and ADCmgr sources are driven with synthetic injector edge trains.
+// For each edge, ISR(PCINT2_vect) is called at the simulated edge time, and host time stamps are taken at the ISR entry, at the injector output write (ON edge),
+// and at the Timer1 compare channel arming (OFF edge, extension start). Timer1 compare, Timer1 overflow and watchdog ISRs, and the Main Loop tasks of INJmgr, run at their simulated times.
+// Results are host nanoseconds: they compare two versions of the injection path on the same machine, they are not AVR cycles (trace pins and "d 2 x n" statistics measure the board)
+// Engine Data snapshot test: "read_engine_snapshot" runs in a loop (Main Loop), and the injector edges are driven by a host timer signal, which interrupts the copy at any point, as the injection interrupts do.
+// Counted: reader retries, updates lost by the writer (dropped), incoherent copies. The test fails if an update is dropped or a copy is incoherent
+// Safety watchdog test: a long ECU command (cranking, prime pulse) must be followed, a missing OFF edge and a stuck input must turn the injector OFF, and the aborted injection must be published
+// Usage: inj_isr_bench [RESULT_FILE [REFERENCE_FILE]]. The p50 and p99 of each scenario are written in RESULT_FILE, and compared with the ones of REFERENCE_FILE (another build, example: single injector and twin).
+// A FastPin build (INJ_OUT_FASTPIN = 1) compared with a "digitalWrite" build of the same injectors must have a lower edge to output latency (sum of the p50 of all the scenarios), or the benchmark fails
+
+#include <Arduino.h>
+#include <stdio.h>
+#include <time.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <algorithm>
+#include <vector>
+#include "INJmgr/INJmgr.h"
+#include "INJmgr/Tempo/Tempo.h"
+#include "EEPROMmgr/EEPROMmgr.h"
+#include "ISRmgr/ISRmgr.h"
+#include "ADCmgr/ADCmgr.h"
+
+extern "C" void PCINT2_vect(void);
+extern "C" void TIMER1_COMPA_vect(void);
+extern "C" void TIMER1_COMPB_vect(void);
+extern "C" void TIMER1_OVF_vect(void);
+#if INJ_SAFETY_WDT_ENABLE
+extern "C" void WDT_vect(void);
+#endif
+
+#define BENCH_WARMUP_TICKS 6000000ULL // 3s of simulated time before measuring: cranking filter, then steady state (engine running)
+#define BENCH_INJECTIONS 20000 // measured injections per scenario
+#define BENCH_LOOP_TICKS ((uint64_t)LOOP_MIN_EXEC_TIME * 2000) // Main Loop period (Timer1 ticks)
+#define BENCH_WDT_TICKS 32000ULL // watchdog period: 16ms
+#define SNAPSHOT_RPM 12000 // Engine Data snapshot test: engine speed
+#define SNAPSHOT_INJ_US 1500 // Engine Data snapshot test: injection time
+#define SNAPSHOT_INJECTIONS 3000 // Engine Data snapshot test: injections per injector, after the warm up
+#define SNAPSHOT_SIGNAL_US 20 // Engine Data snapshot test: host timer period (one injector edge per signal)
+
+extern volatile uint16_t ADCmgr_measures[]; // ADCmgr.cpp (no ADC interrupt in this benchmark: values are written here)
+extern volatile INJ_engine_snapshot_struct INJ_engine_snapshot; // INJmgr.cpp
+extern volatile uint8_t INJ_engine_snapshot_seq; // INJmgr.cpp
+
+// Host clock (ns)
+static inline uint64_t now_ns(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// Injector output pins: data address of the PORTx register, and bit mask (same mapping as FastPin_arduino)
+static uint8_t port_addr(uint8_t pin) { return (pin < 8) ? 0x2B : ((pin < 14) ? 0x25 : 0x28); }
+static uint8_t pin_mask(uint8_t pin) { return (uint8_t)(1 << ((pin < 8) ? pin : ((pin < 14) ? (pin - 8) : (pin - 14)))); }
+static const uint8_t out_pins[INJ_CHANNELS_NUM] = {OUT_INJ_PIN
+#if INJ_CHANNELS_NUM == 2
+	, OUT_INJ_2_PIN
+#endif
+};
+static const uint8_t in_pins[INJ_CHANNELS_NUM] = {IN_INJ_PIN
+#if INJ_CHANNELS_NUM == 2
+	, IN_INJ_2_PIN
+#endif
+};
+
+// Time stamps taken by the register write hook during one ISR call
+static uint64_t hook_out_high_ns[INJ_CHANNELS_NUM]; // injector output set HIGH
+static uint64_t hook_armed_ns[INJ_CHANNELS_NUM]; // Timer1 compare channel interrupt enabled
+static void bench_write_hook(uint8_t addr, uint8_t old_value, uint8_t new_value){
+	uint8_t rising = (uint8_t)(new_value & ~old_value);
+	if (!rising) return;
+	for (uint8_t ch=0; ch<INJ_CHANNELS_NUM; ch++){
+		if ((addr == port_addr(out_pins[ch])) && (rising & pin_mask(out_pins[ch])) && !hook_out_high_ns[ch]) hook_out_high_ns[ch] = now_ns();
+		if ((addr == 0x6F) && (rising & (ch ? _BV(OCIE1B) : _BV(OCIE1A))) && !hook_armed_ns[ch]) hook_armed_ns[ch] = now_ns(); // TIMSK1
+	}
+}
+
+// Distribution of one measured quantity (ns)
+struct Dist{
+	std::vector<uint64_t> v;
+	void add(uint64_t x) { v.push_back(x); }
+	void print(const char* name, uint64_t offset, uint64_t* p50, uint64_t* p99){
+		*p50 = *p99 = 0;
+		if (v.empty()){ printf("  %-19s (no samples)\n", name); return; }
+		std::sort(v.begin(), v.end());
+		for (uint64_t& x : v) x = (x > offset) ? (x - offset) : 0;
+		*p50 = v[v.size() / 2];
+		*p99 = v[(v.size() * 99) / 100];
+		printf("  %-19s n=%-6zu min %5llu  p50 %5llu  p99 %5llu  max %6llu ns\n", name, v.size(), (unsigned long long)v.front(), (unsigned long long)*p50,
+			(unsigned long long)*p99, (unsigned long long)v.back());
+	}
+};
+
+// Results of one scenario: p50 and p99 of each measured quantity (ns)
+#define BENCH_QUANTITIES 4
+static const char* const bench_quantity_names[BENCH_QUANTITIES] = {"ISR ON edge", "ISR OFF edge", "ON -> output HIGH", "OFF -> Timer1 armed"};
+struct ScenarioResult{ uint16_t rpm; uint16_t inj_us; uint64_t p50[BENCH_QUANTITIES]; uint64_t p99[BENCH_QUANTITIES]; };
+
+// Simulated time and pending events
+static uint64_t sim_now = 0; // Timer1 ticks (0.5us)
+static uint64_t next_loop = 0; // next Main Loop tasks
+static uint64_t next_wdt = 0; // next watchdog interrupt
+
+// Next expiry time of one armed Timer1 compare channel (now, if the compare match happens at the present time: channels are never armed 0 ticks from now)
+static uint64_t compare_expiry(uint8_t ch){
+	uint16_t ocr = ch ? (uint16_t)OCR1B : (uint16_t)OCR1A;
+	return sim_now + (uint16_t)(ocr - (uint16_t)sim_now);
+}
+
+// Runs all the timer interrupts and Main Loop tasks due before "t", in time order, then moves the simulated time to "t"
+static void advance_to(uint64_t t){
+	for (;;){
+		uint64_t next = t;
+		int8_t what = -1; // -1: none, 0-1: compare channel, 2: overflow, 3: watchdog, 4: Main Loop
+		for (uint8_t ch=0; ch<TEMPO_CHANNELS_NUM; ch++){
+			if (Timer1.armed(ch) && (compare_expiry(ch) <= next)) { next = compare_expiry(ch); what = (int8_t)ch; }
+		}
+		uint64_t ovf = (sim_now | 0xFFFF) + 1;
+		if (ovf <= next) { next = ovf; what = 2; }
+		if (next_wdt <= next) { next = next_wdt; what = 3; }
+		if (next_loop <= next) { next = next_loop; what = 4; }
+		if (what < 0) break;
+		sim_now = next;
+		hal_time_set(sim_now);
+		switch (what){
+			case 0: TIMER1_COMPA_vect(); break;
+			case 1: TIMER1_COMPB_vect(); break;
+			case 2: TIMER1_OVF_vect(); break;
+			case 3:
+				#if INJ_SAFETY_WDT_ENABLE
+				WDT_vect();
+				#endif
+				next_wdt += BENCH_WDT_TICKS;
+				break;
+			case 4:
+				INJmgr.safety_check(millis());
+				INJmgr.steady_state_eval(millis());
+				next_loop += BENCH_LOOP_TICKS;
+				break;
+		}
+	}
+	sim_now = t;
+	hal_time_set(sim_now);
+}
+
+// One injector input edge (LOW = injector ON): PIND is changed, then the pin change ISR is called
+struct EdgeResult{ uint64_t isr_ns; uint64_t out_ns; uint64_t armed_ns; };
+static EdgeResult edge(uint8_t ch, bool on){
+	uint8_t m = pin_mask(in_pins[ch]);
+	uint8_t pind = PIND;
+	PIND.value = on ? (uint8_t)(pind & ~m) : (uint8_t)(pind | m); // input pins change without hook (the ECU drives them)
+	for (uint8_t c=0; c<INJ_CHANNELS_NUM; c++) { hook_out_high_ns[c] = 0; hook_armed_ns[c] = 0; }
+	uint64_t t0 = now_ns();
+	PCINT2_vect();
+	uint64_t t1 = now_ns();
+	EdgeResult r;
+	r.isr_ns = t1 - t0;
+	r.out_ns = hook_out_high_ns[ch] ? (hook_out_high_ns[ch] - t0) : 0;
+	r.armed_ns = hook_armed_ns[ch] ? (hook_armed_ns[ch] - t0) : 0;
+	return r;
+}
+
+// Cost of one pair of clock readings, subtracted from the results
+static uint64_t clock_overhead_ns(){
+	std::vector<uint64_t> v;
+	for (int i=0; i<10000; i++){ uint64_t a = now_ns(); uint64_t b = now_ns(); v.push_back(b - a); }
+	std::sort(v.begin(), v.end());
+	return v[v.size() / 2];
+}
+
+// One scenario: constant engine speed and injection time, with a small deterministic jitter on the edges
+// Returns the number of edges not served (ON edge without output, OFF edge without extension)
+static uint32_t run_scenario(uint16_t rpm, uint16_t inj_us, uint64_t overhead, ScenarioResult* res){
+	uint64_t period = 240000000ULL / rpm; // 2 rotations, Timer1 ticks
+	uint64_t inj = (uint64_t)inj_us * 2;
+	Dist isr_on, isr_off, on_to_out, off_to_armed;
+	uint32_t missed_out = 0, missed_arm = 0;
+	uint32_t lcg = 12345; // edge jitter generator
+	uint64_t t = sim_now + period;
+	uint64_t measure_from = sim_now + BENCH_WARMUP_TICKS;
+	uint32_t measured = 0;
+	while (measured < BENCH_INJECTIONS){
+		lcg = lcg * 1103515245u + 12345u;
+		uint64_t jitter = (lcg >> 16) & 0x0F; // 0 - 7.5us
+		for (uint8_t ch=0; ch<INJ_CHANNELS_NUM; ch++){ // injector 2 fires one rotation later
+			uint64_t t_on = t + jitter + ch * (period / 2);
+			advance_to(t_on);
+			EdgeResult on = edge(ch, true);
+			advance_to(t_on + inj);
+			EdgeResult off = edge(ch, false);
+			if (t_on < measure_from) continue;
+			isr_on.add(on.isr_ns);
+			isr_off.add(off.isr_ns);
+			if (on.out_ns) on_to_out.add(on.out_ns); else missed_out++;
+			if (off.armed_ns) off_to_armed.add(off.armed_ns); else missed_arm++;
+			if (ch == 0) measured++;
+		}
+		t += period;
+	}
+	advance_to(t); // last extensions expire
+	printf("%5u rpm, injection %4u us: %u injections per injector\n", rpm, inj_us, measured);
+	res->rpm = rpm;
+	res->inj_us = inj_us;
+	isr_on.print(bench_quantity_names[0], overhead, &res->p50[0], &res->p99[0]);
+	isr_off.print(bench_quantity_names[1], overhead, &res->p50[1], &res->p99[1]);
+	on_to_out.print(bench_quantity_names[2], overhead / 2, &res->p50[2], &res->p99[2]); // one clock reading, instead of two
+	off_to_armed.print(bench_quantity_names[3], overhead / 2, &res->p50[3], &res->p99[3]);
+	if (missed_out || missed_arm) printf("  missed: %u ON edges without output, %u OFF edges without extension\n", missed_out, missed_arm);
+	return missed_out + missed_arm;
+}
+
+// Throttle and lambda given to injection "counter" of injector "ch" (10 bits, different for each injection)
+static uint16_t snapshot_throttle(uint8_t ch, uint16_t counter) { return (uint16_t)((counter * 37u + ch * 512u) & 0x3FF); }
+static uint16_t snapshot_lambda(uint8_t ch, uint16_t counter) { return (uint16_t)((counter * 91u + ch * 256u + 5u) & 0x3FF); }
+
+// Engine Data snapshot test state. Written by the signal handler (interrupts), read by the reader loop (Main Loop)
+struct PublishedData{ uint32_t delta_time_tick; uint16_t delta_inj_tick; uint16_t extension_time_ticks; };
+static volatile PublishedData snap_published[INJ_CHANNELS_NUM][256]; // injector data published with each injection counter (low byte)
+static volatile uint16_t snap_counter_last[INJ_CHANNELS_NUM]; // last injection counter published
+static volatile uint32_t snap_injections[INJ_CHANNELS_NUM]; // ON edges generated
+static volatile uint32_t snap_dropped = 0; // injections never published
+static volatile uint32_t snap_not_latched = 0; // published throttle or lambda different from the values at the ON edge
+static volatile bool snap_done = false; // all the edges generated
+static uint64_t snap_t = 0; // present engine cycle start (Timer1 ticks)
+static uint64_t snap_measure_from = 0; // end of the warm up
+static uint32_t snap_lcg = 54321; // edge jitter generator
+static uint8_t snap_step = 0; // next edge: injector (step >> 1), ON (even) or OFF (odd)
+static uint64_t snap_jitter = 0; // jitter of the present engine cycle
+
+// Looks for the snapshot updates made by the last edge (and by the timer interrupts before it): each injection must be published once, with its own throttle and lambda
+static void snapshot_spy(){
+	static uint8_t seq_last = 0;
+	if (INJ_engine_snapshot_seq == seq_last) return;
+	seq_last = INJ_engine_snapshot_seq;
+	for (uint8_t ch=0; ch<INJ_CHANNELS_NUM; ch++){
+		uint16_t counter = INJ_engine_snapshot.channel[ch].injection_counter;
+		uint16_t diff = (uint16_t)(counter - snap_counter_last[ch]);
+		if (diff == 0) continue;
+		snap_dropped = snap_dropped + (diff - 1);
+		volatile PublishedData* p = &snap_published[ch][counter & 0xFF];
+		p->delta_time_tick = INJ_engine_snapshot.channel[ch].delta_time_tick;
+		p->delta_inj_tick = INJ_engine_snapshot.channel[ch].delta_inj_tick;
+		p->extension_time_ticks = INJ_engine_snapshot.channel[ch].extension_time_ticks;
+		if ((INJ_engine_snapshot.throttle != snapshot_throttle(ch, counter)) || (INJ_engine_snapshot.lambda != snapshot_lambda(ch, counter))) snap_not_latched = snap_not_latched + 1;
+		snap_counter_last[ch] = counter;
+	}
+}
+
+// Host timer signal: one injector edge, with the timer interrupts and Main Loop tasks before it
+static void snapshot_signal(int){
+	if (snap_done) return;
+	uint64_t period = 240000000ULL / SNAPSHOT_RPM;
+	uint8_t ch = snap_step >> 1;
+	if (snap_step == 0){
+		snap_lcg = snap_lcg * 1103515245u + 12345u;
+		snap_jitter = (snap_lcg >> 16) & 0x0F; // 0 - 7.5us
+	}
+	uint64_t t_on = snap_t + snap_jitter + ch * (period / 2); // injector 2 fires one rotation later
+	if (!(snap_step & 1)){ // ON edge: throttle and lambda of this injection
+		advance_to(t_on); // the previous injection is published here (extension end)
+		snapshot_spy();
+		uint16_t counter = (uint16_t)(snap_counter_last[ch] + 1);
+		ADCmgr_measures[ADCMGR_THROTTLE_INDEX] = snapshot_throttle(ch, counter);
+		ADCmgr_measures[ADCMGR_LAMBDA_INDEX] = snapshot_lambda(ch, counter);
+		edge(ch, true);
+		snap_injections[ch] = snap_injections[ch] + 1;
+	}else{ // OFF edge: throttle and lambda change, they must not be published with this injection
+		advance_to(t_on + SNAPSHOT_INJ_US * 2); // cranking filter: the ON edge is processed here
+		ADCmgr_measures[ADCMGR_THROTTLE_INDEX] = 0x3FF - ADCmgr_measures[ADCMGR_THROTTLE_INDEX];
+		ADCmgr_measures[ADCMGR_LAMBDA_INDEX] = 0x3FF - ADCmgr_measures[ADCMGR_LAMBDA_INDEX];
+		edge(ch, false);
+	}
+	snapshot_spy();
+	if (++snap_step == 2 * INJ_CHANNELS_NUM){
+		snap_step = 0;
+		snap_t += period;
+		if (snap_t >= snap_measure_from + SNAPSHOT_INJECTIONS * period){
+			advance_to(snap_t); // last extensions expire
+			snapshot_spy();
+			snap_done = true;
+		}
+	}
+}
+
+// Engine Data snapshot test: the reader copies the snapshot continuously, while the timer signal generates the injections. Returns the number of errors
+static uint32_t snapshot_test(){
+	advance_to(sim_now + 240000000ULL / SNAPSHOT_RPM); // extensions of the previous scenario expire (injector 2: after the end of the scenario)
+	snap_t = sim_now + 240000000ULL / SNAPSHOT_RPM;
+	snap_measure_from = sim_now + BENCH_WARMUP_TICKS;
+	uint16_t counter_start[INJ_CHANNELS_NUM]; // injections published before the test
+	for (uint8_t ch=0; ch<INJ_CHANNELS_NUM; ch++){ // data published before the test (throttle and lambda were not given by the test)
+		uint16_t counter = INJ_engine_snapshot.channel[ch].injection_counter;
+		snap_counter_last[ch] = counter_start[ch] = counter;
+		snap_published[ch][counter & 0xFF].delta_time_tick = INJ_engine_snapshot.channel[ch].delta_time_tick;
+		snap_published[ch][counter & 0xFF].delta_inj_tick = INJ_engine_snapshot.channel[ch].delta_inj_tick;
+		snap_published[ch][counter & 0xFF].extension_time_ticks = INJ_engine_snapshot.channel[ch].extension_time_ticks;
+	}
+	snapshot_spy(); // present sequence counter
+	struct sigaction sa = {};
+	sa.sa_handler = snapshot_signal;
+	sigaction(SIGALRM, &sa, NULL);
+	struct itimerval it = {{0, SNAPSHOT_SIGNAL_US}, {0, SNAPSHOT_SIGNAL_US}};
+	setitimer(ITIMER_REAL, &it, NULL);
+	uint64_t reads = 0, retries = 0, incoherent = 0;
+	while (!snap_done){
+		INJ_engine_snapshot_struct s;
+		retries += INJmgr.read_engine_snapshot(&s);
+		reads++;
+		bool running = false, latched = false, started = false;
+		for (uint8_t ch=0; ch<INJ_CHANNELS_NUM; ch++){
+			volatile PublishedData* p = &snap_published[ch][s.channel[ch].injection_counter & 0xFF];
+			if ((s.channel[ch].delta_time_tick != p->delta_time_tick) || (s.channel[ch].delta_inj_tick != p->delta_inj_tick) || (s.channel[ch].extension_time_ticks != p->extension_time_ticks)) incoherent++;
+			if (s.channel[ch].delta_time_tick) running = true;
+			if (s.channel[ch].injection_counter != counter_start[ch]) started = true; // published by the test
+			if ((s.throttle == snapshot_throttle(ch, s.channel[ch].injection_counter)) && (s.lambda == snapshot_lambda(ch, s.channel[ch].injection_counter))) latched = true; // from the last published injection
+		}
+		if (running && started && !latched) incoherent++;
+	}
+	struct itimerval off = {};
+	setitimer(ITIMER_REAL, &off, NULL);
+	uint32_t missing = 0; // last injections not published at the end
+	for (uint8_t ch=0; ch<INJ_CHANNELS_NUM; ch++){
+		uint32_t published = (uint16_t)(snap_counter_last[ch] - counter_start[ch]); // counter increments (gaps are counted as dropped by the spy)
+		if (published < snap_injections[ch]) missing += snap_injections[ch] - published;
+	}
+	printf("%5u rpm, Engine Data snapshot: %llu reads, %llu reader retries, %u dropped updates, %llu incoherent copies, %u throttle / lambda not latched\n", SNAPSHOT_RPM,
+		(unsigned long long)reads, (unsigned long long)retries, snap_dropped + missing, (unsigned long long)incoherent, snap_not_latched);
+	return snap_dropped + missing + (uint32_t)incoherent + snap_not_latched;
+}
+
+// Injector 0 output status
+static bool out_high() { return (hal_mem[port_addr(out_pins[0])].value & pin_mask(out_pins[0])) != 0; }
+
+// Safety watchdog test (injector 0). Returns the number of errors
+static uint32_t wdt_test(){
+	uint32_t errors = 0;
+	#if INJ_SAFETY_WDT_ENABLE
+	uint64_t period = 240000000ULL / 1500; // 1500 rpm
+	uint64_t t = sim_now + period; // extensions of the previous test expire
+	uint16_t trips = INJ_wdt_trip_cnt[0];
+	INJ_engine_snapshot_struct s;
+	
+	// Long command (30ms, longer than INJ_TIME_TICKS_MAX): followed, not aborted
+	advance_to(t);
+	edge(0, true);
+	advance_to(t + 60000);
+	if (!out_high() || (INJ_wdt_trip_cnt[0] != trips)){ printf("  watchdog: 30ms command cut\n"); errors++; }
+	edge(0, false);
+	advance_to(t + 60000 + 2 * BENCH_WDT_TICKS);
+	INJmgr.read_engine_snapshot(&s);
+	if (out_high() || (INJ_wdt_trip_cnt[0] != trips) || s.channel[0].aborted){ printf("  watchdog: 30ms command, injection aborted\n"); errors++; }
+	
+	// Missing OFF edge (input OFF, pin change interrupt lost): injector OFF within one watchdog period, injection aborted with its open time
+	t += period;
+	advance_to(t);
+	edge(0, true);
+	advance_to(t + 4000);
+	PIND.value |= pin_mask(in_pins[0]); // no interrupt
+	advance_to(t + 4000 + 2 * BENCH_WDT_TICKS);
+	INJmgr.read_engine_snapshot(&s);
+	uint32_t open_ticks = (uint32_t)s.channel[0].delta_inj_tick << (3 - INJ_TS_SHIFT); // Timer1 ticks (0.5us)
+	if (out_high() || (INJ_wdt_trip_cnt[0] != (uint16_t)(trips + 1)) || !s.channel[0].aborted || (open_ticks < 4000) || (open_ticks > 4000 + BENCH_WDT_TICKS + 16)){
+		printf("  watchdog: missing OFF edge, output %u, trips %u, aborted %u, open %u ticks\n", out_high(), INJ_wdt_trip_cnt[0] - trips, s.channel[0].aborted, open_ticks); errors++;
+	}
+	t += period;
+	advance_to(t);
+	edge(0, true); // next injection: served
+	bool served = out_high();
+	advance_to(t + 3000);
+	edge(0, false);
+	advance_to(t + 3000 + 4 * BENCH_WDT_TICKS);
+	INJmgr.read_engine_snapshot(&s);
+	if (!served || s.channel[0].aborted){ printf("  watchdog: injection after the missing OFF edge not served\n"); errors++; }
+	
+	// Stuck input: injector OFF after INJ_SAFETY_WDT_MAX_ECU_ON_TICKS
+	t += period;
+	advance_to(t);
+	edge(0, true);
+	advance_to(t + (uint64_t)INJ_SAFETY_WDT_MAX_ECU_ON_TICKS * 8 - BENCH_WDT_TICKS);
+	if (!out_high()){ printf("  watchdog: stuck input, injector OFF too early\n"); errors++; }
+	advance_to(t + (uint64_t)INJ_SAFETY_WDT_MAX_ECU_ON_TICKS * 8 + 2 * BENCH_WDT_TICKS);
+	if (out_high() || (INJ_wdt_trip_cnt[0] != (uint16_t)(trips + 2))){ printf("  watchdog: stuck input, injector not turned OFF\n"); errors++; }
+	edge(0, false);
+	printf("Safety watchdog: %u errors\n", errors);
+	#endif
+	return errors;
+}
+
+// Results file: build options (INJ_OUT_FASTPIN, INJ_CHANNELS_NUM), then one line per scenario (rpm, injection time, then p50 and p99 of each quantity)
+static void results_write(const char* path, const ScenarioResult* res, uint8_t n){
+	FILE* f = fopen(path, "w");
+	if (!f){ fprintf(stderr, "%s: cannot write\n", path); return; }
+	fprintf(f, "%u %u\n", INJ_OUT_FASTPIN, INJ_CHANNELS_NUM);
+	for (uint8_t s=0; s<n; s++){
+		fprintf(f, "%u %u", res[s].rpm, res[s].inj_us);
+		for (uint8_t q=0; q<BENCH_QUANTITIES; q++) fprintf(f, " %llu %llu", (unsigned long long)res[s].p50[q], (unsigned long long)res[s].p99[q]);
+		fprintf(f, "\n");
+	}
+	fclose(f);
+}
+
+// Reads the results file of another build ("fastpin", "channels": its build options). Returns the number of scenarios read
+static uint8_t results_read(const char* path, ScenarioResult* res, uint8_t n_max, unsigned* fastpin, unsigned* channels){
+	FILE* f = fopen(path, "r");
+	if (!f){ fprintf(stderr, "%s: cannot read\n", path); return 0; }
+	if (fscanf(f, "%u %u", fastpin, channels) != 2) { fclose(f); return 0; }
+	uint8_t n = 0;
+	unsigned rpm, inj_us;
+	while ((n < n_max) && (fscanf(f, "%u %u", &rpm, &inj_us) == 2)){
+		res[n].rpm = (uint16_t)rpm;
+		res[n].inj_us = (uint16_t)inj_us;
+		for (uint8_t q=0; q<BENCH_QUANTITIES; q++){
+			unsigned long long p50 = 0, p99 = 0;
+			if (fscanf(f, "%llu %llu", &p50, &p99) != 2) { fclose(f); return n; }
+			res[n].p50[q] = p50;
+			res[n].p99[q] = p99;
+		}
+		n++;
+	}
+	fclose(f);
+	return n;
+}
+
+// Prints this build and the reference build side by side (same scenarios), with the sum of the p50 of all the scenarios. Returns the number of errors:
+// reference not readable, or FastPin build not faster than the "digitalWrite" build, from the injector input edge to the output
+static uint32_t results_compare(const char* ref_path, const ScenarioResult* res, uint8_t n){
+	ScenarioResult ref[16];
+	unsigned ref_fastpin = 0, ref_channels = 0;
+	uint8_t n_ref = results_read(ref_path, ref, 16, &ref_fastpin, &ref_channels);
+	if (n_ref == 0) return 1;
+	uint64_t sum_p50[BENCH_QUANTITIES], ref_sum_p50[BENCH_QUANTITIES];
+	for (uint8_t q=0; q<BENCH_QUANTITIES; q++) sum_p50[q] = ref_sum_p50[q] = 0;
+	printf("Compared with %s, INJ_OUT_FASTPIN %u, %u injector(s) (p50 / p99 ns: this build | reference)\n", ref_path, ref_fastpin, ref_channels);
+	printf("  rpm   inj");
+	for (uint8_t q=0; q<BENCH_QUANTITIES; q++) printf("  %-21s", bench_quantity_names[q]);
+	printf("\n");
+	for (uint8_t s=0; s<n; s++){
+		const ScenarioResult* r = NULL;
+		for (uint8_t k=0; k<n_ref; k++) if ((ref[k].rpm == res[s].rpm) && (ref[k].inj_us == res[s].inj_us)) r = &ref[k];
+		if (!r) continue;
+		printf("%5u %5u", res[s].rpm, res[s].inj_us);
+		for (uint8_t q=0; q<BENCH_QUANTITIES; q++){
+			char cell[32];
+			snprintf(cell, sizeof(cell), "%llu/%llu | %llu/%llu", (unsigned long long)res[s].p50[q], (unsigned long long)res[s].p99[q], (unsigned long long)r->p50[q], (unsigned long long)r->p99[q]);
+			printf("  %-21s", cell);
+			sum_p50[q] += res[s].p50[q];
+			ref_sum_p50[q] += r->p50[q];
+		}
+		printf("\n");
+	}
+	printf("  sum of p50");
+	for (uint8_t q=0; q<BENCH_QUANTITIES; q++){
+		char cell[32];
+		snprintf(cell, sizeof(cell), "%llu | %llu", (unsigned long long)sum_p50[q], (unsigned long long)ref_sum_p50[q]);
+		printf("  %-21s", cell);
+	}
+	printf("\n");
+	if (INJ_OUT_FASTPIN && !ref_fastpin && (ref_channels == INJ_CHANNELS_NUM)){
+		bool faster = sum_p50[2] < ref_sum_p50[2];
+		printf("FastPin edge to output latency (sum of p50): %llu ns, digitalWrite %llu ns: %s\n", (unsigned long long)sum_p50[2], (unsigned long long)ref_sum_p50[2], faster ? "lower" : "NOT lower");
+		if (!faster) return 1;
+	}
+	return 0;
+}
+
+int main(int argc, char** argv){
+
+	// Firmware initialization (the parts used by the injection)
+	for (uint8_t ch=0; ch<INJ_CHANNELS_NUM; ch++) PIND.value |= pin_mask(in_pins[ch]); // inputs HIGH: injectors OFF
+	ISRmgr_init();
+	INJmgr.begin();
+	EEPROM_initialize(); // erased EEPROM: standard maps are written and committed
+	hal_write_hook = bench_write_hook;
+
+	uint64_t overhead = clock_overhead_ns();
+	printf("Injector ISR latency benchmark (host ns, clock overhead %llu ns subtracted), %u injector(s)\n", (unsigned long long)overhead, INJ_CHANNELS_NUM);
+	static const uint16_t rpm_list[] = {1500, 4000, 8000, 12000};
+	static const uint16_t inj_list[] = {1500, 4000};
+	ScenarioResult res[sizeof(rpm_list) / sizeof(rpm_list[0]) * sizeof(inj_list) / sizeof(inj_list[0])];
+	uint8_t n = 0;
+	uint32_t missed = 0;
+	for (uint8_t r=0; r<sizeof(rpm_list)/sizeof(rpm_list[0]); r++){
+		for (uint8_t i=0; i<sizeof(inj_list)/sizeof(inj_list[0]); i++){
+			missed += run_scenario(rpm_list[r], inj_list[i], overhead, &res[n++]);
+		}
+	}
+	uint32_t snapshot_errors = snapshot_test();
+	snapshot_errors += wdt_test();
+	if (argc > 1) results_write(argv[1], res, n);
+	uint32_t compare_errors = (argc > 2) ? results_compare(argv[2], res, n) : 0;
+	return (missed || snapshot_errors || compare_errors) ? 1 : 0; // edges not served, Engine Data lost, safety watchdog wrong, or slower than the reference: the injection path is broken, not only slow
+
+}
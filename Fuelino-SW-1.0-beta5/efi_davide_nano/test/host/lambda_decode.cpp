@@ -0,0 +1,47 @@
+// Davide Cavaliere
+// www.monocilindro.com
+// dadez87-at-gmail-com
+// Lambda log decoder (host): prints the Lambda packets ('L', 'S', 'W', 'X') of an SD log file, one line per packet (CSV), the other packets are skipped.
+// Usage: lambda_decode LOG_FILE [volts]. Samples are ADC values (0 - 1023 = 0 - 5V), or volts with the "volts" option
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "lambda_decode.h"
+
+int main(int argc, char** argv){
+
+	if ((argc < 2) || (argc > 3)){
+		fprintf(stderr, "usage: %s LOG_FILE [volts]\n", argv[0]);
+		return 2;
+	}
+	bool volts = (argc == 3) && (strcmp(argv[2], "volts") == 0);
+	FILE* f = fopen(argv[1], "rb");
+	if (!f){
+		fprintf(stderr, "%s: cannot open\n", argv[1]);
+		return 2;
+	}
+	std::vector<uint8_t> log_data;
+	uint8_t chunk[4096];
+	size_t n;
+	while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) log_data.insert(log_data.end(), chunk, chunk + n);
+	fclose(f);
+
+	printf("offset,id,combustion_num,delta_ticks,injec_ticks,throttle,time_delta,delta_inj_tick");
+	for (uint8_t k=0; k<LAMBDA_PACKET_SAMPLES; k++) printf(",s%u", k);
+	printf("\n");
+	uint32_t offset = 0, packet_offset = 0, packets = 0;
+	lambda_packet_struct packet;
+	while (lambda_stream_next(log_data.data(), (uint32_t)log_data.size(), &offset, &packet_offset, &packet)){
+		printf("%u,%c,%u,%u,%u,%u,%u,%u", packet_offset, packet.id, packet.combustion_num, packet.delta_ticks, packet.injec_ticks, packet.throttle, packet.time_delta, packet.delta_inj_tick);
+		for (uint8_t k=0; k<LAMBDA_PACKET_SAMPLES; k++){
+			if (volts) printf(",%.4f", packet.samples[k] * (5.0 / 1024.0));
+			else printf(",%u", packet.samples[k]);
+		}
+		printf("\n");
+		packets++;
+	}
+	fprintf(stderr, "%u Lambda packets\n", packets);
+	return 0;
+
+}
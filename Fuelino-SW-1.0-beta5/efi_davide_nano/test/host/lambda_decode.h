@@ -0,0 +1,84 @@
+// Davide Cavaliere
+// www.monocilindro.com
+// dadez87-at-gmail-com
+// Lambda packets decoder (host): 'L', 'S' (1 byte samples) and 'W', 'X' (10 bits samples, 4 samples packed in 5 bytes), as written on SD by SDmgr (ADCmgr buffer, INJmgr header, SDmgr tail and checksum).
+// Used by the log decoder "lambda_decode" and by the host tests. Sizes are fixed by the packet identifier, so logs of any firmware configuration can be decoded
+
+#ifndef LAMBDA_DECODE_h
+#define LAMBDA_DECODE_h
+
+#include <stdint.h>
+
+#define LAMBDA_PACKET_SAMPLES 32 // samples in one packet (ADCMGR_LAMBDA_ACQ_BUF_SIZE)
+#define LAMBDA_PACKET_HEAD 9 // identifier (1) | combustion counter (2) | delta_ticks (2) | injection ticks (2) | throttle (2)
+#define LAMBDA_PACKET_TAIL 4 // acquisition time (2, 4us) | delta_inj_tick (2)
+
+// Packet contents (little endian fields)
+struct lambda_packet_struct{
+	uint8_t id; // packet identifier
+	uint16_t combustion_num; // injection counter at the acquisition request
+	uint16_t delta_ticks; // engine cycle time (4us)
+	uint16_t injec_ticks; // injection time (4us)
+	uint16_t throttle; // throttle (ADC)
+	uint16_t samples[LAMBDA_PACKET_SAMPLES]; // Lambda voltage (ADC): 0 - 1023 = 0 - 5V ('W', 'X'), 0 - 255 ('L', 'S', 255 also when over about 1.25V)
+	uint16_t time_delta; // time between the first and the last sample (4us, 0xFFFF if saturated)
+	uint16_t delta_inj_tick; // engine cycle time when the packet was written (4us)
+};
+
+// Packet size (header, data, tail, checksum), 0 if the identifier is not a Lambda packet
+static inline uint16_t lambda_packet_size(uint8_t id){
+	switch (id){
+		case 'L': case 'S': return LAMBDA_PACKET_HEAD + LAMBDA_PACKET_SAMPLES + LAMBDA_PACKET_TAIL + 2; // 47 bytes
+		case 'W': case 'X': return LAMBDA_PACKET_HEAD + (LAMBDA_PACKET_SAMPLES >> 2) * 5 + LAMBDA_PACKET_TAIL + 2; // 55 bytes
+		default: return 0;
+	}
+}
+
+static inline uint16_t lambda_get16(const uint8_t* p) { return (uint16_t)(p[0] | ((uint16_t)p[1] << 8)); }
+
+// Decodes the packet at "data" ("size" bytes available). Returns false if it is not a Lambda packet, if it is truncated, or if the checksum (COMM_calculate_checksum, CK_A first) is wrong
+static inline bool lambda_packet_decode(const uint8_t* data, uint32_t size, lambda_packet_struct* packet){
+	uint16_t packet_size = lambda_packet_size(data[0]);
+	if ((packet_size == 0) || (size < packet_size)) return false;
+	uint8_t ck_a = 0, ck_b = 0;
+	for (uint16_t i=0; i<(packet_size - 2); i++){
+		ck_a += data[i];
+		ck_b += ck_a;
+	}
+	if ((data[packet_size - 2] != ck_a) || (data[packet_size - 1] != ck_b)) return false;
+	packet->id = data[0];
+	packet->combustion_num = lambda_get16(&data[1]);
+	packet->delta_ticks = lambda_get16(&data[3]);
+	packet->injec_ticks = lambda_get16(&data[5]);
+	packet->throttle = lambda_get16(&data[7]);
+	const uint8_t* samples = &data[LAMBDA_PACKET_HEAD];
+	for (uint8_t n=0; n<LAMBDA_PACKET_SAMPLES; n++){
+		if ((packet->id == 'W') || (packet->id == 'X')){ // group g of 5 bytes (b0 .. b4): sample(4g+k) = bk | (((b4 >> (2*k)) & 0x03) << 8)
+			const uint8_t* group = &samples[(n >> 2) * 5];
+			uint8_t k = n & 0x03;
+			packet->samples[n] = (uint16_t)(group[k] | (((group[4] >> (2 * k)) & 0x03) << 8));
+		}else{
+			packet->samples[n] = samples[n];
+		}
+	}
+	const uint8_t* tail = &data[packet_size - 2 - LAMBDA_PACKET_TAIL];
+	packet->time_delta = lambda_get16(&tail[0]);
+	packet->delta_inj_tick = lambda_get16(&tail[2]);
+	return true;
+}
+
+// Finds the next Lambda packet of a log stream, from "*offset". The other packets are skipped byte by byte (a Lambda packet is recognized by identifier and checksum).
+// Returns false at the end of the stream. "*packet_offset" is the packet position, "*offset" moves after the packet
+static inline bool lambda_stream_next(const uint8_t* data, uint32_t size, uint32_t* offset, uint32_t* packet_offset, lambda_packet_struct* packet){
+	for (uint32_t i=*offset; i<size; i++){
+		if (lambda_packet_decode(&data[i], size - i, packet)){
+			*packet_offset = i;
+			*offset = i + lambda_packet_size(data[i]);
+			return true;
+		}
+	}
+	*offset = size;
+	return false;
+}
+
+#endif
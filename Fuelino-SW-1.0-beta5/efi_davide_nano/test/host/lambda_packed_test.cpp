@@ -0,0 +1,127 @@
+// Davide Cavaliere
+// www.monocilindro.com
+// dadez87-at-gmail-com
+// Packed 10 bits Lambda test (host): the real ADC interrupt (firmware built with ADCMGR_LAMBDA_PACKED_10BIT = 1, see Makefile) is fed with known conversions,
+// the buffers are completed as INJmgr and SDmgr do, then decoded by "lambda_decode.h" from a log stream. All the samples must be decoded with their 10 bits
+
+#include <Arduino.h>
+#include <stdio.h>
+#include <vector>
+#include "ADCmgr/ADCmgr.h"
+#include "COMMmgr/COMMmgr.h"
+#include "lambda_decode.h"
+
+#if !ADCMGR_LAMBDA_PACKED_10BIT
+	#error "lambda_packed_test needs the firmware variant with ADCMGR_LAMBDA_PACKED_10BIT = 1"
+#endif
+
+extern "C" void ADC_vect(void);
+extern volatile uint8_t ADCmgr_schedule_slot; // ADCmgr.cpp
+
+#define ACQUISITIONS 6 // buffers filled (pool used round robin)
+#define SCHEDULE_GROUP_SIZE (2 * ADCMGR_SCHEDULE_FAST_PAIRS + 1) // same as ADCmgr_schedule: fast pairs (Throttle, Lambda), then one slow signal
+
+static uint32_t errors = 0;
+#define CHECK(cond, ...) do{ if (!(cond)){ if (errors++ < 10) { printf("FAIL %s:%d: ", __FILE__, __LINE__); printf(__VA_ARGS__); printf("\n"); } } }while(0)
+
+static uint32_t lcg = 1;
+static uint16_t rnd10() { lcg = lcg * 1103515245u + 12345u; return (uint16_t)((lcg >> 16) & 0x3FF); }
+
+// Value of sample n: range corners first, then random
+static uint16_t sample_value(uint32_t n){
+	static const uint16_t corners[] = {0, 1, 2, 3, 255, 256, 511, 512, 767, 768, 1020, 1021, 1022, 1023};
+	if (n < sizeof(corners) / sizeof(corners[0])) return corners[n];
+	return rnd10();
+}
+
+// One conversion: result registers written, then the ADC interrupt (its flag is cleared by the vector, as on the AVR)
+static void adc_conversion(uint16_t value){
+	ADCSRA |= _BV(ADIF); // flag cleared writing 1
+	ADCH = (uint8_t)(value >> 8);
+	ADCL = (uint8_t)value;
+	ADC_vect();
+}
+
+// Packet completed as INJmgr (header) and SDmgr (tail and checksum) do, appended to the log stream
+static void packet_complete(volatile uint8_t* buf, uint16_t acq, std::vector<uint8_t>& log_stream){
+	buf[1] = (uint8_t)acq; buf[2] = (uint8_t)(acq >> 8); // combustion counter
+	buf[3] = 0x34; buf[4] = 0x12; // delta_ticks
+	buf[5] = 0x78; buf[6] = 0x06; // injection ticks
+	buf[7] = 0xFF; buf[8] = 0x03; // throttle
+	buf[ADCMGR_LAMBDA_ACQ_BUF_TOT - 4] = 0xCD; buf[ADCMGR_LAMBDA_ACQ_BUF_TOT - 3] = 0xAB; // delta_inj_tick
+	uint16_t CK_SUM = COMM_calculate_checksum((uint8_t*)buf, 0, (ADCMGR_LAMBDA_ACQ_BUF_TOT - 2));
+	buf[ADCMGR_LAMBDA_ACQ_BUF_TOT - 2] = (uint8_t)(CK_SUM >> 8);
+	buf[ADCMGR_LAMBDA_ACQ_BUF_TOT - 1] = (uint8_t)(CK_SUM & 0xFF);
+	for (uint8_t i=0; i<ADCMGR_LAMBDA_ACQ_BUF_TOT; i++) log_stream.push_back((uint8_t)buf[i]);
+}
+
+int main(){
+
+	ADCmgr_init();
+	CHECK(lambda_packet_size(ADCmgr_lambda_acq_buf[0][0]) == ADCMGR_LAMBDA_ACQ_BUF_TOT, "packet '%c': decoder size %u, firmware size %u", ADCmgr_lambda_acq_buf[0][0], lambda_packet_size(ADCmgr_lambda_acq_buf[0][0]), ADCMGR_LAMBDA_ACQ_BUF_TOT);
+
+	// Acquisitions: one Lambda conversion out of (1 << ADCMGR_LAMBDA_PRESCALER_SHIFT) is stored (prescaler 1). Other bytes between the packets, as in a log
+	std::vector<uint8_t> log_stream;
+	std::vector<uint16_t> expected;
+	uint32_t sample_n = 0;
+	for (uint16_t acq=0; acq<ACQUISITIONS; acq++){
+		uint8_t fill = ADCmgr_lambda_acq_buf_fill;
+		ADCmgr_lambda_acq_prescaler_max = 1;
+		uint32_t lambda_conv = 0;
+		for (uint32_t n=0; (n < 100000) && !ADCmgr_lambda_acq_buf_filled[fill]; n++){
+			uint8_t pos = ADCmgr_schedule_slot % SCHEDULE_GROUP_SIZE;
+			bool lambda = (pos < (2 * ADCMGR_SCHEDULE_FAST_PAIRS)) && (pos & 1); // Lambda slot of a fast pair
+			if (lambda && ((++lambda_conv & ((1 << ADCMGR_LAMBDA_PRESCALER_SHIFT) - 1)) == 0)){ // stored by the interrupt
+				uint16_t v = sample_value(sample_n++);
+				expected.push_back(v);
+				adc_conversion(v);
+			}else{
+				adc_conversion(rnd10()); // not stored
+			}
+		}
+		CHECK(ADCmgr_lambda_acq_buf_filled[fill], "acquisition %u: buffer %u not filled", acq, fill);
+		CHECK(ADCmgr_lambda_acq_buf_fill != fill, "acquisition %u: the next acquisition uses the same buffer", acq);
+		packet_complete(ADCmgr_lambda_acq_buf[fill], acq, log_stream);
+		ADCmgr_lambda_acq_buf_filled[fill] = false; // written on SD
+		for (uint8_t i=0; i<7; i++) log_stream.push_back((uint8_t)("EWXWL\x00\xFF"[i])); // other bytes, with packet identifiers
+	}
+	CHECK(expected.size() == ACQUISITIONS * LAMBDA_PACKET_SAMPLES, "%u samples stored, expected %u", (unsigned)expected.size(), ACQUISITIONS * LAMBDA_PACKET_SAMPLES);
+
+	// Decoding: all the packets found, in order, with the 10 bits samples
+	uint32_t offset = 0, packet_offset = 0, packets = 0;
+	lambda_packet_struct packet;
+	while (lambda_stream_next(log_stream.data(), (uint32_t)log_stream.size(), &offset, &packet_offset, &packet)){
+		CHECK(packet.id == 'W', "packet %u: identifier '%c'", packets, packet.id);
+		CHECK(packet.combustion_num == packets, "packet %u: combustion counter %u", packets, packet.combustion_num);
+		CHECK((packet.delta_ticks == 0x1234) && (packet.injec_ticks == 0x0678) && (packet.throttle == 0x03FF) && (packet.delta_inj_tick == 0xABCD), "packet %u: header or tail", packets);
+		for (uint8_t k=0; k<LAMBDA_PACKET_SAMPLES; k++){
+			uint32_t n = packets * LAMBDA_PACKET_SAMPLES + k;
+			if (n < expected.size()) CHECK(packet.samples[k] == expected[n], "packet %u, sample %u: decoded %u, converted %u", packets, k, packet.samples[k], expected[n]);
+		}
+		packets++;
+	}
+	CHECK(packets == ACQUISITIONS, "%u packets decoded, expected %u", packets, ACQUISITIONS);
+
+	// Checksum error: the packet is skipped
+	std::vector<uint8_t> bad(log_stream.begin(), log_stream.begin() + ADCMGR_LAMBDA_ACQ_BUF_TOT);
+	bad[ADCMGR_LAMBDA_ACQ_BUF_HEAD + 4] ^= 0x01;
+	offset = 0;
+	CHECK(!lambda_stream_next(bad.data(), (uint32_t)bad.size(), &offset, &packet_offset, &packet), "packet with wrong checksum decoded");
+
+	// 1 byte samples ('L'): decoded as they are
+	uint8_t packet_l[LAMBDA_PACKET_HEAD + LAMBDA_PACKET_SAMPLES + LAMBDA_PACKET_TAIL + 2] = {'L'};
+	for (uint8_t k=0; k<LAMBDA_PACKET_SAMPLES; k++) packet_l[LAMBDA_PACKET_HEAD + k] = (uint8_t)(k * 8 + 7);
+	uint16_t CK_SUM = COMM_calculate_checksum(packet_l, 0, sizeof(packet_l) - 2);
+	packet_l[sizeof(packet_l) - 2] = (uint8_t)(CK_SUM >> 8);
+	packet_l[sizeof(packet_l) - 1] = (uint8_t)(CK_SUM & 0xFF);
+	CHECK(lambda_packet_decode(packet_l, sizeof(packet_l), &packet) && (packet.samples[0] == 7) && (packet.samples[31] == 255), "'L' packet");
+
+	printf("packed Lambda: %u packets, %u samples of 10 bits decoded\n", packets, (unsigned)expected.size());
+	if (errors){
+		printf("%u errors\n", errors);
+		return 1;
+	}
+	printf("OK\n");
+	return 0;
+
+}
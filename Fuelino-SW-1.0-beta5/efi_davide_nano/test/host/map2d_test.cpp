@@ -0,0 +1,114 @@
+// Davide Cavaliere
+// www.monocilindro.com
+// dadez87-at-gmail-com
+// 2D correction map test (host): "Map2D::interpolate()" (with the INJmgr map geometry) is compared with a 64 bits bilinear interpolation on the whole rpm x throttle range,
+// then it is timed against the 1D path used by the injection interrupt when INJ_MAP_2D_ENABLE is 0 ("interpolate_rpm_map" + "interpolate_thr_map")
+
+#include <Arduino.h>
+#include <stdio.h>
+#include <time.h>
+#include "INJmgr/INJmgr.h"
+#include "ADCmgr/ADCmgr.h"
+#include "EEPROMmgr/EEPROMmgr.h"
+
+extern INJ_calib_struct* volatile INJ_calib_active; // INJmgr.cpp
+
+typedef Map2D<INJ_MAP_2D_RPM_SIZE, INJ_MAP_2D_THR_SIZE, INJ_MAP_2D_RPM_START, INJ_MAP_2D_RPM_SHIFT, INJ_MAP_2D_THR_START, INJ_MAP_2D_THR_SHIFT> map_2d_t; // same as "INJ_map_2d_class"
+
+#define MAPS_NUM 20 // random maps tested
+#define THR_MAX 1023 // throttle range (10 bits ADC)
+#define TIMING_ROUNDS 25 // timing rounds of each path
+#define TIMING_TOLERANCE_PERC 110 // 2D map time, at most this percentage of the 1D maps time (host timing noise)
+
+static uint32_t errors = 0;
+#define CHECK(cond, ...) do{ if (!(cond)){ if (errors++ < 10) { printf("FAIL %s:%d: ", __FILE__, __LINE__); printf(__VA_ARGS__); printf("\n"); } } }while(0)
+
+static uint32_t lcg = 1;
+static uint8_t rnd8() { lcg = lcg * 1103515245u + 12345u; return (uint8_t)(lcg >> 16); }
+
+static inline uint64_t now_ns(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// Axis position: lower point, upper point, and fraction between them (8 bits, 2e8 = 1, truncated as the map does)
+static void ref_axis(uint16_t value, uint16_t start, uint8_t shift, uint8_t size, uint8_t* i0, uint8_t* i1, uint32_t* f){
+	if (value <= start) { *i0 = 0; *i1 = 0; *f = 0; return; }
+	uint32_t offset = value - start;
+	uint32_t index = offset >> shift;
+	if (index >= (uint32_t)(size - 1)) { *i0 = size - 1; *i1 = size - 1; *f = 0; return; }
+	*i0 = (uint8_t)index;
+	*i1 = (uint8_t)(index + 1);
+	*f = (uint32_t)(((offset - (index << shift)) << 8) >> shift);
+}
+
+// Bilinear interpolation without intermediate truncation or wrap around (cells: 2e8 = 50%, result: 2e16 = 100%), rounded down
+static uint16_t ref_interpolate(const map_2d_t& map, uint16_t x, uint16_t y){
+	uint8_t x0, x1, y0, y1;
+	uint32_t fx, fy;
+	ref_axis(x, INJ_MAP_2D_RPM_START, INJ_MAP_2D_RPM_SHIFT, INJ_MAP_2D_RPM_SIZE, &x0, &x1, &fx);
+	ref_axis(y, INJ_MAP_2D_THR_START, INJ_MAP_2D_THR_SHIFT, INJ_MAP_2D_THR_SIZE, &y0, &y1, &fy);
+	uint64_t r = (uint64_t)map.cells[x0][y0] * (256 - fx) * (256 - fy) + (uint64_t)map.cells[x0][y1] * (256 - fx) * fy
+		+ (uint64_t)map.cells[x1][y0] * fx * (256 - fy) + (uint64_t)map.cells[x1][y1] * fx * fy; // cells x 2e16
+	return (uint16_t)(r >> 9);
+}
+
+int main(){
+
+	// Random maps (first ones: flat, maximum slopes): map and reference, on all rpm values and on the throttle range
+	static map_2d_t map;
+	for (uint8_t m=0; m<MAPS_NUM; m++){
+		for (uint8_t i=0; i<INJ_MAP_2D_RPM_SIZE; i++){
+			for (uint8_t j=0; j<INJ_MAP_2D_THR_SIZE; j++){
+				uint8_t v = rnd8();
+				if (m == 0) v = 128;
+				if (m == 1) v = ((i ^ j) & 1) ? 255 : 0;
+				if (m == 2) v = ((i ^ j) & 1) ? 0 : 255;
+				map.cells[i][j] = v;
+			}
+		}
+		for (uint32_t x=0; x<=0xFFFF; x+=(m < 3) ? 1 : 13){
+			for (uint16_t y=0; y<=THR_MAX; y++){
+				uint16_t out = map.interpolate((uint16_t)x, y);
+				uint16_t ref = ref_interpolate(map, (uint16_t)x, y);
+				CHECK(out == ref, "map %u, x %u, y %u: map %u, reference %u", m, (unsigned)x, y, out, ref);
+			}
+		}
+		for (uint8_t i=0; i<INJ_MAP_2D_RPM_SIZE; i++){ // grid points: the cell value, 2e8 = 50% -> 2e16 = 100%
+			for (uint8_t j=0; j<INJ_MAP_2D_THR_SIZE; j++){
+				uint16_t x = INJ_MAP_2D_RPM_START + ((uint16_t)i << INJ_MAP_2D_RPM_SHIFT);
+				uint16_t y = INJ_MAP_2D_THR_START + ((uint16_t)j << INJ_MAP_2D_THR_SHIFT);
+				CHECK(map.interpolate(x, y) == ((uint16_t)map.cells[i][j] << 7), "map %u, grid point [%u][%u]: %u, cell %u", m, i, j, map.interpolate(x, y), map.cells[i][j]);
+			}
+		}
+	}
+	printf("2D map: %u maps, %ux%u cells, bit exact with the 64 bits bilinear interpolation\n", MAPS_NUM, INJ_MAP_2D_RPM_SIZE, INJ_MAP_2D_THR_SIZE);
+
+	// Timing against the 1D path (host ns per call, same rpm inputs, throttle read from ADCmgr by both). The 2D map replaces both 1D maps in the injection interrupt, so it must not be slower.
+	// Best of TIMING_ROUNDS alternated rounds: the fastest round of each path is the one least disturbed by the host
+	EEPROM_initialize(); // standard 1D maps committed
+	const INJ_calib_struct* calib = INJ_calib_active;
+	volatile uint16_t sink = 0;
+	uint64_t best_2d = ~0ULL, best_1d = ~0ULL;
+	for (uint8_t round=0; round<TIMING_ROUNDS; round++){
+		uint64_t t0 = now_ns();
+		for (uint32_t k=0; k<4; k++) for (uint32_t x=0; x<=0xFFFF; x+=7) sink += map.interpolate((uint16_t)x, ADCmgr_throttle_signal_read());
+		uint64_t t1 = now_ns();
+		for (uint32_t k=0; k<4; k++) for (uint32_t x=0; x<=0xFFFF; x+=7) sink += INJmgr.interpolate_rpm_map(calib, (uint16_t)x) + INJmgr.interpolate_thr_map(calib);
+		uint64_t t2 = now_ns();
+		if ((t1 - t0) < best_2d) best_2d = t1 - t0;
+		if ((t2 - t1) < best_1d) best_1d = t2 - t1;
+	}
+	double calls = 4.0 * (0x10000 / 7 + 1);
+	printf("host time per call (best of %u rounds): 2D map %.1f ns, 1D rpm + throttle maps %.1f ns\n", TIMING_ROUNDS, best_2d / calls, best_1d / calls);
+	CHECK(best_2d * 100 <= best_1d * TIMING_TOLERANCE_PERC, "2D map slower than the 1D maps: %.1f ns, 1D %.1f ns (tolerance %u%%)", best_2d / calls, best_1d / calls, TIMING_TOLERANCE_PERC);
+
+	if (errors){
+		printf("%u errors\n", errors);
+		return 1;
+	}
+	printf("OK\n");
+	return 0;
+
+}
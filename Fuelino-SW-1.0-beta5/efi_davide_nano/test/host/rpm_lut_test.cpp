@@ -0,0 +1,100 @@
+// Davide Cavaliere
+// www.monocilindro.com
+// dadez87-at-gmail-com
+// RPM correction lookup table test (host): "INJmgr.interpolate_rpm_map()" (lookup table, used by the injection interrupt) is compared, on the whole delta_time_tick range,
+// with the breakpoint scan "interpolate_rpm_map_scan()" (used to build the table) and with the exact linear interpolation of the map. Then both are timed
+
+#include <Arduino.h>
+#include <stdio.h>
+#include <time.h>
+#include "INJmgr/INJmgr.h"
+
+extern uint16_t interpolate_rpm_map_scan(uint16_t delta_ticks); // INJmgr.cpp, breakpoint scan on the shadow calibration set
+extern INJ_calib_struct* volatile INJ_calib_active; // INJmgr.cpp
+
+// Breakpoints of "incrementi_rpm_brkpts" (INJmgr.cpp, internal linkage). A difference is found by the scan check below (scan is compared with the exact interpolation on these breakpoints)
+static const uint16_t incrementi_rpm_brkpts[INJ_INCR_RPM_MAPS_SIZE] = {2600, 3112, 4136, 5160, 7208, 11304, 15400, 23592};
+
+#define LUT_ERR_MAX 0 // maximum difference from the exact interpolation (2e16 = 100%): breakpoints are on the grid and segment lengths are powers of 2, so the table blend is exact
+#define MAPS_NUM 200 // random maps tested
+
+static uint32_t errors = 0;
+#define CHECK(cond, ...) do{ if (!(cond)){ if (errors++ < 10) { printf("FAIL %s:%d: ", __FILE__, __LINE__); printf(__VA_ARGS__); printf("\n"); } } }while(0)
+
+static uint32_t lcg = 1;
+static uint8_t rnd8() { lcg = lcg * 1103515245u + 12345u; return (uint8_t)(lcg >> 16); }
+
+static inline uint64_t now_ns(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// Exact interpolation of the map (map values: 2e8 = 50%, result: 2e16 = 100%)
+static uint16_t rpm_map_exact(const uint8_t* map, uint16_t x){
+	if (x <= incrementi_rpm_brkpts[0]) return (uint16_t)map[0] << 7;
+	if (x >= incrementi_rpm_brkpts[INJ_INCR_RPM_MAPS_SIZE - 1]) return (uint16_t)map[INJ_INCR_RPM_MAPS_SIZE - 1] << 7;
+	uint8_t i = 0;
+	while (x >= incrementi_rpm_brkpts[i + 1]) i++;
+	int32_t y0 = (int32_t)map[i] << 7;
+	int32_t dy = ((int32_t)map[i + 1] - (int32_t)map[i]) * 128;
+	int32_t dx = incrementi_rpm_brkpts[i + 1] - incrementi_rpm_brkpts[i];
+	int32_t num = dy * (int32_t)(x - incrementi_rpm_brkpts[i]);
+	return (uint16_t)(y0 + num / dx); // rounded towards y0, as the firmware does
+}
+
+int main(){
+
+	// Breakpoints must be on the table grid, otherwise the table cannot reproduce the map corners
+	for (uint8_t i=0; i<INJ_INCR_RPM_MAPS_SIZE; i++){
+		uint16_t b = incrementi_rpm_brkpts[i];
+		CHECK((b >= INJ_RPM_LUT_START_TICKS) && (((b - INJ_RPM_LUT_START_TICKS) & ((1 << INJ_RPM_LUT_STEP_SHIFT) - 1)) == 0), "breakpoint %u (%u ticks) is not on the table grid", i, b);
+	}
+	CHECK(incrementi_rpm_brkpts[INJ_INCR_RPM_MAPS_SIZE - 1] == INJ_RPM_LUT_START_TICKS + ((INJ_RPM_LUT_SIZE - 1) << INJ_RPM_LUT_STEP_SHIFT), "last breakpoint is not the last table point (INJ_RPM_LUT_SIZE)");
+
+	// Random maps (first ones: flat, maximum slopes): table, scan and exact interpolation, on all delta_time_tick values
+	uint16_t err_max = 0;
+	for (uint16_t m=0; m<MAPS_NUM; m++){
+		for (uint8_t i=0; i<INJ_INCR_RPM_MAPS_SIZE; i++){
+			uint8_t v = rnd8();
+			if (m == 0) v = 128;
+			if (m == 1) v = (i & 1) ? 255 : 0;
+			if (m == 2) v = (i & 1) ? 0 : 255;
+			INJ_calib_shadow->incrementi_rpm[i] = v;
+		}
+		INJmgr.calib_commit(); // table built, shadow set is a copy of the active one
+		const INJ_calib_struct* calib = INJ_calib_active;
+		for (uint32_t x=0; x<=0xFFFF; x++){
+			uint16_t lut = INJmgr.interpolate_rpm_map(calib, (uint16_t)x);
+			uint16_t scan = interpolate_rpm_map_scan((uint16_t)x);
+			uint16_t exact = rpm_map_exact(calib->incrementi_rpm, (uint16_t)x);
+			uint16_t err = (lut > exact) ? (lut - exact) : (exact - lut);
+			if (err > err_max) err_max = err;
+			CHECK(err <= LUT_ERR_MAX, "map %u, x %u: table %u, exact %u", m, (unsigned)x, lut, exact);
+			CHECK(scan == exact, "map %u, x %u: scan %u, exact %u", m, (unsigned)x, scan, exact);
+			if ((x >= INJ_RPM_LUT_START_TICKS) && (((x - INJ_RPM_LUT_START_TICKS) & ((1 << INJ_RPM_LUT_STEP_SHIFT) - 1)) == 0)){
+				CHECK(lut == exact, "map %u, grid point %u: table %u, exact %u", m, (unsigned)x, lut, exact);
+			}
+		}
+	}
+	printf("rpm lookup table: %u maps x 65536 points, max difference from exact interpolation %u (2e16 = 100%%)\n", MAPS_NUM, err_max);
+
+	// Timing (host ns per call, same inputs for both)
+	const INJ_calib_struct* calib = INJ_calib_active;
+	volatile uint16_t sink = 0;
+	uint64_t t0 = now_ns();
+	for (uint32_t k=0; k<20; k++) for (uint32_t x=0; x<=0xFFFF; x+=7) sink += INJmgr.interpolate_rpm_map(calib, (uint16_t)x);
+	uint64_t t1 = now_ns();
+	for (uint32_t k=0; k<20; k++) for (uint32_t x=0; x<=0xFFFF; x+=7) sink += interpolate_rpm_map_scan((uint16_t)x);
+	uint64_t t2 = now_ns();
+	double calls = 20.0 * (0x10000 / 7 + 1);
+	printf("host time per call: table %.1f ns, breakpoint scan %.1f ns\n", (t1 - t0) / calls, (t2 - t1) / calls);
+
+	if (errors){
+		printf("%u errors\n", errors);
+		return 1;
+	}
+	printf("OK\n");
+	return 0;
+
+}
@@ -0,0 +1,383 @@
+// Davide Cavaliere
+// www.monocilindro.com
+// dadez87-at-gmail-com
+// ISR latency benchmark (simavr): the AVR firmware (efi_davide_nano.ino, built with ISR_TRACE_PINS_ENABLE = 1, see Makefile) runs cycle-exact on a simulated ATmega 328p at 16MHz.
+// Stimuli: injector input D6 (PD6) at the requested engine speeds, Throttle (A2), Lambda (A3) and battery (A6) voltages, and a continuous UBX stream at 9600 baud on the SWseriale RX pin D2 (GPS).
+// Measured, in clock cycles: injector input edge -> injector output D8 (PB0), input edge -> ISR(PCINT2_vect) trace pin D3, Timer1 compare -> injector output OFF (extension end),
+// for each interrupt the entry latency (flag raised -> vector executed), the vector execution time and the trace pin time (D3, D5, D7, D9), and the interrupts that delayed each other.
+// Usage: isr_latency FIRMWARE_ELF INJECTIONS RPM [RPM ...]. Exit code 1 if an injection was missed, or if the trace pins never toggled (firmware built without ISR_TRACE_PINS_ENABLE)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+#include "sim_avr.h"
+#include "sim_elf.h"
+#include "sim_irq.h"
+#include "sim_interrupts.h"
+#include "sim_cycle_timers.h"
+#include "avr_ioport.h"
+#include "avr_adc.h"
+#include "avr_uart.h"
+
+#define F_CPU_HZ 16000000UL // Fuelino clock
+#define INJ_PULSE_CYCLES (2500UL * 16) // ECU injection pulse: 2.5ms (extended by the firmware)
+#define INJ_JITTER_CYCLES 512 // random variation of the engine cycle (+-32us), so that the edges fall at all the phases of the ADC, Timer2 and Main Loop activity (below the 0.75% steady state limit)
+#define STIMULI_START_CYCLES (2000UL * 16000) // first injection after 2s: GPS_initialize (1.6s of delays) is finished
+#define WARMUP_CYCLES (3000UL * 16000) // first engine speed: 3s of injections not measured (cranking filter, then steady state: engine running)
+#define SETTLE_INJECTIONS 20 // injections not measured after each engine speed change
+#define LATENCY_BASE_CYCLES 6 // entry latency up to this value: only the instruction in execution (not counted as blocked)
+#define GPS_BAUD 9600 // SWseriale baudrate
+#define THROTTLE_MV 1500 // Throttle voltage (A2)
+#define BATTERY_MV 3500 // Battery voltage divider output (A6)
+
+// Interrupts observed. The first ones have a trace pin (ISRmgr.h), the others are observed only as cause of delays
+struct vector_info{
+	uint8_t num; // vector number (ATmega 328p)
+	const char* name;
+	int8_t trace; // trace pin index (trace_pins), -1 if none
+};
+static const vector_info vectors[] = {
+	{5, "PCINT2", 0}, {11, "TIMER1_COMPA", 1}, {12, "TIMER1_COMPB", 1}, {21, "ADC", 2}, {7, "TIMER2_COMPA", 3},
+	{1, "INT0", -1}, {6, "WDT", -1}, {13, "TIMER1_OVF", -1}, {16, "TIMER0_OVF", -1}, {17, "SPI_STC", -1}, {18, "USART_RX", -1}, {19, "USART_UDRE", -1}, {20, "USART_TX", -1}, {24, "TWI", -1}
+};
+#define VECTORS_NUM (sizeof(vectors) / sizeof(vectors[0]))
+#define VECTORS_TRACED 5 // vectors with trace pin (first ones)
+#define VECTOR_T1A 1 // index of TIMER1_COMPA (injector 1 extension)
+#define CULPRIT_CLI VECTORS_NUM // entry delayed with no other interrupt executing: interrupts disabled by Main Loop or by a library
+
+// Trace pins (ISRmgr.h)
+struct trace_pin_info{
+	char port;
+	uint8_t bit;
+	const char* name;
+};
+static const trace_pin_info trace_pins[] = { {'D', 3, "D3 PCINT2"}, {'D', 5, "D5 TIMER1"}, {'D', 7, "D7 ADC"}, {'B', 1, "D9 TIMER2"} };
+#define TRACE_PINS_NUM 4
+
+typedef std::vector<uint32_t> samples_t; // measures in clock cycles
+
+// Results of one engine speed
+struct step_result{
+	uint16_t rpm;
+	uint32_t period; // engine cycle (2 rotations), clock cycles
+	samples_t on_latency; // input ON edge -> injector output HIGH
+	samples_t pcint_latency; // input edge -> trace pin D3 HIGH
+	samples_t ext_late; // TIMER1_COMPA flag -> injector output LOW (extension end)
+	samples_t t1a_entry; // TIMER1_COMPA entry latency
+	uint32_t missed; // ON edges without injector output
+};
+
+static avr_t* avr = NULL;
+static std::vector<step_result> steps;
+static uint32_t step_index = 0;
+static bool measuring = false; // results are recorded
+static bool finished = false; // all engine speeds done
+
+// Interrupts state
+static avr_cycle_count_t vec_pending_since[VECTORS_NUM]; // flag raised at (0: not pending)
+static uint32_t vec_wait_mask[VECTORS_NUM]; // vectors executed while this one was pending
+static avr_cycle_count_t vec_running_since[VECTORS_NUM];
+static uint32_t running_mask = 0; // vectors executing (nested only if an ISR enables interrupts)
+static samples_t vec_entry[VECTORS_NUM]; // entry latency
+static samples_t vec_exec[VECTORS_NUM]; // vector execution (RETI included)
+static uint32_t blocked_count[VECTORS_TRACED][VECTORS_NUM + 1]; // entries delayed by another vector, or by disabled interrupts (last column)
+static uint32_t blocked_max[VECTORS_TRACED][VECTORS_NUM + 1]; // worst entry latency in those cases
+static avr_cycle_count_t trace_since[TRACE_PINS_NUM];
+static samples_t trace_high[TRACE_PINS_NUM]; // trace pin HIGH time (ISR body)
+static uint32_t trace_edges = 0;
+
+// Injector state
+static avr_irq_t* inj_in_irq = NULL;
+static avr_cycle_count_t inj_on_edge = 0; // ON edge without output yet (0: none)
+static avr_cycle_count_t inj_last_edge = 0; // last edge, until the PCINT2 trace pin rises
+static avr_cycle_count_t t1a_pending = 0; // TIMER1_COMPA flag, until the injector output falls
+static uint32_t inj_count = 0; // injections of this engine speed
+static uint32_t inj_settle = 0; // injections not measured
+static uint32_t inj_measured = 0; // injections to measure
+static uint32_t lcg = 1;
+
+static uint32_t rnd(){ lcg = lcg * 1103515245u + 12345u; return lcg >> 16; }
+
+// Interrupt flag raised (value 1) or cleared (value 0)
+static void vector_pending(avr_irq_t* irq, uint32_t value, void* param){
+	uint32_t v = (uint32_t)(uintptr_t)param;
+	if (value && !vec_pending_since[v]){
+		vec_pending_since[v] = avr->cycle;
+		vec_wait_mask[v] = running_mask; // an interrupt raised during another ISR waits its end
+	}else if (!value){
+		vec_pending_since[v] = 0; // serviced (after "vector_running"), or flag cleared by the firmware
+	}
+	if (v == VECTOR_T1A && value && !t1a_pending) t1a_pending = avr->cycle;
+}
+
+// Vector executed (value 1) or RETI (value 0)
+static void vector_running(avr_irq_t* irq, uint32_t value, void* param){
+	uint32_t v = (uint32_t)(uintptr_t)param;
+	if (value){
+		for (uint32_t k=0; k<VECTORS_NUM; k++) if (vec_pending_since[k] && (k != v)) vec_wait_mask[k] |= (1UL << v); // this vector delays the pending ones
+		if (vec_pending_since[v] && measuring){
+			uint32_t latency = (uint32_t)(avr->cycle - vec_pending_since[v]);
+			vec_entry[v].push_back(latency);
+			if (v == VECTOR_T1A) steps[step_index].t1a_entry.push_back(latency);
+			if (v < VECTORS_TRACED){
+				uint32_t mask = vec_wait_mask[v];
+				if (!mask && (latency > LATENCY_BASE_CYCLES)) mask = (1UL << CULPRIT_CLI);
+				for (uint32_t k=0; k<=VECTORS_NUM; k++){
+					if (mask & (1UL << k)){
+						blocked_count[v][k]++;
+						if (latency > blocked_max[v][k]) blocked_max[v][k] = latency;
+					}
+				}
+			}
+		}
+		vec_pending_since[v] = 0;
+		vec_running_since[v] = avr->cycle;
+		running_mask |= (1UL << v);
+	}else{
+		if ((running_mask & (1UL << v)) && measuring) vec_exec[v].push_back((uint32_t)(avr->cycle - vec_running_since[v]));
+		running_mask &= ~(1UL << v);
+	}
+}
+
+// Trace pin change
+static void trace_pin_changed(avr_irq_t* irq, uint32_t value, void* param){
+	uint32_t p = (uint32_t)(uintptr_t)param;
+	trace_edges++;
+	if (value){
+		trace_since[p] = avr->cycle;
+		if ((p == 0) && inj_last_edge){ // PCINT2 body reached
+			if (measuring) steps[step_index].pcint_latency.push_back((uint32_t)(avr->cycle - inj_last_edge));
+			inj_last_edge = 0;
+		}
+	}else if (trace_since[p]){
+		if (measuring) trace_high[p].push_back((uint32_t)(avr->cycle - trace_since[p]));
+		trace_since[p] = 0;
+	}
+}
+
+// Injector output D8 (PB0) change
+static void inj_out_changed(avr_irq_t* irq, uint32_t value, void* param){
+	if (value){
+		if (inj_on_edge && measuring) steps[step_index].on_latency.push_back((uint32_t)(avr->cycle - inj_on_edge));
+		inj_on_edge = 0;
+	}else{
+		if (t1a_pending && measuring) steps[step_index].ext_late.push_back((uint32_t)(avr->cycle - t1a_pending));
+		t1a_pending = 0;
+	}
+}
+
+// Starts one engine speed
+static void step_start(){
+	inj_count = 0;
+	inj_settle = SETTLE_INJECTIONS;
+	if (step_index == 0) inj_settle += (uint32_t)(WARMUP_CYCLES / steps[0].period);
+}
+
+// Injector input D6 (PD6): LOW = ON for the pulse, then HIGH until the next engine cycle. Returns the time of the next edge
+static avr_cycle_count_t inj_stimulus(avr_t* avr_p, avr_cycle_count_t when, void* param){
+	static bool on = false;
+	if (finished) return 0;
+	step_result* st = &steps[step_index];
+	if (!on){ // ON edge
+		measuring = (inj_count >= inj_settle);
+		on = true;
+		inj_on_edge = when;
+		inj_last_edge = when;
+		avr_raise_irq(inj_in_irq, 0);
+		return when + INJ_PULSE_CYCLES;
+	}
+	// OFF edge
+	if (inj_on_edge && measuring) st->missed++; // output never activated
+	inj_on_edge = 0;
+	on = false;
+	inj_last_edge = when;
+	avr_raise_irq(inj_in_irq, 1);
+	if (++inj_count >= inj_settle + inj_measured){ // next engine speed
+		if (++step_index >= steps.size()){
+			finished = true;
+			measuring = false;
+			return 0;
+		}
+		step_start();
+		st = &steps[step_index];
+	}
+	int32_t jitter = (int32_t)(rnd() % (2 * INJ_JITTER_CYCLES + 1)) - INJ_JITTER_CYCLES;
+	return when + (st->period - INJ_PULSE_CYCLES) + jitter;
+}
+
+// GPS on SWseriale RX D2 (PD2): back to back UBX NAV-POSLLH frames (9600 baud, 8N1, one idle bit between bytes)
+static avr_irq_t* gps_rx_irq = NULL;
+static uint8_t gps_frame[8 + 28];
+static avr_cycle_count_t gps_stimulus(avr_t* avr_p, avr_cycle_count_t when, void* param){
+	static uint32_t byte_index = 0, bit = 0;
+	static avr_cycle_count_t byte_start = 0;
+	if (finished) return 0;
+	if (bit == 0) byte_start = when;
+	uint8_t b = gps_frame[byte_index];
+	uint8_t level = (bit == 0) ? 0 : ((bit <= 8) ? ((b >> (bit - 1)) & 1) : 1); // start, data (LSB first), stop and idle
+	avr_raise_irq(gps_rx_irq, level);
+	if (++bit > 10){ // stop and idle bits done
+		bit = 0;
+		byte_index = (byte_index + 1) % sizeof(gps_frame);
+		return byte_start + (11ULL * F_CPU_HZ) / GPS_BAUD;
+	}
+	return byte_start + ((uint64_t)bit * F_CPU_HZ) / GPS_BAUD; // exact bit times (no accumulated rounding)
+}
+
+// Lambda voltage (A3): slow triangle 100 - 900mV, updated each 1ms
+static avr_irq_t* lambda_irq = NULL;
+static avr_cycle_count_t lambda_stimulus(avr_t* avr_p, avr_cycle_count_t when, void* param){
+	static uint32_t n = 0;
+	if (finished) return 0;
+	uint32_t pos = n++ % 400;
+	avr_raise_irq(lambda_irq, 100 + ((pos < 200) ? pos : (400 - pos)) * 4);
+	return when + F_CPU_HZ / 1000;
+}
+
+// Prints one measure: count, min, p50, p99, max, jitter (cycles), max (us)
+static void print_samples(const char* name, samples_t s){
+	if (s.empty()){
+		printf("  %-34s %7u\n", name, 0);
+		return;
+	}
+	std::sort(s.begin(), s.end());
+	uint32_t n = (uint32_t)s.size();
+	printf("  %-34s %7u %7u %7u %7u %7u %7u %9.2f\n", name, n, s[0], s[n / 2], s[((n - 1) * 99) / 100], s[n - 1], s[n - 1] - s[0], s[n - 1] * 1e6 / F_CPU_HZ);
+}
+
+static void print_header(){
+	printf("  %-34s %7s %7s %7s %7s %7s %7s %9s\n", "(clock cycles, 62.5ns)", "n", "min", "p50", "p99", "max", "jitter", "max [us]");
+}
+
+int main(int argc, char** argv){
+
+	if (argc < 4){
+		fprintf(stderr, "usage: %s FIRMWARE_ELF INJECTIONS RPM [RPM ...]\n", argv[0]);
+		return 2;
+	}
+	inj_measured = (uint32_t)atoi(argv[2]);
+	for (int i=3; i<argc; i++){
+		step_result st = step_result();
+		st.rpm = (uint16_t)atoi(argv[i]);
+		if ((st.rpm < 750) || (st.rpm > 12000)){ // steady state range (INJ_STEADY_STATE_DELTA_TICKS_MIN, MAX)
+			fprintf(stderr, "%u rpm: out of range (750 - 12000)\n", st.rpm);
+			return 2;
+		}
+		st.period = (uint32_t)((120ULL * F_CPU_HZ) / st.rpm); // one injection each 2 rotations
+		steps.push_back(st);
+	}
+
+	// Firmware
+	elf_firmware_t fw;
+	memset(&fw, 0, sizeof(fw));
+	if (elf_read_firmware(argv[1], &fw) != 0){
+		fprintf(stderr, "%s: cannot read\n", argv[1]);
+		return 2;
+	}
+	avr = avr_make_mcu_by_name("atmega328p");
+	if (!avr){
+		fprintf(stderr, "simavr: no atmega328p core\n");
+		return 2;
+	}
+	avr_init(avr);
+	fw.frequency = F_CPU_HZ;
+	avr_load_firmware(avr, &fw);
+	avr->frequency = F_CPU_HZ;
+	avr->vcc = avr->avcc = avr->aref = 5000; // mV
+
+	// USB serial: no echo of the firmware packets on stdout
+	uint32_t uart_flags = 0;
+	avr_ioctl(avr, AVR_IOCTL_UART_GET_FLAGS('0'), &uart_flags);
+	uart_flags &= ~AVR_UART_FLAG_STDIO;
+	avr_ioctl(avr, AVR_IOCTL_UART_SET_FLAGS('0'), &uart_flags);
+
+	// Observers
+	for (uint32_t v=0; v<VECTORS_NUM; v++){
+		avr_irq_t* irq = avr_get_interrupt_irq(avr, vectors[v].num);
+		if (!irq) continue;
+		avr_irq_register_notify(irq + AVR_INT_IRQ_PENDING, vector_pending, (void*)(uintptr_t)v);
+		avr_irq_register_notify(irq + AVR_INT_IRQ_RUNNING, vector_running, (void*)(uintptr_t)v);
+	}
+	for (uint32_t p=0; p<TRACE_PINS_NUM; p++){
+		avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(trace_pins[p].port), trace_pins[p].bit), trace_pin_changed, (void*)(uintptr_t)p);
+	}
+	avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('B'), 0), inj_out_changed, NULL); // D8: injector output (Fuelino V2)
+
+	// Stimuli
+	inj_in_irq = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('D'), 6); // D6: injector input (Fuelino V2), HIGH = OFF
+	avr_raise_irq(inj_in_irq, 1);
+	gps_rx_irq = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('D'), 2); // D2: SWseriale RX (INT0)
+	avr_raise_irq(gps_rx_irq, 1); // idle
+	uint8_t* f = gps_frame; // UBX NAV-POSLLH: sync, class, id, length (28), payload, checksum
+	f[0] = 0xB5; f[1] = 0x62; f[2] = 0x01; f[3] = 0x02; f[4] = 28; f[5] = 0;
+	for (uint8_t i=0; i<28; i++) f[6 + i] = (uint8_t)(rnd() & 0xFF);
+	uint8_t ck_a = 0, ck_b = 0;
+	for (uint8_t i=2; i<6 + 28; i++){ ck_a += f[i]; ck_b += ck_a; }
+	f[34] = ck_a; f[35] = ck_b;
+	avr_raise_irq(avr_io_getirq(avr, AVR_IOCTL_ADC_GETIRQ, ADC_IRQ_ADC2), THROTTLE_MV);
+	avr_raise_irq(avr_io_getirq(avr, AVR_IOCTL_ADC_GETIRQ, ADC_IRQ_ADC6), BATTERY_MV);
+	lambda_irq = avr_io_getirq(avr, AVR_IOCTL_ADC_GETIRQ, ADC_IRQ_ADC3);
+	step_start();
+	avr_cycle_timer_register(avr, STIMULI_START_CYCLES, inj_stimulus, NULL);
+	avr_cycle_timer_register(avr, STIMULI_START_CYCLES, gps_stimulus, NULL);
+	avr_cycle_timer_register(avr, 1, lambda_stimulus, NULL);
+
+	// Simulation
+	int state = cpu_Running;
+	while (!finished && (state != cpu_Done) && (state != cpu_Crashed)) state = avr_run(avr);
+	if (!finished){
+		fprintf(stderr, "simavr: firmware stopped (state %d) at cycle %llu\n", state, (unsigned long long)avr->cycle);
+		return 2;
+	}
+
+	// Report
+	uint32_t missed = 0;
+	printf("ISR latency benchmark (simavr, ATmega 328p 16MHz): %u injections per engine speed, ECU pulse %.2f ms\n", inj_measured, INJ_PULSE_CYCLES * 1e3 / F_CPU_HZ);
+	for (uint32_t i=0; i<steps.size(); i++){
+		step_result* st = &steps[i];
+		printf("\n== %u rpm (engine cycle %.3f ms), %u injections missed\n", st->rpm, st->period * 1e3 / F_CPU_HZ, st->missed);
+		print_header();
+		print_samples("input ON edge -> injector output", st->on_latency);
+		print_samples("input edge -> PCINT2 trace pin", st->pcint_latency);
+		print_samples("TIMER1_COMPA flag -> output OFF", st->ext_late);
+		print_samples("TIMER1_COMPA entry latency", st->t1a_entry);
+		missed += st->missed;
+	}
+	printf("\n== Interrupts, all engine speeds: entry latency (flag -> vector), vector execution (to RETI), trace pin HIGH (ISR body)\n");
+	print_header();
+	for (uint32_t v=0; v<VECTORS_NUM; v++){
+		if (vec_entry[v].empty() && vec_exec[v].empty()) continue;
+		char name[48];
+		snprintf(name, sizeof(name), "%s entry", vectors[v].name);
+		print_samples(name, vec_entry[v]);
+		snprintf(name, sizeof(name), "%s execution", vectors[v].name);
+		print_samples(name, vec_exec[v]);
+	}
+	for (uint32_t p=0; p<TRACE_PINS_NUM; p++){
+		char name[48];
+		snprintf(name, sizeof(name), "trace %s HIGH", trace_pins[p].name);
+		print_samples(name, trace_high[p]);
+	}
+	printf("\n== Entry delays: interrupt delayed by (count, worst entry latency in cycles)\n");
+	for (uint32_t v=0; v<VECTORS_TRACED; v++){
+		for (uint32_t k=0; k<=VECTORS_NUM; k++){
+			if (!blocked_count[v][k]) continue;
+			printf("  %-14s by %-40s %7u %7u\n", vectors[v].name, (k == CULPRIT_CLI) ? "interrupts disabled (Main Loop, libraries)" : vectors[k].name, blocked_count[v][k], blocked_max[v][k]);
+		}
+	}
+
+	if (!trace_edges){
+		printf("\nFAIL: the trace pins never changed (firmware built without ISR_TRACE_PINS_ENABLE)\n");
+		return 1;
+	}
+	if (missed){
+		printf("\nFAIL: %u injections missed\n", missed);
+		return 1;
+	}
+	printf("\nOK\n");
+	return 0;
+
+}